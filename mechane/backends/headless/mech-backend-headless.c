@@ -0,0 +1,124 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mechane/mech-container.h>
+#include "mech-backend-headless.h"
+#include "mech-window-headless.h"
+#include "mech-surface-headless.h"
+#include "mech-seat-headless.h"
+#include "mech-cursor-headless.h"
+
+G_DEFINE_TYPE (MechBackendHeadless, _mech_backend_headless, MECH_TYPE_BACKEND)
+
+struct _MechBackendHeadlessPriv
+{
+  MechSeat *seat;
+  guint32 serial;
+};
+
+static MechWindow *
+_mech_backend_headless_create_window (MechBackend *backend)
+{
+  return _mech_window_headless_new ();
+}
+
+static MechSurface *
+_mech_backend_headless_create_surface (MechBackend     *backend,
+                                       MechSurface     *parent,
+                                       MechSurfaceType  surface_type)
+{
+  return _mech_surface_headless_new (surface_type, parent);
+}
+
+static MechCursor *
+_mech_backend_headless_create_cursor (MechBackend    *backend,
+                                      MechCursorType  cursor_type)
+{
+  return g_object_new (MECH_TYPE_CURSOR_HEADLESS,
+                       "cursor-type", cursor_type,
+                       NULL);
+}
+
+static void
+_mech_backend_headless_class_init (MechBackendHeadlessClass *klass)
+{
+  MechBackendClass *backend_class = MECH_BACKEND_CLASS (klass);
+
+  backend_class->create_window = _mech_backend_headless_create_window;
+  backend_class->create_surface = _mech_backend_headless_create_surface;
+  backend_class->create_cursor = _mech_backend_headless_create_cursor;
+
+  g_type_class_add_private (klass, sizeof (MechBackendHeadlessPriv));
+}
+
+static void
+_mech_backend_headless_init (MechBackendHeadless *backend)
+{
+  MechBackendHeadlessPriv *priv;
+
+  backend->_priv = priv =
+    G_TYPE_INSTANCE_GET_PRIVATE (backend,
+                                 MECH_TYPE_BACKEND_HEADLESS,
+                                 MechBackendHeadlessPriv);
+  priv->seat = mech_seat_headless_new ();
+}
+
+MechBackendHeadless *
+_mech_backend_headless_get (void)
+{
+  static MechBackendHeadless *backend = NULL;
+
+  if (g_once_init_enter (&backend))
+    {
+      MechBackendHeadless *object;
+
+      object = g_object_new (MECH_TYPE_BACKEND_HEADLESS, NULL);
+      g_once_init_leave (&backend, object);
+    }
+
+  return backend;
+}
+
+MechSeat *
+_mech_backend_headless_get_seat (MechBackendHeadless *backend)
+{
+  return backend->_priv->seat;
+}
+
+gboolean
+_mech_backend_headless_inject_event (MechBackendHeadless *backend,
+                                     MechWindow          *window,
+                                     MechEvent           *event)
+{
+  MechBackendHeadlessPriv *priv;
+
+  priv = backend->_priv;
+
+  /* Fill in what a real seat would, unless the caller did */
+  if (!event->any.seat)
+    event->any.seat = priv->seat;
+
+  if (event->any.serial == 0)
+    event->any.serial = ++priv->serial;
+
+  if ((event->type == MECH_KEY_PRESS || event->type == MECH_KEY_RELEASE) &&
+      event->input.modifiers == 0)
+    event->input.modifiers = mech_seat_get_modifiers (event->any.seat,
+                                                      NULL, NULL, NULL);
+
+  return mech_container_handle_event ((MechContainer *) window, event);
+}
@@ -0,0 +1,59 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_BACKEND_HEADLESS_H__
+#define __MECH_BACKEND_HEADLESS_H__
+
+#include <mechane/mech-backend-private.h>
+#include <mechane/mech-events.h>
+
+G_BEGIN_DECLS
+
+#define MECH_TYPE_BACKEND_HEADLESS         (_mech_backend_headless_get_type ())
+#define MECH_BACKEND_HEADLESS(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), MECH_TYPE_BACKEND_HEADLESS, MechBackendHeadless))
+#define MECH_BACKEND_HEADLESS_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), MECH_TYPE_BACKEND_HEADLESS, MechBackendHeadlessClass))
+#define MECH_IS_BACKEND_HEADLESS(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), MECH_TYPE_BACKEND_HEADLESS))
+#define MECH_IS_BACKEND_HEADLESS_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), MECH_TYPE_BACKEND_HEADLESS))
+#define MECH_BACKEND_HEADLESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MECH_TYPE_BACKEND_HEADLESS, MechBackendHeadlessClass))
+
+typedef struct _MechBackendHeadless MechBackendHeadless;
+typedef struct _MechBackendHeadlessClass MechBackendHeadlessClass;
+typedef struct _MechBackendHeadlessPriv MechBackendHeadlessPriv;
+
+struct _MechBackendHeadless
+{
+  MechBackend parent_instance;
+  MechBackendHeadlessPriv *_priv;
+};
+
+struct _MechBackendHeadlessClass
+{
+  MechBackendClass parent_class;
+};
+
+GType                 _mech_backend_headless_get_type     (void) G_GNUC_CONST;
+
+MechBackendHeadless * _mech_backend_headless_get          (void);
+
+MechSeat            * _mech_backend_headless_get_seat     (MechBackendHeadless *backend);
+gboolean              _mech_backend_headless_inject_event (MechBackendHeadless *backend,
+                                                           MechWindow          *window,
+                                                           MechEvent           *event);
+
+G_END_DECLS
+
+#endif /* __MECH_BACKEND_HEADLESS_H__ */
@@ -0,0 +1,109 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mech-clock-headless.h"
+
+G_DEFINE_TYPE (MechClockHeadless, mech_clock_headless, MECH_TYPE_CLOCK)
+
+struct _MechClockHeadlessPriv
+{
+  gint64 frame_time;
+  guint pending : 1;
+};
+
+static void
+mech_clock_headless_start (MechClock *clock)
+{
+  MechClockHeadlessPriv *priv = ((MechClockHeadless *) clock)->_priv;
+
+  /* Nothing happens until the next manual step */
+  priv->pending = TRUE;
+}
+
+static void
+mech_clock_headless_stop (MechClock *clock)
+{
+  MechClockHeadlessPriv *priv = ((MechClockHeadless *) clock)->_priv;
+
+  priv->pending = FALSE;
+}
+
+static gint64
+mech_clock_headless_get_time (MechClock *clock)
+{
+  MechClockHeadlessPriv *priv = ((MechClockHeadless *) clock)->_priv;
+
+  return priv->frame_time;
+}
+
+static void
+mech_clock_headless_class_init (MechClockHeadlessClass *klass)
+{
+  MechClockClass *clock_class = MECH_CLOCK_CLASS (klass);
+
+  clock_class->start = mech_clock_headless_start;
+  clock_class->stop = mech_clock_headless_stop;
+  clock_class->get_time = mech_clock_headless_get_time;
+
+  g_type_class_add_private (klass, sizeof (MechClockHeadlessPriv));
+}
+
+static void
+mech_clock_headless_init (MechClockHeadless *clock)
+{
+  clock->_priv = G_TYPE_INSTANCE_GET_PRIVATE (clock,
+                                              MECH_TYPE_CLOCK_HEADLESS,
+                                              MechClockHeadlessPriv);
+}
+
+MechClock *
+_mech_clock_headless_new (MechWindow *window)
+{
+  return g_object_new (MECH_TYPE_CLOCK_HEADLESS,
+                       "window", window,
+                       NULL);
+}
+
+gboolean
+mech_clock_headless_step (MechClockHeadless *clock,
+                          gint64             frame_time)
+{
+  MechClockHeadlessPriv *priv;
+
+  g_return_val_if_fail (MECH_IS_CLOCK_HEADLESS (clock), FALSE);
+
+  priv = clock->_priv;
+
+  if (frame_time > priv->frame_time)
+    priv->frame_time = frame_time;
+
+  if (!priv->pending)
+    return FALSE;
+
+  /* Stops the clock, and clears pending, if nothing else is queued */
+  _mech_clock_dispatch ((MechClock *) clock);
+
+  return TRUE;
+}
+
+gboolean
+mech_clock_headless_is_pending (MechClockHeadless *clock)
+{
+  g_return_val_if_fail (MECH_IS_CLOCK_HEADLESS (clock), FALSE);
+
+  return clock->_priv->pending;
+}
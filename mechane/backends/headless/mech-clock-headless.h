@@ -0,0 +1,58 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_CLOCK_HEADLESS_H__
+#define __MECH_CLOCK_HEADLESS_H__
+
+#include <mechane/mech-clock-private.h>
+#include <mechane/mech-window.h>
+
+G_BEGIN_DECLS
+
+#define MECH_TYPE_CLOCK_HEADLESS         (mech_clock_headless_get_type ())
+#define MECH_CLOCK_HEADLESS(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), MECH_TYPE_CLOCK_HEADLESS, MechClockHeadless))
+#define MECH_CLOCK_HEADLESS_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), MECH_TYPE_CLOCK_HEADLESS, MechClockHeadlessClass))
+#define MECH_IS_CLOCK_HEADLESS(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), MECH_TYPE_CLOCK_HEADLESS))
+#define MECH_IS_CLOCK_HEADLESS_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), MECH_TYPE_CLOCK_HEADLESS))
+#define MECH_CLOCK_HEADLESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MECH_TYPE_CLOCK_HEADLESS, MechClockHeadlessClass))
+
+typedef struct _MechClockHeadless MechClockHeadless;
+typedef struct _MechClockHeadlessClass MechClockHeadlessClass;
+typedef struct _MechClockHeadlessPriv MechClockHeadlessPriv;
+
+struct _MechClockHeadless
+{
+  MechClock parent_instance;
+  MechClockHeadlessPriv *_priv;
+};
+
+struct _MechClockHeadlessClass
+{
+  MechClockClass parent_class;
+};
+
+GType       mech_clock_headless_get_type (void) G_GNUC_CONST;
+
+MechClock * _mech_clock_headless_new     (MechWindow        *window);
+
+gboolean    mech_clock_headless_step     (MechClockHeadless *clock,
+                                          gint64             frame_time);
+gboolean    mech_clock_headless_is_pending (MechClockHeadless *clock);
+
+G_END_DECLS
+
+#endif /* __MECH_CLOCK_HEADLESS_H__ */
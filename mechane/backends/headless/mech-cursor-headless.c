@@ -0,0 +1,30 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mech-cursor-headless.h"
+
+G_DEFINE_TYPE (MechCursorHeadless, mech_cursor_headless, MECH_TYPE_CURSOR)
+
+static void
+mech_cursor_headless_class_init (MechCursorHeadlessClass *klass)
+{
+}
+
+static void
+mech_cursor_headless_init (MechCursorHeadless *cursor)
+{
+}
@@ -0,0 +1,105 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mechane/mech-container-private.h>
+#include <mechane/mech-headless.h>
+#include "mech-backend-headless.h"
+#include "mech-window-headless.h"
+#include "mech-surface-headless.h"
+
+static MechSurfaceHeadless *
+_headless_window_get_surface (MechWindow *window)
+{
+  MechSurface *surface;
+
+  surface = _mech_container_get_surface ((MechContainer *) window);
+
+  if (!MECH_IS_SURFACE_HEADLESS (surface))
+    return NULL;
+
+  return (MechSurfaceHeadless *) surface;
+}
+
+MechSeat *
+mech_headless_get_seat (void)
+{
+  return _mech_backend_headless_get_seat (_mech_backend_headless_get ());
+}
+
+gboolean
+mech_headless_step (MechWindow *window,
+                    gint64      frame_time)
+{
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), FALSE);
+
+  return mech_window_headless_step ((MechWindowHeadless *) window,
+                                    frame_time);
+}
+
+gboolean
+mech_headless_inject_event (MechWindow *window,
+                            MechEvent  *event)
+{
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), FALSE);
+  g_return_val_if_fail (event != NULL, FALSE);
+
+  return _mech_backend_headless_inject_event (_mech_backend_headless_get (),
+                                              window, event);
+}
+
+guint
+mech_headless_get_n_updates (MechWindow *window)
+{
+  MechSurfaceHeadless *surface;
+
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), 0);
+
+  surface = _headless_window_get_surface (window);
+
+  if (!surface)
+    return 0;
+
+  return mech_surface_headless_get_n_updates (surface);
+}
+
+void
+mech_headless_get_damage (MechWindow *window,
+                          guint64    *last_frame,
+                          guint64    *total)
+{
+  MechSurfaceHeadless *surface;
+
+  g_return_if_fail (MECH_IS_WINDOW_HEADLESS (window));
+
+  if (last_frame)
+    *last_frame = 0;
+  if (total)
+    *total = 0;
+
+  surface = _headless_window_get_surface (window);
+
+  if (surface)
+    mech_surface_headless_get_damage (surface, last_frame, total);
+}
+
+cairo_surface_t *
+mech_headless_get_image (MechWindow *window)
+{
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), NULL);
+
+  return mech_window_headless_get_image ((MechWindowHeadless *) window);
+}
@@ -0,0 +1,77 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mech-seat-headless.h"
+
+G_DEFINE_TYPE (MechSeatHeadless, mech_seat_headless, MECH_TYPE_SEAT)
+
+struct _MechSeatHeadlessPriv
+{
+  guint active;
+  guint latched;
+  guint locked;
+};
+
+static void
+mech_seat_headless_get_modifiers (MechSeat *seat,
+                                  guint    *active,
+                                  guint    *latched,
+                                  guint    *locked)
+{
+  MechSeatHeadlessPriv *priv = ((MechSeatHeadless *) seat)->_priv;
+
+  *active = priv->active;
+  *latched = priv->latched;
+  *locked = priv->locked;
+}
+
+static void
+mech_seat_headless_class_init (MechSeatHeadlessClass *klass)
+{
+  MechSeatClass *seat_class = MECH_SEAT_CLASS (klass);
+
+  seat_class->get_modifiers = mech_seat_headless_get_modifiers;
+
+  g_type_class_add_private (klass, sizeof (MechSeatHeadlessPriv));
+}
+
+static void
+mech_seat_headless_init (MechSeatHeadless *seat)
+{
+  seat->_priv = G_TYPE_INSTANCE_GET_PRIVATE (seat,
+                                             MECH_TYPE_SEAT_HEADLESS,
+                                             MechSeatHeadlessPriv);
+}
+
+MechSeat *
+mech_seat_headless_new (void)
+{
+  return g_object_new (MECH_TYPE_SEAT_HEADLESS, NULL);
+}
+
+void
+mech_seat_headless_set_modifiers (MechSeatHeadless *seat,
+                                  guint             active,
+                                  guint             latched,
+                                  guint             locked)
+{
+  g_return_if_fail (MECH_IS_SEAT_HEADLESS (seat));
+
+  seat->_priv->active = active;
+  seat->_priv->latched = latched;
+  seat->_priv->locked = locked;
+}
@@ -0,0 +1,57 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_SEAT_HEADLESS_H__
+#define __MECH_SEAT_HEADLESS_H__
+
+#include <mechane/mech-seat.h>
+
+G_BEGIN_DECLS
+
+#define MECH_TYPE_SEAT_HEADLESS         (mech_seat_headless_get_type ())
+#define MECH_SEAT_HEADLESS(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), MECH_TYPE_SEAT_HEADLESS, MechSeatHeadless))
+#define MECH_SEAT_HEADLESS_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), MECH_TYPE_SEAT_HEADLESS, MechSeatHeadlessClass))
+#define MECH_IS_SEAT_HEADLESS(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), MECH_TYPE_SEAT_HEADLESS))
+#define MECH_IS_SEAT_HEADLESS_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), MECH_TYPE_SEAT_HEADLESS))
+#define MECH_SEAT_HEADLESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MECH_TYPE_SEAT_HEADLESS, MechSeatHeadlessClass))
+
+typedef struct _MechSeatHeadless MechSeatHeadless;
+typedef struct _MechSeatHeadlessClass MechSeatHeadlessClass;
+typedef struct _MechSeatHeadlessPriv MechSeatHeadlessPriv;
+
+struct _MechSeatHeadless
+{
+  MechSeat parent_instance;
+  MechSeatHeadlessPriv *_priv;
+};
+
+struct _MechSeatHeadlessClass
+{
+  MechSeatClass parent_class;
+};
+
+GType      mech_seat_headless_get_type      (void) G_GNUC_CONST;
+
+MechSeat * mech_seat_headless_new           (void);
+void       mech_seat_headless_set_modifiers (MechSeatHeadless *seat,
+                                             guint             active,
+                                             guint             latched,
+                                             guint             locked);
+
+G_END_DECLS
+
+#endif /* __MECH_SEAT_HEADLESS_H__ */
@@ -0,0 +1,172 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mech-surface-headless.h"
+
+G_DEFINE_TYPE (MechSurfaceHeadless, mech_surface_headless, MECH_TYPE_SURFACE)
+
+struct _MechSurfaceHeadlessPriv
+{
+  cairo_surface_t *surface;
+
+  /* Damage pushed on updates, in pixels */
+  guint64 last_damage;
+  guint64 total_damage;
+  guint n_updates;
+
+  guint rendered : 1;
+};
+
+static void
+mech_surface_headless_finalize (GObject *object)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) object)->_priv;
+
+  if (priv->surface)
+    cairo_surface_destroy (priv->surface);
+
+  G_OBJECT_CLASS (mech_surface_headless_parent_class)->finalize (object);
+}
+
+static void
+mech_surface_headless_set_size (MechSurface *surface,
+                                gint         width,
+                                gint         height)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) surface)->_priv;
+
+  if (priv->surface &&
+      cairo_image_surface_get_width (priv->surface) == width &&
+      cairo_image_surface_get_height (priv->surface) == height)
+    return;
+
+  if (priv->surface)
+    cairo_surface_destroy (priv->surface);
+
+  priv->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                              width, height);
+  priv->rendered = FALSE;
+}
+
+static cairo_surface_t *
+mech_surface_headless_get_surface (MechSurface *surface)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) surface)->_priv;
+
+  return priv->surface;
+}
+
+static void
+mech_surface_headless_release (MechSurface *surface)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) surface)->_priv;
+
+  priv->rendered = TRUE;
+}
+
+static gint
+mech_surface_headless_get_age (MechSurface *surface)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) surface)->_priv;
+
+  /* Single buffered, contents are always the previous frame */
+  return (priv->rendered) ? 1 : 0;
+}
+
+static void
+mech_surface_headless_push_update (MechSurface          *surface,
+                                   const cairo_region_t *region)
+{
+  MechSurfaceHeadlessPriv *priv = ((MechSurfaceHeadless *) surface)->_priv;
+  cairo_rectangle_int_t rect;
+  gint i;
+
+  priv->last_damage = 0;
+  priv->n_updates++;
+
+  for (i = 0; i < cairo_region_num_rectangles (region); i++)
+    {
+      cairo_region_get_rectangle (region, i, &rect);
+      priv->last_damage += (guint64) rect.width * rect.height;
+    }
+
+  priv->total_damage += priv->last_damage;
+}
+
+static void
+mech_surface_headless_class_init (MechSurfaceHeadlessClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  MechSurfaceClass *surface_class = MECH_SURFACE_CLASS (klass);
+
+  object_class->finalize = mech_surface_headless_finalize;
+
+  surface_class->set_size = mech_surface_headless_set_size;
+  surface_class->get_surface = mech_surface_headless_get_surface;
+  surface_class->release = mech_surface_headless_release;
+  surface_class->get_age = mech_surface_headless_get_age;
+  surface_class->push_update = mech_surface_headless_push_update;
+
+  g_type_class_add_private (klass, sizeof (MechSurfaceHeadlessPriv));
+}
+
+static void
+mech_surface_headless_init (MechSurfaceHeadless *surface)
+{
+  surface->_priv = G_TYPE_INSTANCE_GET_PRIVATE (surface,
+                                                MECH_TYPE_SURFACE_HEADLESS,
+                                                MechSurfaceHeadlessPriv);
+  g_object_set (surface,
+                "renderer-type", MECH_RENDERER_TYPE_SOFTWARE,
+                NULL);
+}
+
+MechSurface *
+_mech_surface_headless_new (MechSurfaceType  surface_type,
+                            MechSurface     *parent)
+{
+  g_assert (surface_type != MECH_SURFACE_TYPE_NONE);
+
+  /* Everything is rendered in software, GL surfaces
+   * are just image surfaces with a different type.
+   */
+  return g_object_new (MECH_TYPE_SURFACE_HEADLESS,
+                       "surface-type", surface_type,
+                       "parent", parent,
+                       NULL);
+}
+
+guint
+mech_surface_headless_get_n_updates (MechSurfaceHeadless *surface)
+{
+  g_return_val_if_fail (MECH_IS_SURFACE_HEADLESS (surface), 0);
+
+  return surface->_priv->n_updates;
+}
+
+void
+mech_surface_headless_get_damage (MechSurfaceHeadless *surface,
+                                  guint64             *last_frame,
+                                  guint64             *total)
+{
+  g_return_if_fail (MECH_IS_SURFACE_HEADLESS (surface));
+
+  if (last_frame)
+    *last_frame = surface->_priv->last_damage;
+  if (total)
+    *total = surface->_priv->total_damage;
+}
@@ -0,0 +1,59 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_SURFACE_HEADLESS_H__
+#define __MECH_SURFACE_HEADLESS_H__
+
+#include <mechane/mech-surface-private.h>
+
+G_BEGIN_DECLS
+
+#define MECH_TYPE_SURFACE_HEADLESS         (mech_surface_headless_get_type ())
+#define MECH_SURFACE_HEADLESS(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), MECH_TYPE_SURFACE_HEADLESS, MechSurfaceHeadless))
+#define MECH_SURFACE_HEADLESS_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), MECH_TYPE_SURFACE_HEADLESS, MechSurfaceHeadlessClass))
+#define MECH_IS_SURFACE_HEADLESS(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), MECH_TYPE_SURFACE_HEADLESS))
+#define MECH_IS_SURFACE_HEADLESS_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), MECH_TYPE_SURFACE_HEADLESS))
+#define MECH_SURFACE_HEADLESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MECH_TYPE_SURFACE_HEADLESS, MechSurfaceHeadlessClass))
+
+typedef struct _MechSurfaceHeadless MechSurfaceHeadless;
+typedef struct _MechSurfaceHeadlessClass MechSurfaceHeadlessClass;
+typedef struct _MechSurfaceHeadlessPriv MechSurfaceHeadlessPriv;
+
+struct _MechSurfaceHeadless
+{
+  MechSurface parent_instance;
+  MechSurfaceHeadlessPriv *_priv;
+};
+
+struct _MechSurfaceHeadlessClass
+{
+  MechSurfaceClass parent_class;
+};
+
+GType         mech_surface_headless_get_type      (void) G_GNUC_CONST;
+
+MechSurface * _mech_surface_headless_new          (MechSurfaceType      surface_type,
+                                                   MechSurface         *parent);
+
+guint         mech_surface_headless_get_n_updates (MechSurfaceHeadless *surface);
+void          mech_surface_headless_get_damage    (MechSurfaceHeadless *surface,
+                                                   guint64             *last_frame,
+                                                   guint64             *total);
+
+G_END_DECLS
+
+#endif /* __MECH_SURFACE_HEADLESS_H__ */
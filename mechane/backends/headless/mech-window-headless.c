@@ -0,0 +1,124 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <mechane/mech-container-private.h>
+#include <mechane/mech-window-private.h>
+#include "mech-window-headless.h"
+#include "mech-clock-headless.h"
+
+G_DEFINE_TYPE (MechWindowHeadless, mech_window_headless, MECH_TYPE_WINDOW)
+
+static void
+mech_window_headless_constructed (GObject *object)
+{
+  MechClock *clock;
+
+  G_OBJECT_CLASS (mech_window_headless_parent_class)->constructed (object);
+
+  clock = _mech_clock_headless_new ((MechWindow *) object);
+  _mech_window_set_clock ((MechWindow *) object, clock);
+  g_object_unref (clock);
+}
+
+static void
+mech_window_headless_set_visible (MechWindow *window,
+                                  gboolean    visible)
+{
+}
+
+static void
+mech_window_headless_set_title (MechWindow  *window,
+                                const gchar *title)
+{
+}
+
+static gboolean
+mech_window_headless_move (MechWindow *window,
+                           MechEvent  *event)
+{
+  /* There is no window manager to move the window around */
+  return FALSE;
+}
+
+static gboolean
+mech_window_headless_resize (MechWindow    *window,
+                             MechEvent     *event,
+                             MechSideFlags  side)
+{
+  return FALSE;
+}
+
+static void
+mech_window_headless_apply_state (MechWindow      *window,
+                                  MechWindowState  state,
+                                  MechMonitor     *monitor)
+{
+}
+
+static void
+mech_window_headless_class_init (MechWindowHeadlessClass *klass)
+{
+  MechWindowClass *window_class = MECH_WINDOW_CLASS (klass);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = mech_window_headless_constructed;
+
+  window_class->set_visible = mech_window_headless_set_visible;
+  window_class->set_title = mech_window_headless_set_title;
+  window_class->move = mech_window_headless_move;
+  window_class->resize = mech_window_headless_resize;
+  window_class->apply_state = mech_window_headless_apply_state;
+}
+
+static void
+mech_window_headless_init (MechWindowHeadless *window)
+{
+}
+
+MechWindow *
+_mech_window_headless_new (void)
+{
+  return g_object_new (MECH_TYPE_WINDOW_HEADLESS, NULL);
+}
+
+gboolean
+mech_window_headless_step (MechWindowHeadless *window,
+                           gint64              frame_time)
+{
+  MechClock *clock;
+
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), FALSE);
+
+  clock = _mech_window_get_clock ((MechWindow *) window);
+
+  return mech_clock_headless_step ((MechClockHeadless *) clock, frame_time);
+}
+
+cairo_surface_t *
+mech_window_headless_get_image (MechWindowHeadless *window)
+{
+  MechSurface *surface;
+
+  g_return_val_if_fail (MECH_IS_WINDOW_HEADLESS (window), NULL);
+
+  surface = _mech_container_get_surface ((MechContainer *) window);
+
+  if (!surface)
+    return NULL;
+
+  return MECH_SURFACE_GET_CLASS (surface)->get_surface (surface);
+}
@@ -0,0 +1,55 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_WINDOW_HEADLESS_H__
+#define __MECH_WINDOW_HEADLESS_H__
+
+#include <mechane/mech-window.h>
+
+G_BEGIN_DECLS
+
+#define MECH_TYPE_WINDOW_HEADLESS         (mech_window_headless_get_type ())
+#define MECH_WINDOW_HEADLESS(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), MECH_TYPE_WINDOW_HEADLESS, MechWindowHeadless))
+#define MECH_WINDOW_HEADLESS_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k), MECH_TYPE_WINDOW_HEADLESS, MechWindowHeadlessClass))
+#define MECH_IS_WINDOW_HEADLESS(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), MECH_TYPE_WINDOW_HEADLESS))
+#define MECH_IS_WINDOW_HEADLESS_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), MECH_TYPE_WINDOW_HEADLESS))
+#define MECH_WINDOW_HEADLESS_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), MECH_TYPE_WINDOW_HEADLESS, MechWindowHeadlessClass))
+
+typedef struct _MechWindowHeadless MechWindowHeadless;
+typedef struct _MechWindowHeadlessClass MechWindowHeadlessClass;
+
+struct _MechWindowHeadless
+{
+  MechWindow parent_instance;
+};
+
+struct _MechWindowHeadlessClass
+{
+  MechWindowClass parent_class;
+};
+
+GType             mech_window_headless_get_type (void) G_GNUC_CONST;
+
+MechWindow *     _mech_window_headless_new      (void);
+
+gboolean          mech_window_headless_step     (MechWindowHeadless *window,
+                                                 gint64              frame_time);
+cairo_surface_t * mech_window_headless_get_image (MechWindowHeadless *window);
+
+G_END_DECLS
+
+#endif /* __MECH_WINDOW_HEADLESS_H__ */
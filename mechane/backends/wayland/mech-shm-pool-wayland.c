@@ -0,0 +1,433 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <glib/gstdio.h>
+#include "mech-backend-wayland.h"
+#include "mech-shm-pool-wayland.h"
+
+/* Address space mapped per segment, the backing
+ * file grows within it, so blocks never move.
+ */
+#define SEGMENT_RESERVE  (128 * 1024 * 1024)
+#define SEGMENT_MIN_SIZE (1024 * 1024)
+#define BLOCK_ALIGN      4096
+
+typedef struct _SHMSegment SHMSegment;
+typedef struct _SHMRange SHMRange;
+
+struct _SHMRange
+{
+  gsize offset;
+  gsize size;
+};
+
+struct _SHMSegment
+{
+  MechSHMPool *pool;
+  struct wl_shm_pool *wl_pool;
+  guchar *data;
+  gint fd;
+  gsize size;
+  gsize reserved;
+  GArray *free_ranges; /* Sorted by offset */
+  guint n_blocks;
+};
+
+struct _MechSHMPool
+{
+  gint ref_count;
+  GPtrArray *segments;
+};
+
+static GQuark quark_shm_pool = 0;
+
+static gint
+_create_shm_file (void)
+{
+  gchar *path;
+  gint fd;
+
+#ifdef HAVE_MEMFD_CREATE
+  fd = memfd_create ("mechane-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  if (fd >= 0)
+    {
+#ifdef F_ADD_SEALS
+      /* Segments only ever grow */
+      fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+#endif
+      return fd;
+    }
+#endif
+
+  path = g_build_filename (g_get_tmp_dir (), "mechane-buffer-XXXXXX", NULL);
+  fd = g_mkstemp (path);
+  g_unlink (path);
+  g_free (path);
+
+  return fd;
+}
+
+static gsize
+_bucket_size (gsize size)
+{
+  gsize step;
+
+  /* Round up to 1/16th of the next power of two, so
+   * slightly different sizes end up in the same bucket.
+   */
+  step = MAX (BLOCK_ALIGN, ((gsize) 1 << g_bit_storage (size)) >> 4);
+
+  return (size + step - 1) & ~(step - 1);
+}
+
+static void
+_shm_segment_return_range (SHMSegment *segment,
+                           gsize       offset,
+                           gsize       size)
+{
+  SHMRange *prev = NULL, *next = NULL, range;
+  guint i;
+
+  for (i = 0; i < segment->free_ranges->len; i++)
+    {
+      if (g_array_index (segment->free_ranges, SHMRange, i).offset > offset)
+        break;
+    }
+
+  if (i > 0)
+    prev = &g_array_index (segment->free_ranges, SHMRange, i - 1);
+  if (i < segment->free_ranges->len)
+    next = &g_array_index (segment->free_ranges, SHMRange, i);
+
+  if (prev && prev->offset + prev->size == offset)
+    {
+      prev->size += size;
+
+      if (next && prev->offset + prev->size == next->offset)
+        {
+          prev->size += next->size;
+          g_array_remove_index (segment->free_ranges, i);
+        }
+    }
+  else if (next && offset + size == next->offset)
+    {
+      next->offset = offset;
+      next->size += size;
+    }
+  else
+    {
+      range.offset = offset;
+      range.size = size;
+      g_array_insert_val (segment->free_ranges, i, range);
+    }
+}
+
+static gboolean
+_shm_segment_take_range (SHMSegment *segment,
+                         gsize       size,
+                         gsize      *offset)
+{
+  SHMRange *range, *best = NULL;
+  guint i, best_idx = 0;
+
+  for (i = 0; i < segment->free_ranges->len; i++)
+    {
+      range = &g_array_index (segment->free_ranges, SHMRange, i);
+
+      if (range->size < size)
+        continue;
+
+      if (!best || range->size < best->size)
+        {
+          best = range;
+          best_idx = i;
+        }
+
+      if (best->size == size)
+        break;
+    }
+
+  if (!best)
+    return FALSE;
+
+  *offset = best->offset;
+
+  if (best->size == size)
+    g_array_remove_index (segment->free_ranges, best_idx);
+  else
+    {
+      best->offset += size;
+      best->size -= size;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+_shm_segment_grow (SHMSegment *segment,
+                   gsize       size)
+{
+  SHMRange *last;
+  gsize needed, new_size;
+
+  needed = size;
+
+  if (segment->free_ranges->len > 0)
+    {
+      last = &g_array_index (segment->free_ranges, SHMRange,
+                             segment->free_ranges->len - 1);
+
+      /* The free tail is extended by the growth */
+      if (last->offset + last->size == segment->size)
+        needed -= last->size;
+    }
+
+  new_size = MIN (segment->reserved,
+                  MAX (segment->size * 2, segment->size + needed));
+
+  if (new_size - segment->size < needed)
+    return FALSE;
+
+  if (ftruncate (segment->fd, new_size) < 0)
+    {
+      g_warning ("Growing SHM pool failed: %m");
+      return FALSE;
+    }
+
+  wl_shm_pool_resize (segment->wl_pool, new_size);
+  _shm_segment_return_range (segment, segment->size,
+                             new_size - segment->size);
+  segment->size = new_size;
+
+  return TRUE;
+}
+
+static void
+_shm_segment_free (SHMSegment *segment)
+{
+  wl_shm_pool_destroy (segment->wl_pool);
+  munmap (segment->data, segment->reserved);
+  close (segment->fd);
+  g_array_unref (segment->free_ranges);
+  g_slice_free (SHMSegment, segment);
+}
+
+static SHMSegment *
+_shm_segment_new (MechSHMPool *pool,
+                  gsize        size)
+{
+  MechBackendWayland *backend;
+  SHMSegment *segment;
+  gpointer data;
+  gsize reserved;
+  gint fd;
+
+  reserved = MAX (SEGMENT_RESERVE, size);
+  size = MAX (SEGMENT_MIN_SIZE, size);
+  fd = _create_shm_file ();
+
+  if (fd < 0)
+    {
+      g_critical ("Creating SHM file failed: %m");
+      return NULL;
+    }
+
+  if (ftruncate (fd, size) < 0)
+    {
+      g_critical ("Truncating SHM file failed: %m");
+      close (fd);
+      return NULL;
+    }
+
+  /* Map the whole reserve upfront, only the
+   * first 'size' bytes are backed by the file.
+   */
+  data = mmap (NULL, reserved, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED)
+    {
+      g_critical ("Failed to mmap SHM region: %m");
+      close (fd);
+      return NULL;
+    }
+
+  backend = _mech_backend_wayland_get ();
+
+  segment = g_slice_new0 (SHMSegment);
+  segment->pool = pool;
+  segment->fd = fd;
+  segment->data = data;
+  segment->size = size;
+  segment->reserved = reserved;
+  segment->wl_pool = wl_shm_create_pool (backend->wl_shm, fd, size);
+  segment->free_ranges = g_array_new (FALSE, FALSE, sizeof (SHMRange));
+  _shm_segment_return_range (segment, 0, size);
+
+  return segment;
+}
+
+static MechSHMPool *
+_mech_shm_pool_new (void)
+{
+  MechSHMPool *pool;
+
+  pool = g_slice_new0 (MechSHMPool);
+  pool->ref_count = 1;
+  pool->segments =
+    g_ptr_array_new_with_free_func ((GDestroyNotify) _shm_segment_free);
+
+  return pool;
+}
+
+static MechSHMPool *
+_mech_shm_pool_ref (MechSHMPool *pool)
+{
+  pool->ref_count++;
+  return pool;
+}
+
+static void
+_mech_shm_pool_unref (MechSHMPool *pool)
+{
+  pool->ref_count--;
+
+  if (pool->ref_count > 0)
+    return;
+
+  g_ptr_array_unref (pool->segments);
+  g_slice_free (MechSHMPool, pool);
+}
+
+MechSHMPool *
+_mech_shm_pool_get_for_surface (MechSurface *surface)
+{
+  MechSurface *parent;
+  MechSHMPool *pool;
+
+  if (G_UNLIKELY (!quark_shm_pool))
+    quark_shm_pool = g_quark_from_static_string ("mech-shm-pool");
+
+  /* Pools are shared by all surfaces in a window */
+  while ((parent = _mech_surface_get_parent (surface)) != NULL)
+    surface = parent;
+
+  pool = g_object_get_qdata ((GObject *) surface, quark_shm_pool);
+
+  if (!pool)
+    {
+      pool = _mech_shm_pool_new ();
+      g_object_set_qdata_full ((GObject *) surface, quark_shm_pool, pool,
+                               (GDestroyNotify) _mech_shm_pool_unref);
+    }
+
+  return pool;
+}
+
+MechSHMBlock *
+_mech_shm_pool_alloc (MechSHMPool *pool,
+                      gsize        size)
+{
+  SHMSegment *segment = NULL;
+  MechSHMBlock *block;
+  gsize offset;
+  guint i;
+
+  size = _bucket_size (size);
+
+  for (i = 0; i < pool->segments->len; i++)
+    {
+      segment = g_ptr_array_index (pool->segments, i);
+
+      if (_shm_segment_take_range (segment, size, &offset))
+        break;
+
+      segment = NULL;
+    }
+
+  for (i = 0; !segment && i < pool->segments->len; i++)
+    {
+      segment = g_ptr_array_index (pool->segments, i);
+
+      if (!_shm_segment_grow (segment, size) ||
+          !_shm_segment_take_range (segment, size, &offset))
+        segment = NULL;
+    }
+
+  if (!segment)
+    {
+      segment = _shm_segment_new (pool, size);
+
+      if (!segment)
+        return NULL;
+
+      g_ptr_array_add (pool->segments, segment);
+      _shm_segment_take_range (segment, size, &offset);
+    }
+
+  block = g_slice_new0 (MechSHMBlock);
+  block->wl_pool = segment->wl_pool;
+  block->data = segment->data + offset;
+  block->offset = offset;
+  block->size = size;
+  block->segment = segment;
+
+  segment->n_blocks++;
+  _mech_shm_pool_ref (pool);
+
+  return block;
+}
+
+void
+_mech_shm_block_free (MechSHMBlock *block)
+{
+  SHMSegment *segment;
+  MechSHMPool *pool;
+
+  segment = block->segment;
+  pool = segment->pool;
+
+  _shm_segment_return_range (segment, block->offset, block->size);
+  segment->n_blocks--;
+
+  /* Segment files can't shrink, so unused ones are dropped, the
+   * first one is kept if minimal, to avoid churn on resizes.
+   */
+  if (segment->n_blocks == 0 &&
+      (segment != g_ptr_array_index (pool->segments, 0) ||
+       segment->size > SEGMENT_MIN_SIZE))
+    g_ptr_array_remove (pool->segments, segment);
+
+  g_slice_free (MechSHMBlock, block);
+  _mech_shm_pool_unref (pool);
+}
+
+gboolean
+_mech_shm_block_fits (MechSHMBlock *block,
+                      gsize         size)
+{
+  /* Blocks way bigger than needed are better given back */
+  return (block->size >= size &&
+          block->size <= 2 * _bucket_size (size));
+}
@@ -0,0 +1,50 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_SHM_POOL_WAYLAND_H__
+#define __MECH_SHM_POOL_WAYLAND_H__
+
+#include <wayland-client.h>
+#include <mechane/mech-surface-private.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MechSHMPool MechSHMPool;
+typedef struct _MechSHMBlock MechSHMBlock;
+
+struct _MechSHMBlock
+{
+  struct wl_shm_pool *wl_pool;
+  gpointer data;
+  gsize offset;
+  gsize size;
+
+  /*< private >*/
+  gpointer segment;
+};
+
+MechSHMPool  * _mech_shm_pool_get_for_surface (MechSurface  *surface);
+
+MechSHMBlock * _mech_shm_pool_alloc           (MechSHMPool  *pool,
+                                               gsize         size);
+void           _mech_shm_block_free           (MechSHMBlock *block);
+gboolean       _mech_shm_block_fits           (MechSHMBlock *block,
+                                               gsize         size);
+
+G_END_DECLS
+
+#endif /* __MECH_SHM_POOL_WAYLAND_H__ */
@@ -15,27 +15,33 @@
  * License along with this library. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <sys/mman.h>
 #include <wayland-client.h>
-#include <glib/gstdio.h>
 #include <cairo/cairo-gobject.h>
 #include "mech-backend-wayland.h"
+#include "mech-shm-pool-wayland.h"
 #include "mech-surface-wayland-shm.h"
 
+/* Buffers may be added past the requested
+ * amount while the compositor holds them all.
+ */
+#define MAX_BUFFERS 4
+#define DEFAULT_N_BUFFERS 3
+
 G_DEFINE_TYPE (MechSurfaceWaylandSHM, mech_surface_wayland_shm,
                MECH_TYPE_SURFACE_WAYLAND)
 
+enum {
+  PROP_N_BUFFERS = 1
+};
+
 typedef struct _BufferData BufferData;
 
 struct _BufferData
 {
-  struct wl_shm_pool *wl_pool;
+  MechSHMBlock *block;
   struct wl_buffer *wl_buffer;
   cairo_surface_t *surface;
-  gpointer data;
-  gsize data_len;
-  guint16 age;
-  guint16 n_uses;
+  guint64 last_frame;
   guint blank    : 1;
   guint released : 1;
   guint disposed : 1;
@@ -43,33 +49,15 @@ struct _BufferData
 
 struct _MechSurfaceWaylandSHMPriv
 {
-  BufferData *buffers[2];
+  BufferData *buffers[MAX_BUFFERS];
+  guint n_buffers;
+  guint requested_buffers;
   gint cur_buffer;
+  guint64 frame_counter;
   gint tx;
   gint ty;
 };
 
-static gint
-_create_temporary_file (gint size)
-{
-  gchar *path;
-  gint fd;
-
-  path = g_build_filename (g_get_tmp_dir (), "mechane-buffer-XXXXXX", NULL);
-  fd = g_mkstemp (path);
-  g_unlink (path);
-  g_free (path);
-
-  if (ftruncate (fd, size) < 0)
-    {
-      g_critical ("Truncating temporary file failed: %m");
-      close(fd);
-      return -1;
-    }
-
-  return fd;
-}
-
 static void
 _destroy_buffer (BufferData *buffer)
 {
@@ -90,11 +78,9 @@ _destroy_buffer (BufferData *buffer)
   if (buffer->wl_buffer)
     wl_buffer_destroy (buffer->wl_buffer);
 
-  if (buffer->wl_pool)
-    wl_shm_pool_destroy (buffer->wl_pool);
-
-  if (buffer->data && buffer->data_len)
-    munmap (buffer->data, buffer->data_len);
+  /* The memory goes back to the pool */
+  if (buffer->block)
+    _mech_shm_block_free (buffer->block);
 
   g_free (buffer);
 }
@@ -115,54 +101,66 @@ static struct wl_buffer_listener buffer_listener_funcs = {
   _buffer_release
 };
 
-static BufferData *
-_create_buffer (gint width,
-                gint height)
+static void
+_buffer_set_size (BufferData *buffer,
+                  gint        width,
+                  gint        height)
 {
-  MechBackendWayland *backend;
-  BufferData *buffer;
-  gint stride, fd;
-
-  buffer = g_new0 (BufferData, 1);
-
-  backend = _mech_backend_wayland_get ();
-  stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
-  buffer->data_len = stride * height;
+  gint stride;
 
-  fd = _create_temporary_file (buffer->data_len);
-  buffer->data = mmap (NULL, buffer->data_len,
-                       PROT_READ | PROT_WRITE, MAP_SHARED,
-                       fd, 0);
-
-  if (buffer->data == MAP_FAILED)
-    {
-      g_critical ("Failed to mmap SHM region: %m");
-      g_free (buffer);
-      close(fd);
-      return NULL;
-    }
+  if (buffer->surface)
+    cairo_surface_destroy (buffer->surface);
 
-  buffer->wl_pool = wl_shm_create_pool (backend->wl_shm, fd, buffer->data_len);
-  close (fd);
+  if (buffer->wl_buffer)
+    wl_buffer_destroy (buffer->wl_buffer);
 
-  buffer->wl_buffer = wl_shm_pool_create_buffer (buffer->wl_pool, 0,
+  stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
+  buffer->wl_buffer = wl_shm_pool_create_buffer (buffer->block->wl_pool,
+                                                 buffer->block->offset,
                                                  width, height, stride,
                                                  WL_SHM_FORMAT_ARGB8888);
   wl_buffer_add_listener (buffer->wl_buffer, &buffer_listener_funcs, buffer);
 
-  buffer->surface = cairo_image_surface_create_for_data (buffer->data,
+  buffer->surface = cairo_image_surface_create_for_data (buffer->block->data,
                                                          CAIRO_FORMAT_ARGB32,
                                                          width, height, stride);
   buffer->blank = TRUE;
+  buffer->last_frame = 0;
+}
+
+static BufferData *
+_create_buffer (MechSHMPool *pool,
+                gint         width,
+                gint         height)
+{
+  MechSHMBlock *block;
+  BufferData *buffer;
+  gint stride;
+
+  stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
+  block = _mech_shm_pool_alloc (pool, stride * height);
+
+  if (!block)
+    return NULL;
+
+  buffer = g_new0 (BufferData, 1);
+  buffer->block = block;
   buffer->released = TRUE;
+  _buffer_set_size (buffer, width, height);
 
   return buffer;
 }
 
-BufferData *
-_create_buffer_similar (BufferData *buffer)
+static BufferData *
+_create_buffer_similar (MechSurfaceWaylandSHM *surface_shm,
+                        BufferData            *buffer)
 {
-  return _create_buffer (cairo_image_surface_get_width (buffer->surface),
+  MechSHMPool *pool;
+
+  pool = _mech_shm_pool_get_for_surface ((MechSurface *) surface_shm);
+
+  return _create_buffer (pool,
+                         cairo_image_surface_get_width (buffer->surface),
                          cairo_image_surface_get_height (buffer->surface));
 }
 
@@ -173,14 +171,50 @@ _surface_ensure_buffers (MechSurfaceWaylandSHM *surface_shm,
 {
   MechSurfaceWaylandSHMPriv *priv = surface_shm->_priv;
   MechSurface *surface = (MechSurface *) surface_shm;
+  guint i, n_buffers;
+  BufferData *buffer;
+  MechSHMPool *pool;
+  gint stride;
 
-  _destroy_buffer (priv->buffers[0]);
-  _destroy_buffer (priv->buffers[1]);
+  pool = _mech_shm_pool_get_for_surface (surface);
+  stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
 
-  priv->buffers[0] = _create_buffer (width, height);
+  /* Offscreens are single buffered */
+  if (_mech_surface_get_surface_type (surface) == MECH_SURFACE_TYPE_OFFSCREEN)
+    n_buffers = 1;
+  else
+    n_buffers = priv->requested_buffers;
 
-  if (_mech_surface_get_surface_type (surface) != MECH_SURFACE_TYPE_OFFSCREEN)
-    priv->buffers[1] = _create_buffer (width, height);
+  for (i = 0; i < MAX_BUFFERS; i++)
+    {
+      buffer = priv->buffers[i];
+
+      if (i < n_buffers && buffer && buffer->released &&
+          _mech_shm_block_fits (buffer->block, (gsize) stride * height))
+        {
+          /* Memory is big enough, but not too much, just rewrap it */
+          _buffer_set_size (buffer, width, height);
+        }
+      else
+        {
+          _destroy_buffer (buffer);
+          priv->buffers[i] = NULL;
+        }
+    }
+
+  /* Replacements are allocated after all memory to drop
+   * went back to the pool, so emptied segments can go.
+   */
+  for (i = 0; i < n_buffers; i++)
+    {
+      if (!priv->buffers[i])
+        priv->buffers[i] = _create_buffer (pool, width, height);
+    }
+
+  priv->n_buffers = n_buffers;
+
+  if (priv->cur_buffer >= n_buffers)
+    priv->cur_buffer = 0;
 }
 
 static void
@@ -188,12 +222,13 @@ mech_surface_wayland_shm_finalize (GObject *object)
 {
   MechSurfaceWaylandSHM *surface_shm;
   MechSurfaceWaylandSHMPriv *priv;
+  guint i;
 
   surface_shm = (MechSurfaceWaylandSHM *) object;
   priv = surface_shm->_priv;
 
-  _destroy_buffer (priv->buffers[0]);
-  _destroy_buffer (priv->buffers[1]);
+  for (i = 0; i < priv->n_buffers; i++)
+    _destroy_buffer (priv->buffers[i]);
 
   G_OBJECT_CLASS (mech_surface_wayland_shm_parent_class)->finalize (object);
 }
@@ -227,9 +262,9 @@ static void
 _surface_choose_next_buffer (MechSurfaceWaylandSHM *surface_shm)
 {
   MechSurfaceWaylandSHMPriv *priv;
+  BufferData *buffer, *oldest;
   MechSurface *surface;
-  BufferData *buffer;
-  gint cur_buffer;
+  gint i, next, oldest_idx;
 
   surface = (MechSurface *) surface_shm;
 
@@ -238,32 +273,74 @@ _surface_choose_next_buffer (MechSurfaceWaylandSHM *surface_shm)
     return;
 
   priv = surface_shm->_priv;
-  cur_buffer = priv->cur_buffer;
-  buffer = priv->buffers[cur_buffer];
 
-  if (!buffer->released)
+  /* The current buffer is kept if it wasn't acquired
+   * by the compositor, else pick the released buffer
+   * with the most recent contents, so the least gets
+   * to be repainted.
+   */
+  if (priv->buffers[priv->cur_buffer]->released)
+    return;
+
+  next = -1;
+  oldest = NULL;
+  oldest_idx = 0;
+
+  for (i = 0; i < priv->n_buffers; i++)
     {
-      /* Pick the next buffer if the current
-       * one wasn't released yet.
-       */
-      cur_buffer = (cur_buffer + 1) % 2;
-      priv->buffers[cur_buffer]->age = buffer->n_uses + 1;
-      buffer = priv->buffers[cur_buffer];
-      buffer->n_uses = 0;
+      buffer = priv->buffers[i];
 
-      if (!buffer->released)
+      if (buffer->released)
         {
-          /* If the next buffer is still acquired by the compositor,
-           * create a replacement buffer and dispose the original one,
-           * it will be truly freed after being released by the
-           * compositor.
-           */
-          priv->buffers[cur_buffer] = _create_buffer_similar (buffer);
-          _destroy_buffer (buffer);
+          if (next < 0 ||
+              buffer->last_frame > priv->buffers[next]->last_frame)
+            next = i;
+        }
+      else if (i != priv->cur_buffer &&
+               (!oldest || buffer->last_frame < oldest->last_frame))
+        {
+          oldest = buffer;
+          oldest_idx = i;
         }
     }
 
-  priv->cur_buffer = cur_buffer;
+  if (next >= 0)
+    {
+      priv->cur_buffer = next;
+      return;
+    }
+
+  /* Every buffer is held by the compositor, grow the
+   * swapchain so the buffers already there keep their
+   * contents for later frames. The new buffer is blank,
+   * so the next frame is a full redraw.
+   */
+  if (priv->n_buffers < MAX_BUFFERS)
+    {
+      buffer = _create_buffer_similar (surface_shm,
+                                       priv->buffers[priv->cur_buffer]);
+
+      if (buffer)
+        {
+          next = priv->n_buffers;
+          priv->buffers[next] = buffer;
+          priv->n_buffers++;
+        }
+    }
+
+  if (next < 0)
+    {
+      /* Create a replacement for the oldest buffer and
+       * dispose the original one, it will be truly freed
+       * after being released by the compositor.
+       */
+      g_assert (oldest != NULL);
+      next = oldest_idx;
+      priv->buffers[next] = _create_buffer_similar (surface_shm, oldest);
+      _destroy_buffer (oldest);
+    }
+
+  priv->cur_buffer = next;
 }
 
 static void
@@ -271,17 +348,16 @@ mech_surface_wayland_shm_release (MechSurface *surface)
 {
   MechSurfaceWaylandSHM *surface_shm;
   MechSurfaceWaylandSHMPriv *priv;
+  BufferData *buffer;
 
   surface_shm = (MechSurfaceWaylandSHM *) surface;
   priv = surface_shm->_priv;
+  buffer = priv->buffers[priv->cur_buffer];
 
   /* The buffer has been rendered now for sure */
-  priv->buffers[priv->cur_buffer]->blank = FALSE;
-  priv->buffers[priv->cur_buffer]->age = 1;
-
-  /* Prevent wraparound, old is old */
-  if (priv->buffers[priv->cur_buffer]->n_uses != G_MAXUINT16)
-    priv->buffers[priv->cur_buffer]->n_uses++;
+  priv->frame_counter++;
+  buffer->last_frame = priv->frame_counter;
+  buffer->blank = FALSE;
 
   _surface_choose_next_buffer (surface_shm);
 }
@@ -297,10 +373,14 @@ mech_surface_wayland_shm_get_age (MechSurface *surface)
   priv = surface_shm->_priv;
   buffer = priv->buffers[priv->cur_buffer];
 
-  if (buffer->blank)
+  /* Fresh buffers hold no previous frame to build on */
+  if (buffer->blank || buffer->last_frame == 0)
     return 0;
-  else
-    return buffer->age;
+
+  /* Number of frames since the buffer contents were
+   * rendered, 1 meaning it holds the previous frame.
+   */
+  return MIN (priv->frame_counter - buffer->last_frame + 1, G_MAXINT);
 }
 
 static void
@@ -348,6 +428,43 @@ mech_surface_wayland_shm_translate (MechSurfaceWayland *surface,
   priv->ty += ty;
 }
 
+static void
+mech_surface_wayland_shm_set_property (GObject      *object,
+                                       guint         prop_id,
+                                       const GValue *value,
+                                       GParamSpec   *pspec)
+{
+  MechSurfaceWaylandSHMPriv *priv = ((MechSurfaceWaylandSHM *) object)->_priv;
+
+  switch (prop_id)
+    {
+    case PROP_N_BUFFERS:
+      /* Applied on the next resize */
+      priv->requested_buffers = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+mech_surface_wayland_shm_get_property (GObject    *object,
+                                       guint       prop_id,
+                                       GValue     *value,
+                                       GParamSpec *pspec)
+{
+  MechSurfaceWaylandSHMPriv *priv = ((MechSurfaceWaylandSHM *) object)->_priv;
+
+  switch (prop_id)
+    {
+    case PROP_N_BUFFERS:
+      g_value_set_uint (value, priv->requested_buffers);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 mech_surface_wayland_shm_class_init (MechSurfaceWaylandSHMClass *klass)
 {
@@ -356,6 +473,8 @@ mech_surface_wayland_shm_class_init (MechSurfaceWaylandSHMClass *klass)
   GObjectClass *object_class;
 
   object_class = G_OBJECT_CLASS (klass);
+  object_class->set_property = mech_surface_wayland_shm_set_property;
+  object_class->get_property = mech_surface_wayland_shm_get_property;
   object_class->finalize = mech_surface_wayland_shm_finalize;
 
   surface_class = MECH_SURFACE_CLASS (klass);
@@ -368,6 +487,16 @@ mech_surface_wayland_shm_class_init (MechSurfaceWaylandSHMClass *klass)
   surface_wayland_class = MECH_SURFACE_WAYLAND_CLASS (klass);
   surface_wayland_class->translate = mech_surface_wayland_shm_translate;
 
+  g_object_class_install_property (object_class,
+                                   PROP_N_BUFFERS,
+                                   g_param_spec_uint ("n-buffers",
+                                                      "Number of buffers",
+                                                      "Number of buffers in the swapchain",
+                                                      1, MAX_BUFFERS,
+                                                      DEFAULT_N_BUFFERS,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
   g_type_class_add_private (klass, sizeof (MechSurfaceWaylandSHMPriv));
 }
 
@@ -378,6 +507,7 @@ mech_surface_wayland_shm_init (MechSurfaceWaylandSHM *surface)
                                                 MECH_TYPE_SURFACE_WAYLAND_SHM,
                                                 MechSurfaceWaylandSHMPriv);
   surface->_priv->cur_buffer = 0;
+  surface->_priv->requested_buffers = DEFAULT_N_BUFFERS;
 
   g_object_set (surface,
                 "renderer-type", MECH_RENDERER_TYPE_SOFTWARE,
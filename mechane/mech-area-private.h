@@ -48,6 +48,12 @@ void             _mech_area_reset_surface_type    (MechArea          *area,
                                                    MechSurfaceType    surface_type);
 void             _mech_area_notify_visibility_change (MechArea       *area);
 
+gboolean         _mech_area_has_custom_shape      (MechArea          *area);
+gboolean         _mech_area_contains_point        (MechArea          *area,
+                                                   gdouble            x,
+                                                   gdouble            y);
+
+guint            _mech_area_get_content_generation (MechArea       *area);
 
 
 G_END_DECLS
@@ -55,7 +55,8 @@ enum {
   PROP_DEPTH,
   PROP_NAME,
   PROP_MATRIX,
-  PROP_CURSOR
+  PROP_CURSOR,
+  PROP_RETAIN_DRAWING
 };
 
 enum {
@@ -89,6 +90,18 @@ struct _MechAreaPrivate
    */
   cairo_rectangle_t rect;
 
+  /* Cumulative transformations from area coordinates, valid
+   * while matrices_valid is set and the parent matrices are
+   * still the ones tagged by parent_matrices_stamp.
+   */
+  cairo_matrix_t parent_matrix;
+  cairo_matrix_t root_matrix;
+  cairo_matrix_t root_matrix_inverse;
+  GNode *root_node;
+  guint64 matrices_stamp;
+  guint64 parent_matrices_stamp;
+  guint64 matrices_generation;
+
   /* Index is MechAxis */
   PreferredAxisSize preferred_size[2];
 
@@ -97,6 +110,9 @@ struct _MechAreaPrivate
 
   gint depth;
 
+  /* Bumped on every mech_area_redraw() */
+  guint content_generation;
+
   guint evmask              : 16;
   guint state               : 9;
   guint surface_type        : 3;
@@ -106,6 +122,9 @@ struct _MechAreaPrivate
   guint need_width_request  : 1;
   guint need_height_request : 1;
   guint need_allocate_size  : 1;
+  guint root_matrix_invertible : 1;
+  guint matrices_valid         : 1;
+  guint retain_drawing      : 1;
 };
 
 struct _MechAreaDelegateData
@@ -120,8 +139,26 @@ static guint signals[LAST_SIGNAL] = { 0 };
 static GQuark quark_window = 0;
 static GQuark quark_container = 0;
 
+/* Tags each computation of cached area matrices */
+static guint64 matrices_stamp = 0;
+
+/* Bumped on every invalidation, areas checked against
+ * the current generation need not look at ancestors.
+ */
+static guint64 matrices_generation = 1;
+
 G_DEFINE_TYPE_WITH_PRIVATE (MechArea, mech_area, G_TYPE_INITIALLY_UNOWNED)
 
+static void
+_mech_area_invalidate_matrices (MechArea *area)
+{
+  MechAreaPrivate *priv = mech_area_get_instance_private (area);
+
+  /* Descendants notice through the parent stamp */
+  priv->matrices_valid = FALSE;
+  matrices_generation++;
+}
+
 static void
 mech_area_init (MechArea *area)
 {
@@ -232,6 +269,9 @@ mech_area_set_property (GObject      *object,
     case PROP_CURSOR:
       mech_area_set_cursor (area, g_value_get_object (value));
       break;
+    case PROP_RETAIN_DRAWING:
+      mech_area_set_retain_drawing (area, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
     }
@@ -271,6 +311,9 @@ mech_area_get_property (GObject    *object,
     case PROP_CURSOR:
       g_value_set_object (value, mech_area_get_cursor (area));
       break;
+    case PROP_RETAIN_DRAWING:
+      g_value_set_boolean (value, priv->retain_drawing);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
     }
@@ -478,6 +521,14 @@ mech_area_class_init (MechAreaClass *klass)
                                                         MECH_TYPE_CURSOR,
                                                         G_PARAM_READWRITE |
                                                         G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class,
+                                   PROP_RETAIN_DRAWING,
+                                   g_param_spec_boolean ("retain-drawing",
+                                                         "Retain drawing",
+                                                         "Whether the area drawing is recorded and replayed until redrawn",
+                                                         FALSE,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
   signals[DRAW] =
     g_signal_new ("draw",
                   G_TYPE_FROM_CLASS (klass),
@@ -704,6 +755,8 @@ _mech_area_allocate_stage_rect (MechArea          *area,
       renderer = mech_area_get_renderer (area);
       priv->need_allocate_size = FALSE;
       priv->rect = *alloc;
+      _mech_stage_node_queue_reindex (priv->node);
+      _mech_area_invalidate_matrices (area);
 
       if (renderer)
         mech_renderer_get_border_extents (renderer, MECH_EXTENT_CONTENT, &border);
@@ -723,6 +776,12 @@ _mech_area_allocate_stage_rect (MechArea          *area,
                        G_PRE_ORDER, G_TRAVERSE_ALL,
                        -1, _area_update_translation,
                        &diff);
+
+      /* Children are indexed relative to their parent,
+       * only the parent index is affected.
+       */
+      _mech_stage_node_queue_reindex (priv->node);
+      _mech_area_invalidate_matrices (area);
     }
 }
 
@@ -1291,6 +1350,8 @@ mech_area_set_matrix (MechArea             *area,
   priv->matrix = *matrix;
   priv->is_identity =
     (MATRIX_IS_IDENTITY (priv->matrix) == TRUE);
+  _mech_stage_node_queue_reindex (priv->node);
+  _mech_area_invalidate_matrices (area);
 
   if (container)
     {
@@ -1345,81 +1406,97 @@ mech_area_get_clip (MechArea *area)
   return priv->clip;
 }
 
-static MechArea *
-find_common_root (MechArea *area1,
-                  MechArea *area2)
+void
+mech_area_set_retain_drawing (MechArea *area,
+                              gboolean  retain_drawing)
 {
-  GNode *node1, *node2;
-  gint depth1, depth2;
+  MechAreaPrivate *priv;
 
-  node1 = _mech_area_get_node (area1);
-  node2 = _mech_area_get_node (area2);
-  depth1 = g_node_depth (node1);
-  depth2 = g_node_depth (node2);
+  g_return_if_fail (MECH_IS_AREA (area));
 
-  if (depth1 == depth2)
-    {
-      while (node1 != node2)
-        {
-          node1 = node1->parent;
-          node2 = node2->parent;
-        }
+  priv = mech_area_get_instance_private (area);
 
-      return (node1) ? node1->data : NULL;
+  if ((retain_drawing == TRUE) != (priv->retain_drawing == TRUE))
+    {
+      priv->retain_drawing = retain_drawing;
+      g_object_notify ((GObject *) area, "retain-drawing");
+      mech_area_redraw (area, NULL);
     }
+}
 
-  if (depth1 > depth2)
-    {
-      GNode *tmp;
+gboolean
+mech_area_get_retain_drawing (MechArea *area)
+{
+  MechAreaPrivate *priv;
 
-      /* Swap nodes */
-      tmp = node2;
-      node2 = node1;
-      node1 = tmp;
-    }
+  g_return_val_if_fail (MECH_IS_AREA (area), FALSE);
+
+  priv = mech_area_get_instance_private (area);
+  return priv->retain_drawing;
+}
 
-  while (node1 && !g_node_is_ancestor (node1, node2))
-    node1 = node1->parent;
+guint
+_mech_area_get_content_generation (MechArea *area)
+{
+  MechAreaPrivate *priv;
 
-  return (node1) ? node1->data : NULL;
+  priv = mech_area_get_instance_private (area);
+  return priv->content_generation;
 }
 
 static void
-_mech_area_get_matrix_linear_upwards (MechArea       *area,
-                                      MechArea       *ancestor,
-                                      cairo_matrix_t *matrix_ret)
+_mech_area_ensure_matrices (MechArea *area)
 {
-  cairo_rectangle_t parent_rect, rect;
-  MechArea *cur, *parent;
-  cairo_matrix_t diff;
-  gboolean has_matrix;
+  MechAreaPrivate *priv, *parent_priv;
+  cairo_matrix_t offset;
+  GNode *parent;
 
-  cur = area;
-  _mech_area_get_stage_rect (cur, &rect);
-  cairo_matrix_init_identity (matrix_ret);
+  priv = mech_area_get_instance_private (area);
+
+  if (priv->matrices_valid &&
+      priv->matrices_generation == matrices_generation)
+    return;
+
+  parent = priv->node->parent;
+  priv->matrices_generation = matrices_generation;
 
-  while (cur != ancestor)
+  if (!parent)
     {
-      parent = _mech_area_get_node (cur)->parent->data;
-      has_matrix = mech_area_get_matrix (cur, &diff);
+      if (priv->matrices_valid)
+        return;
 
-      if (parent != ancestor && !has_matrix)
-        {
-          cur = parent;
-          continue;
-        }
-      else if (has_matrix)
-        _mech_area_get_stage_rect (cur, &parent_rect);
-      else
-        _mech_area_get_stage_rect (parent, &parent_rect);
+      /* Root coordinates, the root matrix is not applied here */
+      cairo_matrix_init_identity (&priv->parent_matrix);
+      cairo_matrix_init_identity (&priv->root_matrix);
+      priv->root_node = priv->node;
+    }
+  else
+    {
+      _mech_area_ensure_matrices (parent->data);
+      parent_priv = mech_area_get_instance_private (parent->data);
 
-      cairo_matrix_translate (&diff,
-                              rect.x - parent_rect.x,
-                              rect.y - parent_rect.y);
-      cairo_matrix_multiply (matrix_ret, matrix_ret, &diff);
-      rect = parent_rect;
-      cur = parent;
+      if (priv->matrices_valid &&
+          priv->parent_matrices_stamp == parent_priv->matrices_stamp)
+        return;
+
+      /* Same transformation than applied on rendering,
+       * area matrix first, then offset on the parent.
+       */
+      cairo_matrix_init_translate (&offset,
+                                   priv->rect.x - parent_priv->rect.x,
+                                   priv->rect.y - parent_priv->rect.y);
+      cairo_matrix_multiply (&priv->parent_matrix, &priv->matrix, &offset);
+      cairo_matrix_multiply (&priv->root_matrix, &priv->parent_matrix,
+                             &parent_priv->root_matrix);
+      priv->root_node = parent_priv->root_node;
+      priv->parent_matrices_stamp = parent_priv->matrices_stamp;
     }
+
+  priv->root_matrix_inverse = priv->root_matrix;
+  priv->root_matrix_invertible =
+    cairo_matrix_invert (&priv->root_matrix_inverse) == CAIRO_STATUS_SUCCESS;
+  priv->matrices_stamp = ++matrices_stamp;
+  priv->matrices_valid = TRUE;
 }
 
 gboolean
@@ -1427,8 +1504,7 @@ mech_area_get_relative_matrix (MechArea       *area,
                                MechArea       *relative_to,
                                cairo_matrix_t *matrix_ret)
 {
-  MechArea *common_root;
-  GNode *node;
+  MechAreaPrivate *priv, *relative_priv;
 
   g_return_val_if_fail (MECH_IS_AREA (area), FALSE);
   g_return_val_if_fail (!relative_to || MECH_IS_AREA (relative_to), FALSE);
@@ -1439,26 +1515,32 @@ mech_area_get_relative_matrix (MechArea       *area,
   if (area == relative_to)
     return TRUE;
 
-  node = _mech_area_get_node (area);
+  priv = mech_area_get_instance_private (area);
+  _mech_area_ensure_matrices (area);
 
   if (!relative_to)
-    relative_to = common_root = g_node_get_root (node)->data;
-  else
-    common_root = find_common_root (area, relative_to);
+    {
+      *matrix_ret = priv->root_matrix;
+      return TRUE;
+    }
 
-  g_return_val_if_fail (common_root != NULL, FALSE);
+  relative_priv = mech_area_get_instance_private (relative_to);
+  _mech_area_ensure_matrices (relative_to);
 
-  _mech_area_get_matrix_linear_upwards (area, common_root, matrix_ret);
+  g_return_val_if_fail (priv->root_node == relative_priv->root_node, FALSE);
 
-  if (common_root != relative_to)
+  if (priv->node->parent == relative_priv->node)
     {
-      cairo_matrix_t downwards;
-
-      _mech_area_get_matrix_linear_upwards (relative_to, common_root, &downwards);
-      cairo_matrix_invert (&downwards);
-      cairo_matrix_multiply (matrix_ret, matrix_ret, &downwards);
+      *matrix_ret = priv->parent_matrix;
+      return TRUE;
     }
 
+  /* Points can't be mapped into a degenerate transformation */
+  if (!relative_priv->root_matrix_invertible)
+    return FALSE;
+
+  cairo_matrix_multiply (matrix_ret, &priv->root_matrix,
+                         &relative_priv->root_matrix_inverse);
   return TRUE;
 }
 
@@ -1628,6 +1710,7 @@ mech_area_set_parent (MechArea *area,
     }
 
   priv->parent = parent;
+  _mech_area_invalidate_matrices (area);
 
   if (parent)
     {
@@ -1847,10 +1930,13 @@ mech_area_redraw (MechArea       *area,
                   cairo_region_t *region)
 {
   MechContainer *container;
+  MechAreaPrivate *priv;
   MechStage *stage;
 
   g_return_if_fail (MECH_IS_AREA (area));
 
+  priv = mech_area_get_instance_private (area);
+  priv->content_generation++;
   container = _mech_area_get_container (area);
 
   if (!container)
@@ -2074,6 +2160,38 @@ mech_area_get_shape (MechArea *area)
   return MECH_AREA_GET_CLASS (area)->get_shape (area);
 }
 
+gboolean
+_mech_area_has_custom_shape (MechArea *area)
+{
+  return MECH_AREA_GET_CLASS (area)->get_shape != mech_area_get_shape_impl;
+}
+
+gboolean
+_mech_area_contains_point (MechArea *area,
+                           gdouble   x,
+                           gdouble   y)
+{
+  cairo_region_t *region;
+  gboolean inside;
+
+  if (!_mech_area_has_custom_shape (area))
+    {
+      MechAreaPrivate *priv = mech_area_get_instance_private (area);
+
+      /* Same test than on the region returned by the default
+       * get_shape() implementation, without creating it.
+       */
+      return ((gint) x >= 0 && (gint) x < (gint) priv->rect.width &&
+              (gint) y >= 0 && (gint) y < (gint) priv->rect.height);
+    }
+
+  region = mech_area_get_shape (area);
+  inside = cairo_region_contains_point (region, (gint) x, (gint) y);
+  cairo_region_destroy (region);
+
+  return inside;
+}
+
 void
 mech_area_grab_focus (MechArea *area,
                       MechSeat *seat)
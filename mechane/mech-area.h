@@ -119,6 +119,10 @@ void             mech_area_set_clip             (MechArea        *area,
                                                  gboolean         clip);
 gboolean         mech_area_get_clip             (MechArea        *area);
 
+void             mech_area_set_retain_drawing   (MechArea        *area,
+                                                 gboolean         retain_drawing);
+gboolean         mech_area_get_retain_drawing   (MechArea        *area);
+
 void             mech_area_set_events           (MechArea        *area,
                                                  MechEventMask    evmask);
 void             mech_area_add_events           (MechArea        *area,
@@ -17,6 +17,7 @@
 
 #include <mechane/mech-backend-private.h>
 #include <backends/wayland/mech-backend-wayland.h>
+#include <backends/headless/mech-backend-headless.h>
 #include <mechane/mech-resources.h>
 
 G_DEFINE_ABSTRACT_TYPE (MechBackend, mech_backend, G_TYPE_OBJECT)
@@ -34,7 +35,14 @@ mech_backend_init (MechBackend *backend)
 MechBackend *
 mech_backend_get (void)
 {
+  const gchar *backend_name;
+
   /* FIXME: make this loadable */
+  backend_name = g_getenv ("MECH_BACKEND");
+
+  if (g_strcmp0 (backend_name, "headless") == 0)
+    return (MechBackend *) _mech_backend_headless_get ();
+
   return (MechBackend *) _mech_backend_wayland_get ();
 }
 
@@ -64,6 +64,7 @@ static void
 mech_button_init (MechButton *button)
 {
   mech_area_set_name ((MechArea * ) button, "button");
+  mech_area_set_retain_drawing ((MechArea *) button, TRUE);
 }
 
 static void
@@ -15,6 +15,7 @@
  * License along with this library. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include <cairo/cairo-gobject.h>
 
 #include <mechane/mech-marshal.h>
@@ -56,9 +57,13 @@ struct _MechContainerPrivate
   gint width;
   gint height;
 
+  MechFrameStats frame_stats;
+
   guint redraw_requested : 1;
   guint resize_requested : 1;
   guint size_initialized : 1;
+  guint frame_stats_set : 1;
+  guint trace_frames : 1;
 };
 
 enum {
@@ -612,6 +617,12 @@ mech_container_init (MechContainer *container)
 
   priv = mech_container_get_instance_private (container);
   priv->stage = _mech_stage_new ();
+
+  if (g_getenv ("MECH_DEBUG_FRAMES"))
+    {
+      priv->trace_frames = TRUE;
+      _mech_stage_set_trace (priv->stage, TRUE);
+    }
 }
 
 void
@@ -735,6 +746,8 @@ void
 mech_container_process_updates (MechContainer *container)
 {
   MechContainerPrivate *priv;
+  MechFrameStats *stats;
+  gint64 start_time;
   cairo_t *cr;
 
   priv = mech_container_get_instance_private (container);
@@ -742,14 +755,20 @@ mech_container_process_updates (MechContainer *container)
   if (!priv->surface || (!priv->resize_requested && !priv->redraw_requested))
     return;
 
+  stats = &priv->frame_stats;
+  memset (stats, 0, sizeof (MechFrameStats));
+  stats->frame_time = g_get_monotonic_time ();
+
   /* This call may modify the underlying surfaces */
   if (priv->resize_requested)
     {
       _mech_stage_set_size (priv->stage, &priv->width, &priv->height);
       g_signal_emit (container, signals[SIZE_CHANGED],
                      0, priv->width, priv->height);
+      stats->resize_time = g_get_monotonic_time () - stats->frame_time;
     }
 
+  start_time = g_get_monotonic_time ();
   cr = _mech_surface_cairo_create (priv->surface);
 
   g_signal_emit (container, signals[DRAW], 0, cr);
@@ -762,6 +781,79 @@ mech_container_process_updates (MechContainer *container)
   priv->redraw_requested = FALSE;
 
   cairo_destroy (cr);
+
+  stats->render_time = g_get_monotonic_time () - start_time;
+  stats->total_time = g_get_monotonic_time () - stats->frame_time;
+  _mech_stage_take_stats (priv->stage, stats);
+  priv->frame_stats_set = TRUE;
+
+  if (priv->trace_frames)
+    g_print ("%s %p: frame %.3f ms (resize %.3f, layout %.3f, "
+             "render %.3f, offscreens %.3f, push %.3f), "
+             "%u areas visited, %u culled, %u offscreens, "
+             "%" G_GUINT64_FORMAT " pixels\n",
+             G_OBJECT_TYPE_NAME (container), container,
+             (gdouble) stats->total_time / 1000,
+             (gdouble) stats->resize_time / 1000,
+             (gdouble) stats->layout_time / 1000,
+             (gdouble) stats->render_time / 1000,
+             (gdouble) stats->offscreen_time / 1000,
+             (gdouble) stats->push_time / 1000,
+             stats->n_areas_visited, stats->n_areas_culled,
+             stats->n_offscreens, stats->damaged_pixels);
+}
+
+void
+mech_container_set_offscreen_budget (MechContainer *container,
+                                     gsize          budget)
+{
+  MechContainerPrivate *priv;
+
+  g_return_if_fail (MECH_IS_CONTAINER (container));
+
+  priv = mech_container_get_instance_private (container);
+  _mech_stage_set_offscreen_budget (priv->stage, budget);
+}
+
+gsize
+mech_container_get_offscreen_budget (MechContainer *container)
+{
+  MechContainerPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_CONTAINER (container), 0);
+
+  priv = mech_container_get_instance_private (container);
+  return _mech_stage_get_offscreen_budget (priv->stage);
+}
+
+gsize
+mech_container_get_offscreen_memory (MechContainer *container)
+{
+  MechContainerPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_CONTAINER (container), 0);
+
+  priv = mech_container_get_instance_private (container);
+  return _mech_stage_get_offscreen_memory (priv->stage);
+}
+
+gboolean
+mech_container_get_frame_stats (MechContainer  *container,
+                                MechFrameStats *stats)
+{
+  MechContainerPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_CONTAINER (container), FALSE);
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  priv = mech_container_get_instance_private (container);
+
+  if (!priv->frame_stats_set)
+    return FALSE;
+
+  *stats = priv->frame_stats;
+
+  return TRUE;
 }
 
 gboolean
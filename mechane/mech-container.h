@@ -70,6 +70,13 @@ void       mech_container_queue_resize    (MechContainer *container,
                                            gint           width,
                                            gint           height);
 void       mech_container_process_updates (MechContainer *container);
+gboolean   mech_container_get_frame_stats (MechContainer  *container,
+                                           MechFrameStats *stats);
+
+void       mech_container_set_offscreen_budget (MechContainer *container,
+                                                gsize          budget);
+gsize      mech_container_get_offscreen_budget (MechContainer *container);
+gsize      mech_container_get_offscreen_memory (MechContainer *container);
 
 gboolean   mech_container_get_size        (MechContainer *container,
                                            gint          *width,
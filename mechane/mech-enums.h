@@ -148,6 +148,11 @@ typedef enum {
   MECH_RENDERER_TYPE_GL
 } MechRendererType;
 
+typedef enum {
+  MECH_TEXT_SEARCH_CASE_INSENSITIVE = 1 << 0,
+  MECH_TEXT_SEARCH_REGEX            = 1 << 1
+} MechTextSearchFlags;
+
 G_END_DECLS
 
 #endif /* __MECH_ENUMS_H__ */
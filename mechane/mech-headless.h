@@ -0,0 +1,45 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_HEADLESS_H__
+#define __MECH_HEADLESS_H__
+
+#include <cairo.h>
+#include <mechane/mech-window.h>
+#include <mechane/mech-seat.h>
+#include <mechane/mech-events.h>
+
+G_BEGIN_DECLS
+
+/* Only usable on windows created with MECH_BACKEND=headless */
+
+MechSeat        * mech_headless_get_seat      (void);
+
+gboolean          mech_headless_step          (MechWindow *window,
+                                               gint64      frame_time);
+gboolean          mech_headless_inject_event  (MechWindow *window,
+                                               MechEvent  *event);
+
+guint             mech_headless_get_n_updates (MechWindow *window);
+void              mech_headless_get_damage    (MechWindow *window,
+                                               guint64    *last_frame,
+                                               guint64    *total);
+cairo_surface_t * mech_headless_get_image     (MechWindow *window);
+
+G_END_DECLS
+
+#endif /* __MECH_HEADLESS_H__ */
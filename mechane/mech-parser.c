@@ -25,6 +25,7 @@ typedef struct _MechParserPrivate MechParserPrivate;
 typedef struct _ParserRule ParserRule;
 typedef struct _ParserStackedRule ParserStackedRule;
 typedef enum _ParserRuleType ParserRuleType;
+typedef struct _ParserByteSet ParserByteSet;
 
 enum {
   ERROR,
@@ -99,6 +100,22 @@ struct _ParserStackedRule
   guint finished : 1;
 };
 
+/* 256 bit byte class, delimiters are all ASCII,
+ * so input can be scanned bytewise against it.
+ */
+struct _ParserByteSet
+{
+  guint32 bits[8];
+};
+
+#define BYTE_SET_ADD(s,c) ((s)->bits[(guchar) (c) >> 5] |= (1U << ((guchar) (c) & 31)))
+#define BYTE_SET_HAS(s,c) (((s)->bits[(guchar) (c) >> 5] & (1U << ((guchar) (c) & 31))) != 0)
+
+/* ASCII bytes allowed in unquoted strings: [#-_0-9A-Za-z] */
+static const ParserByteSet string_chars = {
+  { 0, 0x03ff2008, 0x87fffffe, 0x07fffffe, 0, 0, 0, 0 }
+};
+
 struct _MechParserContext
 {
   MechParser *parser;
@@ -108,7 +125,7 @@ struct _MechParserContext
   GArray *rule_stack;
   GPtrArray *data_stack;
   GArray *delimiters;
-  gchar *delimiters_string;
+  ParserByteSet delimiters_set;
 };
 
 struct _MechParserPrivate
@@ -513,37 +530,23 @@ _parser_context_pop_data (MechParserContext  *context,
 }
 
 static void
-_parser_context_update_delimiters_string (MechParserContext *context)
+_parser_context_update_delimiters_set (MechParserContext *context)
 {
-  GString *string = NULL;
   gint i;
 
-  if (context->delimiters_string)
-    {
-      g_free (context->delimiters_string);
-      context->delimiters_string = NULL;
-    }
-
-  if (context->delimiters->len == 0)
-    return;
+  memset (&context->delimiters_set, 0, sizeof (ParserByteSet));
 
   for (i = context->delimiters->len - 1; i >= 0; i--)
     {
-      gunichar ch;
+      guchar ch;
 
       ch = g_array_index (context->delimiters, guchar, i);
 
       if (ch == 0)
         break;
 
-      if (!string)
-        string = g_string_new ("");
-
-      g_string_append_unichar (string, ch);
+      BYTE_SET_ADD (&context->delimiters_set, ch);
     }
-
-  if (string)
-    context->delimiters_string = g_string_free (string, FALSE);
 }
 
 static void
@@ -560,7 +563,7 @@ _parser_context_push_delimiter (MechParserContext *context,
     }
 
   g_array_append_val (context->delimiters, delimiter);
-  _parser_context_update_delimiters_string (context);
+  _parser_context_update_delimiters_set (context);
 }
 
 static void
@@ -574,7 +577,7 @@ _parser_context_pop_delimiter (MechParserContext *context)
       g_array_index (context->delimiters, guchar, context->delimiters->len - 1) == 0)
     g_array_remove_index (context->delimiters, context->delimiters->len - 1);
 
-  _parser_context_update_delimiters_string (context);
+  _parser_context_update_delimiters_set (context);
 }
 
 static MechParserContext *
@@ -613,34 +616,6 @@ _parser_context_free (MechParserContext *context)
   g_free (context);
 }
 
-static gboolean
-_char_is_delimiter (const gchar *ptr,
-                    const gchar *delimiters,
-                    const gchar *context_delimiters)
-{
-  guint i = 0;
-
-  if (delimiters)
-    {
-      for (i = 0; delimiters[i]; i++)
-        {
-          if (*ptr == delimiters[i])
-            return TRUE;
-        }
-    }
-
-  if (context_delimiters)
-    {
-      for (i = 0; context_delimiters[i]; i++)
-        {
-          if (*ptr == context_delimiters[i])
-            return TRUE;
-        }
-    }
-
-  return FALSE;
-}
-
 static gboolean
 _advance_while_valid (MechParserContext  *context,
                       gchar             **end,
@@ -648,26 +623,33 @@ _advance_while_valid (MechParserContext  *context,
                       gboolean            add_context_delimiters,
                       gboolean            equal)
 {
-  const gchar *context_delimiters = NULL, *start;
-
-  start = *end = (gchar *) _mech_parser_context_get_current (context);
+  ParserByteSet set = { { 0 } };
+  const guchar *start, *ptr;
+  guint i;
 
   if (add_context_delimiters)
-    context_delimiters = context->delimiters_string;
+    set = context->delimiters_set;
 
-  while (**end)
+  if (delimiters)
     {
-      gboolean match = FALSE;
+      for (i = 0; delimiters[i]; i++)
+        BYTE_SET_ADD (&set, delimiters[i]);
+    }
 
-      match = _char_is_delimiter (*end, delimiters, context_delimiters);
+  start = ptr = (const guchar *) _mech_parser_context_get_current (context);
 
-      if (match == equal)
-        return TRUE;
+  /* Delimiters never match UTF-8 lead or continuation
+   * bytes, so multibyte chars are skipped as a whole.
+   */
+  while (*ptr && BYTE_SET_HAS (&set, *ptr) != equal)
+    ptr++;
 
-      *end = g_utf8_next_char (*end);
-    }
+  *end = (gchar *) ptr;
 
-  return **end == '\0' && *end != start;
+  if (*ptr)
+    return TRUE;
+
+  return ptr != start;
 }
 
 static gboolean
@@ -717,6 +699,46 @@ _parse_number (MechParser         *parser,
   return TRUE;
 }
 
+static gboolean
+_token_equals (const gchar *token,
+               gsize        len,
+               const gchar *str)
+{
+  return strncmp (token, str, len) == 0 && str[len] == '\0';
+}
+
+static GEnumValue *
+_enum_get_value_by_token (GEnumClass  *enum_class,
+                          const gchar *token,
+                          gsize        len)
+{
+  guint i;
+
+  for (i = 0; i < enum_class->n_values; i++)
+    {
+      if (_token_equals (token, len, enum_class->values[i].value_nick))
+        return &enum_class->values[i];
+    }
+
+  return NULL;
+}
+
+static GFlagsValue *
+_flags_get_value_by_token (GFlagsClass *flags_class,
+                           const gchar *token,
+                           gsize        len)
+{
+  guint i;
+
+  for (i = 0; i < flags_class->n_values; i++)
+    {
+      if (_token_equals (token, len, flags_class->values[i].value_nick))
+        return &flags_class->values[i];
+    }
+
+  return NULL;
+}
+
 static gboolean
 _parse_enum (MechParser         *parser,
              MechParserContext  *context,
@@ -727,7 +749,7 @@ _parse_enum (MechParser         *parser,
   GEnumClass *enum_class;
   GEnumValue *enum_value;
   const gchar *data;
-  gchar *str, *end;
+  gchar *end;
 
   if (!g_type_is_a (G_VALUE_TYPE (value), G_TYPE_ENUM))
     return FALSE;
@@ -740,21 +762,19 @@ _parse_enum (MechParser         *parser,
   if (end == data)
     return FALSE;
 
-  str = g_strndup (data, end - data);
   enum_class = g_type_class_ref (G_VALUE_TYPE (value));
-  enum_value = g_enum_get_value_by_nick (enum_class, str);
+  enum_value = _enum_get_value_by_token (enum_class, data, end - data);
 
   if (!enum_value)
     {
-      g_warning ("Invalid value '%s' for enum type '%s'",
-                 str, G_VALUE_TYPE_NAME (value));
-      g_free (str);
+      g_warning ("Invalid value '%.*s' for enum type '%s'",
+                 (gint) (end - data), data, G_VALUE_TYPE_NAME (value));
+      g_type_class_unref (enum_class);
       return FALSE;
     }
 
   g_value_set_enum (value, enum_value->value);
   g_type_class_unref (enum_class);
-  g_free (str);
 
   *offset_end = end - data;
 
@@ -771,7 +791,7 @@ _parse_flags (MechParser         *parser,
   GFlagsClass *flags_class;
   GFlagsValue *flag_value;
   const gchar *data, *cur;
-  gchar *str, *end;
+  gchar *end;
   guint flags= 0;
 
   if (!g_type_is_a (G_VALUE_TYPE (value), G_TYPE_FLAGS))
@@ -783,21 +803,22 @@ _parse_flags (MechParser         *parser,
   while (TRUE)
     {
       if (!_advance_till_delimiter (context, &end, ", \r\n", TRUE))
-        return FALSE;
+        {
+          g_type_class_unref (flags_class);
+          return FALSE;
+        }
 
-      str = g_strndup (cur, end - cur);
-      flag_value = g_flags_get_value_by_nick (flags_class, str);
+      flag_value = _flags_get_value_by_token (flags_class, cur, end - cur);
 
       if (!flag_value)
         {
-          g_warning ("Invalid value '%s' for flags type '%s'",
-                     str, G_VALUE_TYPE_NAME (value));
-          g_free (str);
+          g_warning ("Invalid value '%.*s' for flags type '%s'",
+                     (gint) (end - cur), cur, G_VALUE_TYPE_NAME (value));
+          g_type_class_unref (flags_class);
           return FALSE;
         }
 
       flags |= flag_value->value;
-      g_free (str);
 
       if (end[0] != ',')
         break;
@@ -820,14 +841,10 @@ _parse_string (MechParser         *parser,
                GValue             *value,
                GError            **error)
 {
-  const gchar *data;
-  gchar *str, *end;
+  const gchar *data, *start;
+  gchar *end;
   gunichar ch;
 
-#define CHAR_VALID(c)                        \
-  ((c) == '#' || (c) == '-' || (c) == '_' || \
-   g_unichar_isalnum ((c)))
-
   data = _mech_parser_context_get_current (context);
   end = (gchar *) data;
   *offset_end = 0;
@@ -845,35 +862,39 @@ _parse_string (MechParser         *parser,
                                     delimiter, TRUE) || end[0] != data[0])
         return FALSE;
 
-      str = g_strndup (data + 1, end - data - 1);
+      start = data + 1;
+      g_value_take_string (value, g_strndup (start, end - start));
       end++;
     }
   else
     {
-      while (end && *end)
+      while (*end)
         {
+          if ((guchar) *end < 0x80)
+            {
+              if (!BYTE_SET_HAS (&string_chars, *end))
+                break;
+
+              end++;
+              continue;
+            }
+
           ch = g_utf8_get_char (end);
 
-          if (!CHAR_VALID (ch))
+          if (!g_unichar_isalnum (ch))
             break;
 
           end = g_utf8_next_char (end);
         }
 
-      str = g_strndup (data, end - data);
-    }
+      if (end == data)
+        return FALSE;
 
-  if (end == data)
-    {
-      g_free (str);
-      return FALSE;
+      g_value_take_string (value, g_strndup (data, end - data));
     }
 
-  g_value_take_string (value, str);
   *offset_end = end - data;
 
-#undef CHAR_VALID
-
   return TRUE;
 }
 
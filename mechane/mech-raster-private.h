@@ -0,0 +1,35 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_RASTER_PRIVATE_H__
+#define __MECH_RASTER_PRIVATE_H__
+
+#include <glib.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MechRasterTiles MechRasterTiles;
+
+MechRasterTiles * _mech_raster_tiles_new         (cairo_t              *cr,
+                                                  const cairo_region_t *region);
+cairo_t         * _mech_raster_tiles_get_context (MechRasterTiles      *tiles);
+void              _mech_raster_tiles_finish      (MechRasterTiles      *tiles);
+
+G_END_DECLS
+
+#endif /* __MECH_RASTER_PRIVATE_H__ */
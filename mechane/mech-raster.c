@@ -0,0 +1,371 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cairo.h>
+#include <math.h>
+#ifdef CAIRO_HAS_TEE_SURFACE
+#include <cairo-tee.h>
+#endif
+
+#include "mech-raster-private.h"
+
+#define BAND_MIN_HEIGHT 64
+#define TILING_MIN_PIXELS (512 * 512)
+
+typedef struct _RasterBand RasterBand;
+
+struct _RasterBand
+{
+  MechRasterTiles *tiles;
+  cairo_surface_t *recording;
+  cairo_region_t *region;
+  gint y;
+  gint height;
+};
+
+struct _MechRasterTiles
+{
+  cairo_surface_t *target;
+  guchar *data;
+  gint width;
+  gint stride;
+
+  cairo_t *cr;
+  GArray *bands;
+
+  GMutex mutex;
+  GCond cond;
+  guint n_pending;
+};
+
+static GThreadPool *raster_pool = NULL;
+
+#ifdef CAIRO_HAS_TEE_SURFACE
+static void
+_raster_band_func (gpointer data,
+                   gpointer user_data)
+{
+  RasterBand *band = data;
+  MechRasterTiles *tiles = band->tiles;
+  cairo_rectangle_int_t rect;
+  cairo_surface_t *surface;
+  gint i, n_rects;
+  cairo_t *cr;
+
+  /* Each band gets its own image over the target
+   * pixels, and replays its own recording.
+   */
+  surface = cairo_image_surface_create_for_data (tiles->data +
+                                                 band->y * tiles->stride,
+                                                 CAIRO_FORMAT_ARGB32,
+                                                 tiles->width, band->height,
+                                                 tiles->stride);
+  cr = cairo_create (surface);
+  cairo_translate (cr, 0, -band->y);
+
+  n_rects = cairo_region_num_rectangles (band->region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_region_get_rectangle (band->region, i, &rect);
+      cairo_rectangle (cr, rect.x, rect.y, rect.width, rect.height);
+    }
+
+  cairo_clip (cr);
+  cairo_set_source_surface (cr, band->recording, 0, 0);
+  cairo_paint (cr);
+
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+
+  g_mutex_lock (&tiles->mutex);
+  tiles->n_pending--;
+
+  if (tiles->n_pending == 0)
+    g_cond_signal (&tiles->cond);
+
+  g_mutex_unlock (&tiles->mutex);
+}
+
+static GThreadPool *
+_mech_raster_get_pool (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      const gchar *threads_str;
+      guint n_threads = 0;
+
+      threads_str = g_getenv ("MECH_RENDER_THREADS");
+
+      if (g_strcmp0 (threads_str, "auto") == 0)
+        n_threads = g_get_num_processors ();
+      else if (threads_str)
+        n_threads = (guint) g_ascii_strtoull (threads_str, NULL, 10);
+
+      if (n_threads > 1)
+        raster_pool = g_thread_pool_new (_raster_band_func, NULL,
+                                         n_threads, FALSE, NULL);
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return raster_pool;
+}
+
+/* Returns @region, given in the user space of @matrix, as
+ * the device pixels it covers, clamped to the target size.
+ */
+static cairo_region_t *
+_raster_region_to_device (const cairo_region_t *region,
+                          const cairo_matrix_t *matrix,
+                          gint                  width,
+                          gint                  height)
+{
+  cairo_rectangle_int_t rect, bounds = { 0, 0, width, height };
+  gdouble x[4], y[4], x1, y1, x2, y2;
+  cairo_region_t *device;
+  gint i, j, n_rects;
+
+  device = cairo_region_create ();
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_region_get_rectangle (region, i, &rect);
+
+      x[0] = x[3] = rect.x;
+      x[1] = x[2] = rect.x + rect.width;
+      y[0] = y[1] = rect.y;
+      y[2] = y[3] = rect.y + rect.height;
+
+      for (j = 0; j < 4; j++)
+        cairo_matrix_transform_point (matrix, &x[j], &y[j]);
+
+      x1 = MIN (MIN (x[0], x[1]), MIN (x[2], x[3]));
+      y1 = MIN (MIN (y[0], y[1]), MIN (y[2], y[3]));
+      x2 = MAX (MAX (x[0], x[1]), MAX (x[2], x[3]));
+      y2 = MAX (MAX (y[0], y[1]), MAX (y[2], y[3]));
+
+      rect.x = (gint) floor (x1);
+      rect.y = (gint) floor (y1);
+      rect.width = (gint) ceil (x2) - rect.x;
+      rect.height = (gint) ceil (y2) - rect.y;
+      cairo_region_union_rectangle (device, &rect);
+    }
+
+  cairo_region_intersect_rectangle (device, &bounds);
+
+  return device;
+}
+#endif /* CAIRO_HAS_TEE_SURFACE */
+
+static void
+_raster_tiles_free (MechRasterTiles *tiles)
+{
+  RasterBand *band;
+  guint i;
+
+  for (i = 0; i < tiles->bands->len; i++)
+    {
+      band = &g_array_index (tiles->bands, RasterBand, i);
+      cairo_surface_destroy (band->recording);
+      cairo_region_destroy (band->region);
+    }
+
+  if (tiles->cr)
+    cairo_destroy (tiles->cr);
+
+  g_array_unref (tiles->bands);
+  g_mutex_clear (&tiles->mutex);
+  g_cond_clear (&tiles->cond);
+  cairo_surface_destroy (tiles->target);
+  g_slice_free (MechRasterTiles, tiles);
+}
+
+MechRasterTiles *
+_mech_raster_tiles_new (cairo_t              *cr,
+                        const cairo_region_t *region)
+{
+#ifdef CAIRO_HAS_TEE_SURFACE
+  cairo_surface_t *target, *master, *tee;
+  cairo_rectangle_int_t extents, rect;
+  cairo_region_t *device_region;
+  gdouble x_offset, y_offset;
+  gint i, n_rects, n_bands;
+  MechRasterTiles *tiles;
+  cairo_rectangle_t area;
+  cairo_matrix_t matrix;
+  guint64 n_pixels = 0;
+  gint band_height;
+  GThreadPool *pool;
+
+  pool = _mech_raster_get_pool ();
+
+  if (!pool)
+    return NULL;
+
+  target = cairo_get_target (cr);
+  cairo_surface_get_device_offset (target, &x_offset, &y_offset);
+
+  if (cairo_surface_get_type (target) != CAIRO_SURFACE_TYPE_IMAGE ||
+      cairo_image_surface_get_format (target) != CAIRO_FORMAT_ARGB32 ||
+      x_offset != 0 || y_offset != 0)
+    return NULL;
+
+  /* The region is in user space, bands are split
+   * and rasterized in device pixels.
+   */
+  cairo_get_matrix (cr, &matrix);
+  device_region =
+    _raster_region_to_device (region, &matrix,
+                              cairo_image_surface_get_width (target),
+                              cairo_image_surface_get_height (target));
+  n_rects = cairo_region_num_rectangles (device_region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_region_get_rectangle (device_region, i, &rect);
+      n_pixels += (guint64) rect.width * rect.height;
+    }
+
+  cairo_region_get_extents (device_region, &extents);
+  n_bands = MIN (g_thread_pool_get_max_threads (pool) * 2,
+                 extents.height / BAND_MIN_HEIGHT);
+
+  /* Small damage is faster drawn directly */
+  if (n_pixels < TILING_MIN_PIXELS || n_bands < 2)
+    {
+      cairo_region_destroy (device_region);
+      return NULL;
+    }
+
+  band_height = (extents.height + n_bands - 1) / n_bands;
+
+  tiles = g_slice_new0 (MechRasterTiles);
+  tiles->target = cairo_surface_reference (target);
+  tiles->data = cairo_image_surface_get_data (target);
+  tiles->width = cairo_image_surface_get_width (target);
+  tiles->stride = cairo_image_surface_get_stride (target);
+  tiles->bands = g_array_sized_new (FALSE, TRUE, sizeof (RasterBand), n_bands);
+  g_mutex_init (&tiles->mutex);
+  g_cond_init (&tiles->cond);
+
+  /* Drawing goes through a tee into one recording
+   * per band, so workers don't share any recording.
+   * The master only provides the tee extents.
+   */
+  area.x = extents.x;
+  area.y = extents.y;
+  area.width = extents.width;
+  area.height = extents.height;
+  master = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &area);
+  tee = cairo_tee_surface_create (master);
+  cairo_surface_destroy (master);
+
+  for (i = 0; i < n_bands; i++)
+    {
+      RasterBand band = { 0 };
+
+      rect.x = extents.x;
+      rect.y = extents.y + i * band_height;
+      rect.width = extents.width;
+      rect.height = MIN (band_height, extents.y + extents.height - rect.y);
+
+      if (rect.height <= 0)
+        break;
+
+      band.region = cairo_region_create_rectangle (&rect);
+      cairo_region_intersect (band.region, device_region);
+
+      if (cairo_region_is_empty (band.region))
+        {
+          cairo_region_destroy (band.region);
+          continue;
+        }
+
+      area.x = rect.x;
+      area.y = rect.y;
+      area.width = rect.width;
+      area.height = rect.height;
+
+      band.tiles = tiles;
+      band.y = rect.y;
+      band.height = rect.height;
+      band.recording =
+        cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, &area);
+      cairo_tee_surface_add (tee, band.recording);
+
+      g_array_append_val (tiles->bands, band);
+    }
+
+  tiles->cr = cairo_create (tee);
+  cairo_surface_destroy (tee);
+  cairo_region_destroy (device_region);
+
+  /* Same transformation and clip as the target context */
+  cairo_set_matrix (tiles->cr, &matrix);
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_region_get_rectangle (region, i, &rect);
+      cairo_rectangle (tiles->cr, rect.x, rect.y, rect.width, rect.height);
+    }
+
+  cairo_clip (tiles->cr);
+
+  return tiles;
+#else
+  return NULL;
+#endif
+}
+
+cairo_t *
+_mech_raster_tiles_get_context (MechRasterTiles *tiles)
+{
+  return tiles->cr;
+}
+
+void
+_mech_raster_tiles_finish (MechRasterTiles *tiles)
+{
+  guint i;
+
+  /* Flush all recorded drawing into the bands */
+  cairo_destroy (tiles->cr);
+  tiles->cr = NULL;
+
+  cairo_surface_flush (tiles->target);
+  tiles->n_pending = tiles->bands->len;
+
+  for (i = 0; i < tiles->bands->len; i++)
+    g_thread_pool_push (raster_pool,
+                        &g_array_index (tiles->bands, RasterBand, i),
+                        NULL);
+
+  g_mutex_lock (&tiles->mutex);
+
+  while (tiles->n_pending > 0)
+    g_cond_wait (&tiles->cond, &tiles->mutex);
+
+  g_mutex_unlock (&tiles->mutex);
+
+  cairo_surface_mark_dirty (tiles->target);
+  _raster_tiles_free (tiles);
+}
@@ -51,6 +51,10 @@ void           _mech_renderer_set_font_family        (MechRenderer          *ren
 void           _mech_renderer_set_font_size          (MechRenderer          *renderer,
                                                       gdouble                size,
                                                       MechUnit               unit);
+const PangoFontDescription *
+               _mech_renderer_get_font_description   (MechRenderer          *renderer);
+void           _mech_renderer_set_font_context       (MechRenderer          *renderer,
+                                                      PangoContext          *context);
 void           _mech_renderer_set_padding            (MechRenderer          *renderer,
                                                       MechBorder            *border);
 void           _mech_renderer_set_margin             (MechRenderer          *renderer,
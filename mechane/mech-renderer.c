@@ -81,7 +81,7 @@ mech_renderer_finalize (GObject *object)
 
   priv = mech_renderer_get_instance_private ((MechRenderer *) object);
   pango_font_description_free (priv->font_desc);
-  g_object_unref (priv->font_context);
+  g_clear_object (&priv->font_context);
 
   for (i = 0; i < priv->foregrounds->len; i++)
     _mech_pattern_unref (g_array_index (priv->foregrounds, MechPattern *, i));
@@ -114,7 +114,6 @@ static void
 mech_renderer_init (MechRenderer *renderer)
 {
   MechRendererPrivate *priv;
-  PangoFontMap *font_map;
 
   priv = mech_renderer_get_instance_private (renderer);
   priv->foregrounds = g_array_new (FALSE, FALSE, sizeof (MechPattern *));
@@ -126,11 +125,25 @@ mech_renderer_init (MechRenderer *renderer)
   priv->padding.left = priv->padding.right = 0;
   priv->padding.top = priv->padding.bottom = 0;
 
-  font_map = pango_cairo_font_map_get_default ();
-  priv->font_context = pango_font_map_create_context (font_map);
-
   priv->font_desc = pango_font_description_from_string ("Cantarell 10");
-  pango_context_set_font_description (priv->font_context, priv->font_desc);
+}
+
+static PangoContext *
+_mech_renderer_ensure_font_context (MechRenderer *renderer)
+{
+  MechRendererPrivate *priv;
+  PangoFontMap *font_map;
+
+  priv = mech_renderer_get_instance_private (renderer);
+
+  if (!priv->font_context)
+    {
+      font_map = pango_cairo_font_map_get_default ();
+      priv->font_context = pango_font_map_create_context (font_map);
+      pango_context_set_font_description (priv->font_context, priv->font_desc);
+    }
+
+  return priv->font_context;
 }
 
 MechRenderer *
@@ -164,8 +177,8 @@ _mech_renderer_copy (MechRenderer          *renderer,
 
   if (flags & MECH_RENDERER_COPY_FOREGROUND)
     {
-      g_object_unref (copy_priv->font_context);
-      copy_priv->font_context = g_object_ref (priv->font_context);
+      if (priv->font_context)
+        copy_priv->font_context = g_object_ref (priv->font_context);
 
       pango_font_description_free (copy_priv->font_desc);
       copy_priv->font_desc = pango_font_description_copy (priv->font_desc);
@@ -397,7 +410,7 @@ _mech_renderer_set_font_family (MechRenderer *renderer,
 
   priv = mech_renderer_get_instance_private (renderer);
   pango_font_description_set_family (priv->font_desc, family);
-  pango_context_set_font_description (priv->font_context, priv->font_desc);
+  g_clear_object (&priv->font_context);
 }
 
 void
@@ -431,7 +444,36 @@ _mech_renderer_set_font_size (MechRenderer *renderer,
       return;
     }
 
-  pango_context_set_font_description (priv->font_context, priv->font_desc);
+  g_clear_object (&priv->font_context);
+}
+
+const PangoFontDescription *
+_mech_renderer_get_font_description (MechRenderer *renderer)
+{
+  MechRendererPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_RENDERER (renderer), NULL);
+
+  priv = mech_renderer_get_instance_private (renderer);
+  return priv->font_desc;
+}
+
+void
+_mech_renderer_set_font_context (MechRenderer *renderer,
+                                 PangoContext *context)
+{
+  MechRendererPrivate *priv;
+
+  g_return_if_fail (MECH_IS_RENDERER (renderer));
+  g_return_if_fail (PANGO_IS_CONTEXT (context));
+
+  priv = mech_renderer_get_instance_private (renderer);
+
+  if (priv->font_context == context)
+    return;
+
+  g_clear_object (&priv->font_context);
+  priv->font_context = g_object_ref (context);
 }
 
 void
@@ -606,13 +648,11 @@ PangoLayout *
 mech_renderer_create_layout (MechRenderer *renderer,
                              const gchar  *text)
 {
-  MechRendererPrivate *priv;
   PangoLayout *layout;
 
   g_return_val_if_fail (MECH_IS_RENDERER (renderer), NULL);
 
-  priv = mech_renderer_get_instance_private (renderer);
-  layout = pango_layout_new (priv->font_context);
+  layout = pango_layout_new (_mech_renderer_ensure_font_context (renderer));
 
   if (text)
     pango_layout_set_text (layout, text, -1);
@@ -623,12 +663,9 @@ mech_renderer_create_layout (MechRenderer *renderer,
 PangoContext *
 mech_renderer_get_font_context (MechRenderer *renderer)
 {
-  MechRendererPrivate *priv;
-
   g_return_val_if_fail (MECH_IS_RENDERER (renderer), NULL);
 
-  priv = mech_renderer_get_instance_private (renderer);
-  return priv->font_context;
+  return _mech_renderer_ensure_font_context (renderer);
 }
 
 void
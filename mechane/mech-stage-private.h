@@ -45,6 +45,10 @@ MechStage * _mech_stage_new                 (void);
 
 void        _mech_stage_render              (MechStage       *stage,
                                              cairo_t         *cr);
+void        _mech_stage_take_stats          (MechStage       *stage,
+                                             MechFrameStats  *stats);
+void        _mech_stage_set_trace           (MechStage       *stage,
+                                             gboolean         trace);
 void        _mech_stage_get_size            (MechStage       *stage,
                                              gint            *width,
                                              gint            *height);
@@ -55,6 +59,7 @@ gboolean    _mech_stage_set_size            (MechStage       *stage,
 
 GNode     * _mech_stage_node_new            (MechArea        *area);
 void        _mech_stage_node_free           (GNode           *node);
+void        _mech_stage_node_queue_reindex  (GNode           *node);
 
 void        _mech_stage_set_root            (MechStage       *stage,
                                              MechArea        *area);
@@ -94,6 +99,11 @@ gboolean    _mech_stage_get_renderable_rect (MechStage         *stage,
 MechSurface * _mech_stage_get_rendering_surface (MechStage     *stage,
                                                  MechArea      *area);
 
+void        _mech_stage_set_offscreen_budget (MechStage       *stage,
+                                              gsize            budget);
+gsize       _mech_stage_get_offscreen_budget (MechStage       *stage);
+gsize       _mech_stage_get_offscreen_memory (MechStage       *stage);
+
 
 G_END_DECLS
 
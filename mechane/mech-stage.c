@@ -24,6 +24,7 @@
 #include <mechane/mech-area-private.h>
 #include <mechane/mech-marshal.h>
 #include <mechane/mech-surface-private.h>
+#include <mechane/mech-raster-private.h>
 #include <mechane/mech-renderer.h>
 #include <mechane/mech-enums.h>
 #include <mechane/mech-events.h>
@@ -37,14 +38,25 @@
     (p)[2].y = (p)[3].y = (r).y + (r).height;           \
   } G_STMT_END
 
+/* Parents with fewer children than this are picked through a linear walk */
+#define PICK_INDEX_MIN_CHILDREN 16
+#define PICK_INDEX_LEAF_SIZE 4
+
+#define DEFAULT_OFFSCREEN_BUDGET (128 * 1024 * 1024)
+
 typedef struct _MechStagePrivate MechStagePrivate;
 typedef struct _ZCacheNode ZCacheNode;
 typedef struct _StageNode StageNode;
 typedef struct _OffscreenNode OffscreenNode;
 typedef struct _TraverseStageContext TraverseStageContext;
 typedef struct _PickStageContext PickStageContext;
+typedef struct _PickIndex PickIndex;
+typedef struct _PickIndexEntry PickIndexEntry;
+typedef struct _PickIndexBox PickIndexBox;
+typedef struct _OffscreenUsageData OffscreenUsageData;
 typedef struct _RenderingTarget RenderingTarget;
 typedef struct _RenderStageContext RenderStageContext;
+typedef struct _AreaRecording AreaRecording;
 
 typedef enum {
   TRAVERSE_FLAG_STOP     = 0,
@@ -74,12 +86,49 @@ struct _StageNode
   GNode node; /* data is MechArea */
   StageNode *last_child;
   GArray *z_cache;
+
+  /* Spatial index over children, for picking */
+  PickIndex *pick_index;
+  guint pick_index_dirty : 1;
+};
+
+struct _PickIndexEntry
+{
+  /* Relative to the parent stage rect, so
+   * translations of the parent keep it valid.
+   */
+  gdouble x1, y1, x2, y2;
+  guint position;
+};
+
+struct _PickIndexBox
+{
+  gdouble x1, y1, x2, y2;
+  guint first;
+  guint n_entries; /* 0 on inner boxes */
+  guint skip;      /* Box after this one's subtree */
+};
+
+struct _PickIndex
+{
+  GPtrArray *children; /* position -> GNode, in stacking order */
+  GArray *entries;
+  GArray *boxes;       /* Bounding volume hierarchy, depth first */
+  GArray *unindexed;   /* positions of transformed/shaped children */
 };
 
 struct _OffscreenNode
 {
   GNode node;  /* data is MechSurface */
   MechArea *area;
+  guint64 last_used;
+};
+
+struct _OffscreenUsageData
+{
+  GPtrArray *candidates;
+  guint64 frame;
+  gsize usage;
 };
 
 struct _TraverseStageContext
@@ -94,6 +143,20 @@ struct _RenderingTarget
   OffscreenNode *offscreen;
   cairo_region_t *invalidated;
   cairo_t *cr;
+  MechRasterTiles *tiles;
+  gint64 start_time;
+};
+
+struct _AreaRecording
+{
+  /* Key, content is replayed while these stay the same */
+  MechRenderer *renderer;
+  gdouble width;
+  gdouble height;
+  guint generation;
+
+  cairo_surface_t *content;
+  cairo_surface_t *border;
 };
 
 struct _RenderStageContext
@@ -102,11 +165,12 @@ struct _RenderStageContext
   GArray *target_stack;
   GArray *prev_offscreens;
   cairo_t *cr;
+  MechFrameStats stats;
+  guint trace : 1;
 };
 
 struct _PickStageContext
 {
-  TraverseStageContext functions;
   MechArea *root;
   GPtrArray *areas;
   MechEventType event_type;
@@ -119,12 +183,24 @@ struct _MechStagePrivate
   StageNode *areas;
   OffscreenNode *offscreens;
 
+  /* Scratch stack of pick candidates, reused across picks */
+  GArray *pick_candidates;
+
   gint width;
   gint height;
   guint draw_signal_id;
+
+  /* Accumulated until _mech_stage_take_stats() */
+  MechFrameStats stats;
+
+  guint64 frame_count;
+  gsize offscreen_budget;
+
+  guint trace : 1;
 };
 
 static GQuark quark_area_offscreen = 0;
+static GQuark quark_area_recording = 0;
 
 G_DEFINE_TYPE_WITH_PRIVATE (MechStage, mech_stage, G_TYPE_OBJECT)
 
@@ -142,6 +218,8 @@ _stage_node_insert (StageNode *parent,
   if (!parent->node.children || after == parent->last_child)
     parent->last_child = node;
 
+  parent->pick_index_dirty = TRUE;
+
   return (StageNode *) g_node_insert_after ((GNode *) parent,
                                             (GNode *) after,
                                             (GNode *) node);
@@ -271,10 +349,12 @@ _mech_stage_destroy_offscreen_node (OffscreenNode *offscreen,
   _offscreen_node_destroy (offscreen);
 }
 
-static void
+/* Returns the memory size of the child surfaces that were unset */
+static gsize
 _surface_check_children (OffscreenNode *offscreen,
                          OffscreenNode *parent)
 {
+  gsize freed = 0;
   GNode *node;
 
   for (node = offscreen->node.children; node; node = node->next)
@@ -288,9 +368,15 @@ _surface_check_children (OffscreenNode *offscreen,
       /* Unset surface, it will be rechecked when rendering iterates
        * down there.
        */
+      if (_mech_surface_get_surface_type (node->data) ==
+          MECH_SURFACE_TYPE_OFFSCREEN)
+        freed += _mech_surface_get_memory_size (node->data);
+
       g_object_unref (node->data);
       node->data = NULL;
     }
+
+  return freed;
 }
 
 static void
@@ -367,8 +453,10 @@ render_stage_context_push_target (RenderStageContext *context,
 {
   MechSurface *prev_offscreen = NULL;
   RenderingTarget target = { 0 };
+  gint i, n_rects;
 
   target.offscreen = offscreen;
+  target.start_time = g_get_monotonic_time ();
   _mech_surface_acquire (offscreen->node.data);
 
   if (offscreen->node.parent || !context->cr)
@@ -378,8 +466,31 @@ render_stage_context_push_target (RenderStageContext *context,
 
   _mech_surface_apply_clip (offscreen->node.data, target.cr);
   target.invalidated = _mech_surface_get_clip (offscreen->node.data);
+
+  if (_mech_surface_get_renderer_type (offscreen->node.data) ==
+      MECH_RENDERER_TYPE_SOFTWARE)
+    target.tiles = _mech_raster_tiles_new (target.cr, target.invalidated);
+
+  if (target.tiles)
+    {
+      /* Record drawing, and rasterize it in parallel on pop */
+      cairo_destroy (target.cr);
+      target.cr =
+        cairo_reference (_mech_raster_tiles_get_context (target.tiles));
+    }
+
   g_array_append_val (context->target_stack, target);
 
+  n_rects = cairo_region_num_rectangles (target.invalidated);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+
+      cairo_region_get_rectangle (target.invalidated, i, &rect);
+      context->stats.damaged_pixels += (guint64) rect.width * rect.height;
+    }
+
   /* Add a NULL to the prev_offscreens stack, and
    * maybe update current surface z-order.
    */
@@ -412,6 +523,7 @@ render_stage_context_pop_target (RenderStageContext *context)
 {
   OffscreenNode *offscreen;
   RenderingTarget *target;
+  gint64 start_time, push_time;
 
   target = render_stage_context_lookup_target (context);
   g_assert (target != NULL);
@@ -419,14 +531,37 @@ render_stage_context_pop_target (RenderStageContext *context)
   cairo_destroy (target->cr);
   cairo_region_destroy (target->invalidated);
   offscreen = target->offscreen;
+  start_time = target->start_time;
+
+  if (target->tiles)
+    _mech_raster_tiles_finish (target->tiles);
 
   g_array_remove_index (context->target_stack,
                         context->target_stack->len - 1);
   g_array_remove_index (context->prev_offscreens,
                         context->prev_offscreens->len - 1);
 
+  push_time = g_get_monotonic_time ();
   _mech_surface_push_update (offscreen->node.data);
   _mech_surface_release (offscreen->node.data);
+  context->stats.push_time += g_get_monotonic_time () - push_time;
+
+  if (offscreen->node.parent)
+    {
+      gint64 elapsed;
+
+      elapsed = g_get_monotonic_time () - start_time;
+      context->stats.n_offscreens++;
+
+      /* Nested offscreens are already accounted in their parent's */
+      if (context->target_stack->len == 1)
+        context->stats.offscreen_time += elapsed;
+
+      if (context->trace)
+        g_print ("  offscreen %s %p: %.3f ms\n",
+                 G_OBJECT_TYPE_NAME (offscreen->area),
+                 offscreen->area, (gdouble) elapsed / 1000);
+    }
 
   return offscreen;
 }
@@ -461,6 +596,119 @@ render_stage_context_area_overlaps_clip (RenderStageContext *context,
                                           &rect) != CAIRO_REGION_OVERLAP_OUT;
 }
 
+static void
+_area_recording_free (AreaRecording *recording)
+{
+  if (recording->content)
+    cairo_surface_destroy (recording->content);
+  if (recording->border)
+    cairo_surface_destroy (recording->border);
+
+  g_object_unref (recording->renderer);
+  g_slice_free (AreaRecording, recording);
+}
+
+static AreaRecording *
+_area_lookup_recording (MechArea          *area,
+                        MechRenderer      *renderer,
+                        cairo_rectangle_t *rect)
+{
+  AreaRecording *recording;
+
+  recording = g_object_get_qdata ((GObject *) area, quark_area_recording);
+
+  if (!mech_area_get_retain_drawing (area))
+    {
+      if (recording)
+        g_object_set_qdata ((GObject *) area, quark_area_recording, NULL);
+      return NULL;
+    }
+
+  if (recording &&
+      recording->renderer == renderer &&
+      recording->width == rect->width &&
+      recording->height == rect->height &&
+      recording->generation == _mech_area_get_content_generation (area))
+    return recording;
+
+  /* The renderer is kept alive, so a new one can't
+   * be mistaken for the one in the recorded key.
+   */
+  recording = g_slice_new0 (AreaRecording);
+  recording->renderer = g_object_ref (renderer);
+  recording->width = rect->width;
+  recording->height = rect->height;
+  recording->generation = _mech_area_get_content_generation (area);
+  g_object_set_qdata_full ((GObject *) area, quark_area_recording, recording,
+                           (GDestroyNotify) _area_recording_free);
+
+  return recording;
+}
+
+static void
+_stage_replay_recording (cairo_surface_t *recording,
+                         cairo_t         *cr)
+{
+  cairo_save (cr);
+  cairo_set_source_surface (cr, recording, 0, 0);
+  cairo_paint (cr);
+  cairo_restore (cr);
+}
+
+static void
+_stage_render_area_content (MechStage         *stage,
+                            MechArea          *area,
+                            MechRenderer      *renderer,
+                            cairo_rectangle_t *rect,
+                            cairo_t           *cr)
+{
+  MechStagePrivate *priv;
+  MechBorder border;
+
+  priv = mech_stage_get_instance_private (stage);
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_PADDING, &border);
+
+  mech_renderer_render_background (renderer, cr,
+                                   border.left, border.top,
+                                   rect->width - (border.left + border.right),
+                                   rect->height - (border.top + border.bottom));
+
+  if (priv->draw_signal_id == 0)
+    priv->draw_signal_id = g_signal_lookup ("draw", MECH_TYPE_AREA);
+
+  cairo_save (cr);
+
+  if (mech_area_get_clip (area))
+    {
+      mech_renderer_get_border_extents (renderer, MECH_EXTENT_BORDER, &border);
+      mech_renderer_set_border_path (renderer, cr,
+                                     border.left, border.top,
+                                     rect->width - (border.left + border.right),
+                                     rect->height - (border.top + border.bottom));
+      cairo_clip (cr);
+    }
+
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_CONTENT, &border);
+  cairo_translate (cr, border.left, border.top);
+  g_signal_emit (area, priv->draw_signal_id, 0, cr);
+  cairo_restore (cr);
+}
+
+static void
+_stage_render_area_border (MechArea          *area,
+                           MechRenderer      *renderer,
+                           cairo_rectangle_t *rect,
+                           cairo_t           *cr)
+{
+  MechBorder border;
+
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_BORDER, &border);
+  mech_renderer_render_border (renderer, cr,
+                               border.left, border.top,
+                               rect->width - (border.left + border.right),
+                               rect->height - (border.top + border.bottom));
+}
+
 static gboolean
 render_stage_enter (MechStage          *stage,
                     GNode              *node,
@@ -487,7 +735,10 @@ render_stage_enter (MechStage          *stage,
 
   if (!has_matrix &&
       !render_stage_context_area_overlaps_clip (context, stage, area))
-    return FALSE;
+    {
+      context->stats.n_areas_culled++;
+      return FALSE;
+    }
 
   if (node->parent)
     {
@@ -511,12 +762,18 @@ render_stage_enter (MechStage          *stage,
 
   if (offscreen)
     {
+      MechStagePrivate *priv = mech_stage_get_instance_private (stage);
+
+      offscreen->last_used = priv->frame_count;
       _mech_stage_resize_offscreen (stage, offscreen);
       render_stage_context_push_target (context, offscreen);
 
       /* Check again using the new target's invalidated area */
       if (!render_stage_context_area_overlaps_clip (context, stage, area))
-        return FALSE;
+        {
+          context->stats.n_areas_culled++;
+          return FALSE;
+        }
     }
 
   return TRUE;
@@ -536,16 +793,34 @@ render_stage_leave (MechStage          *stage,
   if (render_stage_context_area_overlaps_clip (context, stage, area))
     {
       MechRenderer *renderer;
-      MechBorder border;
+      AreaRecording *recording;
 
       _mech_area_get_stage_rect (area, &rect);
       renderer = mech_area_get_renderer (area);
-      mech_renderer_get_border_extents (renderer, MECH_EXTENT_BORDER, &border);
 
-      mech_renderer_render_border (renderer, target->cr,
-                                   border.left, border.top,
-                                   rect.width - (border.left + border.right),
-                                   rect.height - (border.top + border.bottom));
+      /* Tiles are rasterized in threads, which can't share recordings */
+      if (!target->tiles)
+        recording = _area_lookup_recording (area, renderer, &rect);
+      else
+        recording = NULL;
+
+      if (recording)
+        {
+          if (!recording->border)
+            {
+              cairo_t *cr;
+
+              recording->border =
+                cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+              cr = cairo_create (recording->border);
+              _stage_render_area_border (area, renderer, &rect, cr);
+              cairo_destroy (cr);
+            }
+
+          _stage_replay_recording (recording->border, target->cr);
+        }
+      else
+        _stage_render_area_border (area, renderer, &rect, target->cr);
     }
 
   if (target->offscreen->area == area && !G_NODE_IS_ROOT (node))
@@ -566,26 +841,43 @@ render_stage_visit (MechStage          *stage,
                     RenderStageContext *context)
 {
   MechArea *area = node->data;
+  AreaRecording *recording;
   RenderingTarget *target;
   MechRenderer *renderer;
   cairo_rectangle_t rect;
-  MechStagePrivate *priv;
   MechBorder border;
 
-  priv = mech_stage_get_instance_private (stage);
+  context->stats.n_areas_visited++;
   target = render_stage_context_lookup_target (context);
   _mech_area_get_stage_rect (area, &rect);
-
   renderer = mech_area_get_renderer (area);
-  mech_renderer_get_border_extents (renderer, MECH_EXTENT_PADDING, &border);
 
-  mech_renderer_render_background (renderer, target->cr,
-                                   border.left, border.top,
-                                   rect.width - (border.left + border.right),
-                                   rect.height - (border.top + border.bottom));
+  if (!target->tiles)
+    recording = _area_lookup_recording (area, renderer, &rect);
+  else
+    recording = NULL;
+
+  if (recording)
+    {
+      if (!recording->content)
+        {
+          cairo_t *cr;
+
+          recording->content =
+            cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+          cr = cairo_create (recording->content);
+          _stage_render_area_content (stage, area, renderer, &rect, cr);
+          cairo_destroy (cr);
+        }
+
+      _stage_replay_recording (recording->content, target->cr);
+    }
+  else
+    _stage_render_area_content (stage, area, renderer, &rect, target->cr);
 
   if (mech_area_get_clip (area))
     {
+      /* Children are clipped too, keep it on the target */
       mech_renderer_get_border_extents (renderer, MECH_EXTENT_BORDER, &border);
       mech_renderer_set_border_path (renderer, target->cr,
                                      border.left, border.top,
@@ -594,15 +886,6 @@ render_stage_visit (MechStage          *stage,
       cairo_clip (target->cr);
     }
 
-  if (priv->draw_signal_id == 0)
-    priv->draw_signal_id = g_signal_lookup ("draw", MECH_TYPE_AREA);
-
-  cairo_save (target->cr);
-  mech_renderer_get_border_extents (renderer, MECH_EXTENT_CONTENT, &border);
-  cairo_translate (target->cr, border.left, border.top);
-  g_signal_emit (area, priv->draw_signal_id, 0, target->cr);
-  cairo_restore (target->cr);
-
   return TRAVERSE_FLAG_CONTINUE | TRAVERSE_FLAG_RECURSE;
 }
 
@@ -617,6 +900,8 @@ render_stage_context_init (RenderStageContext *context,
   context->functions.leave = (LeaveNodeFunc) render_stage_leave;
   context->functions.visit = (VisitNodeFunc) render_stage_visit;
   context->cr = (cr) ? cairo_reference (cr) : NULL;
+  memset (&context->stats, 0, sizeof (MechFrameStats));
+  context->trace = priv->trace;
   context->target_stack = g_array_new (FALSE, FALSE,
                                        sizeof (RenderingTarget));
   context->prev_offscreens = g_array_new (FALSE, FALSE,
@@ -641,39 +926,306 @@ render_stage_context_finish (RenderStageContext *context)
 }
 
 /* Picking */
-static TraverseFlags
-pick_stage_visit (MechStage        *stage,
-                  const GNode      *node,
-                  PickStageContext *context)
+static gint
+_pick_index_compare_entries (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+  const PickIndexEntry *entry_a = a, *entry_b = b;
+  MechAxis axis = GPOINTER_TO_INT (user_data);
+  gdouble center_a, center_b;
+
+  if (axis == MECH_AXIS_X)
+    {
+      center_a = entry_a->x1 + entry_a->x2;
+      center_b = entry_b->x1 + entry_b->x2;
+    }
+  else
+    {
+      center_a = entry_a->y1 + entry_a->y2;
+      center_b = entry_b->y1 + entry_b->y2;
+    }
+
+  return (center_a > center_b) - (center_a < center_b);
+}
+
+static gint
+_pick_index_compare_positions (gconstpointer a,
+                               gconstpointer b,
+                               gpointer      user_data)
+{
+  guint pos_a = *((const guint *) a), pos_b = *((const guint *) b);
+
+  return (pos_a > pos_b) - (pos_a < pos_b);
+}
+
+static void
+_pick_index_build_boxes (PickIndex *index,
+                         guint      first,
+                         guint      n_entries)
+{
+  PickIndexBox box = { G_MAXDOUBLE, G_MAXDOUBLE, -G_MAXDOUBLE, -G_MAXDOUBLE };
+  PickIndexEntry *entries;
+  guint i, box_index;
+  MechAxis axis;
+
+  entries = &g_array_index (index->entries, PickIndexEntry, first);
+
+  for (i = 0; i < n_entries; i++)
+    {
+      box.x1 = MIN (box.x1, entries[i].x1);
+      box.y1 = MIN (box.y1, entries[i].y1);
+      box.x2 = MAX (box.x2, entries[i].x2);
+      box.y2 = MAX (box.y2, entries[i].y2);
+    }
+
+  box.first = first;
+  box_index = index->boxes->len;
+  g_array_append_val (index->boxes, box);
+
+  if (n_entries <= PICK_INDEX_LEAF_SIZE)
+    {
+      g_array_index (index->boxes, PickIndexBox, box_index).n_entries = n_entries;
+      g_array_index (index->boxes, PickIndexBox, box_index).skip = box_index + 1;
+      return;
+    }
+
+  /* Split along the longest axis, children go right after the box */
+  axis = (box.x2 - box.x1 >= box.y2 - box.y1) ? MECH_AXIS_X : MECH_AXIS_Y;
+  g_qsort_with_data (entries, n_entries, sizeof (PickIndexEntry),
+                     _pick_index_compare_entries, GINT_TO_POINTER (axis));
+
+  _pick_index_build_boxes (index, first, n_entries / 2);
+  _pick_index_build_boxes (index, first + (n_entries / 2),
+                           n_entries - (n_entries / 2));
+
+  g_array_index (index->boxes, PickIndexBox, box_index).skip = index->boxes->len;
+}
+
+static PickIndex *
+_pick_index_new (GNode *parent)
+{
+  cairo_rectangle_t parent_rect, rect;
+  PickIndexEntry entry;
+  PickIndex *index;
+  GNode *child;
+  guint pos = 0;
+
+  index = g_slice_new0 (PickIndex);
+  index->children = g_ptr_array_new ();
+  index->entries = g_array_new (FALSE, FALSE, sizeof (PickIndexEntry));
+  index->boxes = g_array_new (FALSE, FALSE, sizeof (PickIndexBox));
+  index->unindexed = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  _mech_area_get_stage_rect (parent->data, &parent_rect);
+
+  for (child = parent->children; child; child = child->next, pos++)
+    {
+      g_ptr_array_add (index->children, child);
+
+      /* The stage rect doesn't tell the picked shape of these */
+      if (mech_area_get_matrix (child->data, NULL) ||
+          _mech_area_has_custom_shape (child->data))
+        {
+          g_array_append_val (index->unindexed, pos);
+          continue;
+        }
+
+      _mech_area_get_stage_rect (child->data, &rect);
+      entry.x1 = rect.x - parent_rect.x;
+      entry.y1 = rect.y - parent_rect.y;
+      entry.x2 = entry.x1 + rect.width;
+      entry.y2 = entry.y1 + rect.height;
+      entry.position = pos;
+      g_array_append_val (index->entries, entry);
+    }
+
+  if (index->entries->len > 0)
+    _pick_index_build_boxes (index, 0, index->entries->len);
+
+  return index;
+}
+
+static void
+_pick_index_free (PickIndex *index)
+{
+  g_ptr_array_unref (index->children);
+  g_array_unref (index->entries);
+  g_array_unref (index->boxes);
+  g_array_unref (index->unindexed);
+  g_slice_free (PickIndex, index);
+}
+
+/* Appends to candidates the positions of all children that may
+ * contain the given point, in parent coordinates. Bounds are
+ * checked loosely, the exact test happens when visiting.
+ */
+static void
+_pick_index_query (PickIndex *index,
+                   gdouble    x,
+                   gdouble    y,
+                   GArray    *candidates)
+{
+  guint i = 0, j;
+
+  g_array_append_vals (candidates, index->unindexed->data,
+                       index->unindexed->len);
+
+  while (i < index->boxes->len)
+    {
+      PickIndexBox *box;
+
+      box = &g_array_index (index->boxes, PickIndexBox, i);
+
+      if (x < box->x1 - 1 || x >= box->x2 + 1 ||
+          y < box->y1 - 1 || y >= box->y2 + 1)
+        {
+          i = box->skip;
+          continue;
+        }
+
+      for (j = box->first; j < box->first + box->n_entries; j++)
+        {
+          PickIndexEntry *entry;
+
+          entry = &g_array_index (index->entries, PickIndexEntry, j);
+
+          if (x >= entry->x1 - 1 && x < entry->x2 + 1 &&
+              y >= entry->y1 - 1 && y < entry->y2 + 1)
+            g_array_append_val (candidates, entry->position);
+        }
+
+      i++;
+    }
+}
+
+static PickIndex *
+_stage_node_ensure_pick_index (StageNode *node)
+{
+  if (!node->pick_index_dirty)
+    return node->pick_index;
+
+  if (node->pick_index)
+    {
+      _pick_index_free (node->pick_index);
+      node->pick_index = NULL;
+    }
+
+  if (g_node_n_children ((GNode *) node) >= PICK_INDEX_MIN_CHILDREN)
+    node->pick_index = _pick_index_new ((GNode *) node);
+
+  node->pick_index_dirty = FALSE;
+
+  return node->pick_index;
+}
+
+static void pick_stage_visit (MechStage        *stage,
+                              PickStageContext *context,
+                              GNode            *node,
+                              gdouble           x,
+                              gdouble           y);
+
+static void
+pick_stage_visit_child (MechStage               *stage,
+                        PickStageContext        *context,
+                        GNode                   *child,
+                        const cairo_rectangle_t *parent_rect,
+                        gdouble                  x,
+                        gdouble                  y)
+{
+  MechArea *area = child->data;
+  cairo_rectangle_t rect;
+  cairo_matrix_t matrix;
+
+  if (!mech_area_get_visible (area))
+    return;
+
+  /* Turn parent coordinates into child ones, this is
+   * the inverse of the transformation applied on rendering.
+   */
+  _mech_area_get_stage_rect (area, &rect);
+  x -= rect.x - parent_rect->x;
+  y -= rect.y - parent_rect->y;
+
+  if (mech_area_get_matrix (area, &matrix))
+    {
+      if (cairo_matrix_invert (&matrix) != CAIRO_STATUS_SUCCESS)
+        return;
+
+      cairo_matrix_transform_point (&matrix, &x, &y);
+    }
+
+  pick_stage_visit (stage, context, child, x, y);
+}
+
+static void
+pick_stage_visit_children (MechStage        *stage,
+                           PickStageContext *context,
+                           GNode            *node,
+                           gdouble           x,
+                           gdouble           y)
 {
-  cairo_region_t *region;
+  cairo_rectangle_t parent_rect;
   MechStagePrivate *priv;
-  MechArea *root, *area;
-  gboolean inside;
-  gdouble x, y;
+  PickIndex *index;
+  GNode *child;
+
+  if (!node->children)
+    return;
 
   priv = mech_stage_get_instance_private (stage);
-  area = node->data;
-  root = context->root;
-  x = context->x;
-  y = context->y;
+  _mech_area_get_stage_rect (node->data, &parent_rect);
+  index = _stage_node_ensure_pick_index ((StageNode *) node);
 
-  if (!root)
-    root = priv->areas->node.data;
+  if (index)
+    {
+      GArray *candidates = priv->pick_candidates;
+      guint i, start, end;
+
+      /* Candidates for this node are pushed on top of the
+       * shared stack, deeper levels push and pop theirs above.
+       */
+      start = candidates->len;
+      _pick_index_query (index, x, y, candidates);
+      end = candidates->len;
+
+      g_qsort_with_data (&g_array_index (candidates, guint, start),
+                         end - start, sizeof (guint),
+                         _pick_index_compare_positions, NULL);
+
+      for (i = start; i < end; i++)
+        {
+          child = g_ptr_array_index (index->children,
+                                     g_array_index (candidates, guint, i));
+          pick_stage_visit_child (stage, context, child, &parent_rect, x, y);
+        }
+
+      g_array_set_size (candidates, start);
+    }
+  else
+    {
+      for (child = node->children; child; child = child->next)
+        pick_stage_visit_child (stage, context, child, &parent_rect, x, y);
+    }
+}
 
-  mech_area_transform_point (root, area, &x, &y);
-  region = mech_area_get_shape (area);
-  inside = cairo_region_contains_point (region, (int) x, (int) y);
-  cairo_region_destroy (region);
+static void
+pick_stage_visit (MechStage        *stage,
+                  PickStageContext *context,
+                  GNode            *node,
+                  gdouble           x,
+                  gdouble           y)
+{
+  MechArea *area = node->data;
 
-  if (!inside)
-    return TRAVERSE_FLAG_CONTINUE;
+  if (!_mech_area_contains_point (area, x, y))
+    return;
 
   if (context->event_type == 0 ||
       mech_area_handles_event (area, context->event_type))
     g_ptr_array_add (context->areas, g_object_ref (area));
 
-  return TRAVERSE_FLAG_CONTINUE | TRAVERSE_FLAG_RECURSE;
+  pick_stage_visit_children (stage, context, node, x, y);
 }
 
 static void
@@ -683,9 +1235,6 @@ pick_stage_context_init (PickStageContext *context,
                          gint              x,
                          gint              y)
 {
-  context->functions.enter = NULL;
-  context->functions.leave = NULL;
-  context->functions.visit = (VisitNodeFunc) pick_stage_visit;
   context->areas = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
   context->root = root;
   context->event_type = event_type;
@@ -726,6 +1275,8 @@ mech_stage_finalize (GObject *object)
       _offscreen_node_destroy (priv->offscreens);
     }
 
+  g_array_unref (priv->pick_candidates);
+
   G_OBJECT_CLASS (mech_stage_parent_class)->finalize (object);
 }
 
@@ -737,11 +1288,16 @@ mech_stage_class_init (MechStageClass *klass)
   object_class->finalize = mech_stage_finalize;
 
   quark_area_offscreen = g_quark_from_static_string ("mech-stage-offscreen");
+  quark_area_recording = g_quark_from_static_string ("mech-stage-recording");
 }
 
 static void
 mech_stage_init (MechStage *stage)
 {
+  MechStagePrivate *priv = mech_stage_get_instance_private (stage);
+
+  priv->pick_candidates = g_array_new (FALSE, FALSE, sizeof (guint));
+  priv->offscreen_budget = DEFAULT_OFFSCREEN_BUDGET;
 }
 
 MechStage *
@@ -894,6 +1450,7 @@ _mech_stage_node_new (MechArea *area)
 
   node = g_slice_new0 (StageNode);
   node->z_cache = g_array_new (FALSE, TRUE, sizeof (ZCacheNode));
+  node->pick_index_dirty = TRUE;
   node->node.data = area;
 
   return (GNode *) node;
@@ -905,9 +1462,20 @@ _mech_stage_node_free (GNode *node)
   StageNode *stage_node = (StageNode *) node;
 
   g_array_free (stage_node->z_cache, TRUE);
+
+  if (stage_node->pick_index)
+    _pick_index_free (stage_node->pick_index);
+
   g_slice_free (StageNode, stage_node);
 }
 
+void
+_mech_stage_node_queue_reindex (GNode *node)
+{
+  if (node->parent)
+    ((StageNode *) node->parent)->pick_index_dirty = TRUE;
+}
+
 gboolean
 _mech_stage_add (GNode *parent_node,
                  GNode *child_node)
@@ -962,6 +1530,7 @@ _mech_stage_remove (GNode *child_node)
         break;
     }
 
+  parent->pick_index_dirty = TRUE;
   g_node_unlink (child_node);
   g_object_unref (child_node->data);
 
@@ -998,12 +1567,16 @@ _mech_stage_set_size (MechStage *stage,
 {
   MechStagePrivate *priv;
   cairo_rectangle_t rect;
+  gint64 start_time;
 
   priv = mech_stage_get_instance_private (stage);
   rect.x = rect.y = 0;
   rect.width = *width;
   rect.height = *height;
+
+  start_time = g_get_monotonic_time ();
   mech_area_allocate_size (priv->areas->node.data, &rect);
+  priv->stats.layout_time += g_get_monotonic_time () - start_time;
 
   priv->width = MAX (1, rect.width);
   priv->height = MAX (1, rect.height);
@@ -1019,15 +1592,137 @@ _mech_stage_set_size (MechStage *stage,
   return TRUE;
 }
 
+static gboolean
+_stage_collect_offscreen_usage (GNode    *node,
+                                gpointer  user_data)
+{
+  OffscreenUsageData *data = user_data;
+  OffscreenNode *offscreen = (OffscreenNode *) node;
+
+  if (!node->data ||
+      _mech_surface_get_surface_type (node->data) != MECH_SURFACE_TYPE_OFFSCREEN)
+    return FALSE;
+
+  data->usage += _mech_surface_get_memory_size (node->data);
+
+  if (data->candidates && offscreen->last_used < data->frame)
+    g_ptr_array_add (data->candidates, offscreen);
+
+  return FALSE;
+}
+
+static gint
+_compare_offscreen_last_used (gconstpointer a,
+                              gconstpointer b)
+{
+  const OffscreenNode *offscreen_a = *((OffscreenNode **) a);
+  const OffscreenNode *offscreen_b = *((OffscreenNode **) b);
+
+  return (offscreen_a->last_used > offscreen_b->last_used) -
+    (offscreen_a->last_used < offscreen_b->last_used);
+}
+
+static void
+_mech_stage_enforce_offscreen_budget (MechStage *stage)
+{
+  OffscreenUsageData data = { 0 };
+  OffscreenNode *offscreen;
+  MechStagePrivate *priv;
+  guint i;
+
+  priv = mech_stage_get_instance_private (stage);
+
+  if (priv->offscreen_budget == 0)
+    return;
+
+  data.frame = priv->frame_count;
+  data.candidates = g_ptr_array_new ();
+  g_node_traverse ((GNode *) priv->offscreens, G_PRE_ORDER,
+                   G_TRAVERSE_ALL, -1, _stage_collect_offscreen_usage,
+                   &data);
+
+  if (data.usage > priv->offscreen_budget)
+    {
+      /* Drop the least recently rendered offscreens, those
+       * get recreated and fully redrawn when needed again.
+       */
+      g_ptr_array_sort (data.candidates, _compare_offscreen_last_used);
+
+      for (i = 0; i < data.candidates->len; i++)
+        {
+          if (data.usage <= priv->offscreen_budget)
+            break;
+
+          offscreen = g_ptr_array_index (data.candidates, i);
+
+          /* Surfaces of nested candidates may have been unset
+           * already by dropping an ancestor, those were accounted
+           * for then.
+           */
+          if (!offscreen->node.data)
+            continue;
+
+          data.usage -= _mech_surface_get_memory_size (offscreen->node.data);
+          data.usage -=
+            _surface_check_children (offscreen,
+                                     (OffscreenNode *) offscreen->node.parent);
+          _mech_stage_destroy_offscreen_node (offscreen, FALSE);
+        }
+    }
+
+  g_ptr_array_unref (data.candidates);
+}
+
 void
 _mech_stage_render (MechStage *stage,
                     cairo_t   *cr)
 {
   RenderStageContext context;
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+  priv->frame_count++;
 
   render_stage_context_init (&context, stage, cr);
   _mech_stage_traverse (stage, &context.functions, NULL, FALSE);
   render_stage_context_finish (&context);
+
+  priv->stats.offscreen_time += context.stats.offscreen_time;
+  priv->stats.push_time += context.stats.push_time;
+  priv->stats.n_areas_visited += context.stats.n_areas_visited;
+  priv->stats.n_areas_culled += context.stats.n_areas_culled;
+  priv->stats.n_offscreens += context.stats.n_offscreens;
+  priv->stats.damaged_pixels += context.stats.damaged_pixels;
+
+  _mech_stage_enforce_offscreen_budget (stage);
+}
+
+void
+_mech_stage_take_stats (MechStage      *stage,
+                        MechFrameStats *stats)
+{
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+  stats->layout_time = priv->stats.layout_time;
+  stats->offscreen_time = priv->stats.offscreen_time;
+  stats->push_time = priv->stats.push_time;
+  stats->n_areas_visited = priv->stats.n_areas_visited;
+  stats->n_areas_culled = priv->stats.n_areas_culled;
+  stats->n_offscreens = priv->stats.n_offscreens;
+  stats->damaged_pixels = priv->stats.damaged_pixels;
+
+  memset (&priv->stats, 0, sizeof (MechFrameStats));
+}
+
+void
+_mech_stage_set_trace (MechStage *stage,
+                       gboolean   trace)
+{
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+  priv->trace = (trace == TRUE);
 }
 
 GPtrArray *
@@ -1038,8 +1733,15 @@ _mech_stage_pick_for_event (MechStage     *stage,
                             gdouble        y)
 {
   PickStageContext context;
-  GNode *node = NULL;
+  MechStagePrivate *priv;
+  GNode *node, *cur;
   GPtrArray *areas;
+  MechArea *root;
+
+  priv = mech_stage_get_instance_private (stage);
+
+  if (!priv->areas)
+    return NULL;
 
   if (area)
     {
@@ -1047,10 +1749,28 @@ _mech_stage_pick_for_event (MechStage     *stage,
         return NULL;
 
       node = _mech_area_get_node (area);
+      root = area;
+    }
+  else
+    {
+      node = (GNode *) priv->areas;
+      root = priv->areas->node.data;
     }
 
   pick_stage_context_init (&context, area, event_type, x, y);
-  _mech_stage_traverse (stage, &context.functions, node, FALSE);
+
+  for (cur = node; cur; cur = cur->next)
+    {
+      gdouble cur_x, cur_y;
+
+      if (!mech_area_get_visible (cur->data))
+        continue;
+
+      cur_x = context.x;
+      cur_y = context.y;
+      mech_area_transform_point (root, cur->data, &cur_x, &cur_y);
+      pick_stage_visit (stage, &context, cur, cur_x, cur_y);
+    }
 
   if (context.areas && context.areas->len > 0)
     areas = g_ptr_array_ref (context.areas);
@@ -1167,6 +1887,49 @@ _stage_clamp_to_area (OffscreenNode     *offscreen,
   *rect = clamped;
 }
 
+static void
+_mech_stage_invalidate_rect (MechStage         *stage,
+                             MechArea          *area,
+                             cairo_rectangle_t *rect,
+                             gboolean           start_from_parent)
+{
+  OffscreenNode *offscreen;
+  MechArea *current, *clip_area;
+  cairo_rectangle_t damage;
+  MechPoint points[4];
+
+  damage = *rect;
+  RECT_TO_POINTS (damage, points);
+
+  offscreen = _mech_stage_find_container_offscreen (stage, area);
+  current = area;
+
+  while (offscreen)
+    {
+      mech_area_transform_points (current, offscreen->area,
+                                  (MechPoint *) &points, 4);
+
+      damage.x = MIN4 (points[0].x, points[1].x, points[2].x, points[3].x);
+      damage.y = MIN4 (points[0].y, points[1].y, points[2].y, points[3].y);
+      damage.width = MAX4 (points[0].x, points[1].x, points[2].x, points[3].x) - damage.x;
+      damage.height = MAX4 (points[0].y, points[1].y, points[2].y, points[3].y) - damage.y;
+
+      if (_stage_area_clipped_on_offscreen (current, offscreen, &clip_area))
+        _stage_clamp_to_area (offscreen, clip_area, &damage);
+
+      if (damage.width <= 0 || damage.height <= 0)
+        return;
+
+      if (offscreen->node.data &&
+          (!start_from_parent || offscreen->area != area))
+        _mech_surface_damage (offscreen->node.data, &damage);
+
+      RECT_TO_POINTS (damage, points);
+      current = offscreen->area;
+      offscreen = (OffscreenNode *) offscreen->node.parent;
+    }
+}
+
 void
 _mech_stage_invalidate (MechStage      *stage,
                         MechArea       *area,
@@ -1174,10 +1937,8 @@ _mech_stage_invalidate (MechStage      *stage,
                         gboolean        start_from_parent)
 {
   MechStagePrivate *priv = mech_stage_get_instance_private (stage);
-  OffscreenNode *offscreen = NULL, *prev = NULL;
-  MechArea *current, *clip_area;
   cairo_rectangle_t rect;
-  MechPoint points[4];
+  gint i, n_rects;
 
   if (!priv->offscreens)
     return;
@@ -1186,45 +1947,28 @@ _mech_stage_invalidate (MechStage      *stage,
     area = priv->areas->node.data;
 
   if (!region)
-    _mech_stage_get_renderable_rect (stage, area, &rect);
-  else if (!cairo_region_is_empty (region))
+    {
+      _mech_stage_get_renderable_rect (stage, area, &rect);
+      _mech_stage_invalidate_rect (stage, area, &rect, start_from_parent);
+      return;
+    }
+
+  /* Damage each rectangle separately, so disjoint
+   * damage doesn't get merged into its bounding box.
+   */
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
     {
       cairo_rectangle_int_t int_rect;
 
-      cairo_region_get_extents (region, &int_rect);
+      cairo_region_get_rectangle (region, i, &int_rect);
       rect.x = int_rect.x;
       rect.y = int_rect.y;
       rect.width = int_rect.width;
       rect.height = int_rect.height;
-    }
-  else
-    return;
-
-  RECT_TO_POINTS (rect, points);
-
-  offscreen = _mech_stage_find_container_offscreen (stage, area);
-  current = area;
-
-  while (offscreen)
-    {
-      mech_area_transform_points (current, offscreen->area,
-                                  (MechPoint *) &points, 4);
-
-      rect.x = MIN4 (points[0].x, points[1].x, points[2].x, points[3].x);
-      rect.y = MIN4 (points[0].y, points[1].y, points[2].y, points[3].y);
-      rect.width = MAX4 (points[0].x, points[1].x, points[2].x, points[3].x) - rect.x;
-      rect.height = MAX4 (points[0].y, points[1].y, points[2].y, points[3].y) - rect.y;
-
-      if (_stage_area_clipped_on_offscreen (current, offscreen, &clip_area))
-        _stage_clamp_to_area (offscreen, clip_area, &rect);
 
-      if (!start_from_parent || offscreen->area != area)
-        _mech_surface_damage (offscreen->node.data, &rect);
-
-      RECT_TO_POINTS (rect, points);
-      prev = offscreen;
-      current = offscreen->area;
-      offscreen = (OffscreenNode *) offscreen->node.parent;
+      _mech_stage_invalidate_rect (stage, area, &rect, start_from_parent);
     }
 }
 
@@ -1324,3 +2068,39 @@ _mech_stage_get_rendering_surface (MechStage *stage,
 
   return (offscreen) ? offscreen->node.data : NULL;
 }
+
+void
+_mech_stage_set_offscreen_budget (MechStage *stage,
+                                  gsize      budget)
+{
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+  priv->offscreen_budget = budget;
+}
+
+gsize
+_mech_stage_get_offscreen_budget (MechStage *stage)
+{
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+  return priv->offscreen_budget;
+}
+
+gsize
+_mech_stage_get_offscreen_memory (MechStage *stage)
+{
+  OffscreenUsageData data = { 0 };
+  MechStagePrivate *priv;
+
+  priv = mech_stage_get_instance_private (stage);
+
+  if (!priv->offscreens)
+    return 0;
+
+  g_node_traverse ((GNode *) priv->offscreens, G_PRE_ORDER,
+                   G_TRAVERSE_ALL, -1, _stage_collect_offscreen_usage,
+                   &data);
+  return data.usage;
+}
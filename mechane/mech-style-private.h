@@ -58,6 +58,8 @@ MechStyleProperty
                _mech_style_property_info_get_id            (const MechPropertyInfo   *info);
 
 
+MechStyle    * _mech_style_copy         (MechStyle      *style);
+
 /* Style setters */
 void           _mech_style_push_path    (MechStyle      *style,
                                          const gchar    *element,
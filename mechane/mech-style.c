@@ -28,12 +28,20 @@
 typedef struct _MechStylePrivate MechStylePrivate;
 typedef struct _StyleIterator StyleIterator;
 typedef struct _StyleProperty StyleProperty;
+typedef struct _StyleValue StyleValue;
 typedef struct _StylePropertySet StylePropertySet;
 typedef struct _StyleTreeNode StyleTreeNode;
+typedef struct _StyleTree StyleTree;
+typedef struct _StyleAreaMemo StyleAreaMemo;
+typedef struct _StyleMemoEntry StyleMemoEntry;
 typedef struct _PathContext PathContext;
 
+#define N_MEMO_ENTRIES 4
+
 static GArray *registered_properties = NULL;
 static GHashTable *toplevel_properties = NULL;
+static GQuark quark_area_memo = 0;
+static guint tree_serial = 0;
 
 struct _MechPropertyInfo
 {
@@ -58,18 +66,27 @@ struct _MechPropertyInfo
   guint is_layered : 1;
 };
 
+/* Values are immutable once parsed, and shared
+ * by every property set they get merged into.
+ */
+struct _StyleValue
+{
+  GValue value;
+  gint ref_count;
+};
+
 struct _StyleProperty
 {
   guint32 property;
   gint16 layer;
   guint16 flags;
-  GValue value;
+  StyleValue *value;
 };
 
 struct _StylePropertySet
 {
   GArray *properties;
-  guint16 resolved : 1;
+  gint ref_count;
 };
 
 struct _StyleIterator
@@ -90,18 +107,51 @@ struct _StyleTreeNode
   StyleTreeNode *parent;
   GArray *children;
   StylePropertySet *properties;
+  StylePropertySet *resolved;
   GQuark element;
   guint state_flags;
+
+  /* Shared renderers, indexed by child match */
+  MechRenderer *renderers[2];
+};
+
+/* Compiled style data, shared between styles
+ * until one of them is modified.
+ */
+struct _StyleTree
+{
+  StyleTreeNode *root;
+  GHashTable *font_contexts;
+  guint serial;
+  gint ref_count;
+};
+
+struct _StyleMemoEntry
+{
+  StyleTreeNode *node;
+  guint state;
+  guint child_match : 1;
+};
+
+/* Per area memo of matched style nodes, valid as long
+ * as the tree serial and the area name path are unchanged.
+ */
+struct _StyleAreaMemo
+{
+  guint serial;
+  GArray *path;
+  StyleMemoEntry entries[N_MEMO_ENTRIES];
+  guint n_entries;
 };
 
 struct _MechStylePrivate
 {
   GArray *path_context;
-  StyleTreeNode *style_tree;
+  StyleTree *tree;
 };
 
-static void _style_tree_node_free    (StyleTreeNode    *node);
-static void _style_property_set_free (StylePropertySet *set);
+static void _style_tree_unref        (StyleTree        *tree);
+static void _style_property_set_unref (StylePropertySet *set);
 
 G_DEFINE_TYPE_WITH_PRIVATE (MechStyle, mech_style, G_TYPE_OBJECT)
 
@@ -390,14 +440,14 @@ mech_style_finalize (GObject *object)
   guint i;
 
   priv = mech_style_get_instance_private ((MechStyle *) object);
-  _style_tree_node_free (priv->style_tree);
+  _style_tree_unref (priv->tree);
 
   for (i = 0; i < priv->path_context->len; i++)
     {
       PathContext *context;
 
       context = &g_array_index (priv->path_context, PathContext, i);
-      _style_property_set_free (context->properties);
+      _style_property_set_unref (context->properties);
     }
 
   g_array_unref (priv->path_context);
@@ -412,35 +462,115 @@ mech_style_class_init (MechStyleClass *klass)
 
   object_class->finalize = mech_style_finalize;
 
+  quark_area_memo = g_quark_from_static_string ("MECH_QUARK_STYLE_MEMO");
   mech_style_info_init ();
 }
 
+static StyleValue *
+_style_value_new (const GValue *value)
+{
+  StyleValue *style_value;
+
+  style_value = g_slice_new0 (StyleValue);
+  style_value->ref_count = 1;
+  g_value_init (&style_value->value, G_VALUE_TYPE (value));
+  g_value_copy (value, &style_value->value);
+
+  return style_value;
+}
+
+static StyleValue *
+_style_value_ref (StyleValue *value)
+{
+  g_atomic_int_inc (&value->ref_count);
+  return value;
+}
+
+static void
+_style_value_unref (StyleValue *value)
+{
+  if (!g_atomic_int_dec_and_test (&value->ref_count))
+    return;
+
+  g_value_unset (&value->value);
+  g_slice_free (StyleValue, value);
+}
+
 static StylePropertySet *
-_style_property_set_new (void)
+_style_property_set_new_sized (guint reserved_size)
 {
   StylePropertySet *set;
 
-  set = g_new0 (StylePropertySet, 1);
-  set->properties = g_array_new (FALSE, FALSE, sizeof (StyleProperty));
+  set = g_slice_new0 (StylePropertySet);
+  set->ref_count = 1;
+  set->properties = g_array_sized_new (FALSE, FALSE, sizeof (StyleProperty),
+                                       reserved_size);
+  return set;
+}
 
+static StylePropertySet *
+_style_property_set_new (void)
+{
+  return _style_property_set_new_sized (0);
+}
+
+static StylePropertySet *
+_style_property_set_ref (StylePropertySet *set)
+{
+  g_atomic_int_inc (&set->ref_count);
   return set;
 }
 
 static void
-_style_property_set_free (StylePropertySet *set)
+_style_property_set_unref (StylePropertySet *set)
 {
   guint i;
 
+  if (!g_atomic_int_dec_and_test (&set->ref_count))
+    return;
+
   for (i = 0; i < set->properties->len; i++)
     {
       StyleProperty *property;
 
       property = &g_array_index (set->properties, StyleProperty, i);
-      g_value_unset (&property->value);
+      _style_value_unref (property->value);
     }
 
   g_array_free (set->properties, TRUE);
-  g_free (set);
+  g_slice_free (StylePropertySet, set);
+}
+
+static void
+_style_property_set_append (StylePropertySet *set,
+                            StyleProperty    *property,
+                            guint             flags)
+{
+  StyleProperty copy;
+
+  copy.property = property->property;
+  copy.layer = property->layer;
+  copy.flags = flags;
+  copy.value = _style_value_ref (property->value);
+  g_array_append_val (set->properties, copy);
+}
+
+static StylePropertySet *
+_style_property_set_copy (StylePropertySet *set)
+{
+  StylePropertySet *copy;
+  StyleProperty *property;
+  guint i;
+
+  copy = _style_property_set_new_sized (set->properties->len);
+
+  for (i = 0; i < set->properties->len; i++)
+    {
+      property = &g_array_index (set->properties, StyleProperty, i);
+      _style_property_set_append (copy, property, property->flags);
+    }
+
+  return copy;
 }
 
 static gint
@@ -577,8 +707,7 @@ _style_iterator_add (StyleIterator *iter,
   new_property.property = property;
   new_property.layer = layer;
   new_property.flags = flags;
-  g_value_init (&new_property.value, G_VALUE_TYPE (value));
-  g_value_copy (value, &new_property.value);
+  new_property.value = _style_value_new (value);
 
   if (_style_iterator_finished (iter))
     g_array_append_val (iter->set->properties, new_property);
@@ -590,7 +719,7 @@ _style_iterator_add (StyleIterator *iter,
       if (prev->flags == flags &&
           _style_property_compare (prev, property, layer) == 0)
         {
-          g_value_unset (&prev->value);
+          _style_value_unref (prev->value);
           *prev = new_property;
         }
       else
@@ -614,7 +743,10 @@ _style_iterator_add (StyleIterator *iter,
           flags &= ~(coinciding);
 
           if (prop->flags == 0)
-            g_array_remove_index (iter->set->properties, i);
+            {
+              _style_value_unref (prop->value);
+              g_array_remove_index (iter->set->properties, i);
+            }
           else
             i++;
 
@@ -626,62 +758,80 @@ _style_iterator_add (StyleIterator *iter,
   _style_iterator_next (iter);
 }
 
-static void
-_style_property_set_combine (StylePropertySet       *set,
-                             const StylePropertySet *source)
+/* Merges both sorted sets into a new one, values in @set
+ * take precedence over those in @source for the flags
+ * they are set for.
+ */
+static StylePropertySet *
+_style_property_set_merge (const StylePropertySet *set,
+                           const StylePropertySet *source)
 {
-  StyleIterator source_iter = { (StylePropertySet *) source, 0 };
-  StyleIterator iter = { set, 0 };
-  guint flags_set, flags, property;
-  StyleProperty *prop;
-  gboolean found;
-  gint layer;
+  StyleProperty *props, *source_props;
+  guint i = 0, j = 0, len, source_len;
+  guint32 property, flags_set, flags;
+  StylePropertySet *merged;
+  gint16 layer;
+  gint diff;
+
+  props = (StyleProperty *) set->properties->data;
+  source_props = (StyleProperty *) source->properties->data;
+  len = set->properties->len;
+  source_len = source->properties->len;
+  merged = _style_property_set_new_sized (len + source_len);
 
-  while (!_style_iterator_finished (&source_iter))
+  while (i < len || j < source_len)
     {
-      _style_iterator_current_group (&source_iter, &property, &layer, NULL);
-      found = FALSE;
-      flags_set = 0;
+      if (j == source_len)
+        diff = 1;
+      else if (i == len)
+        diff = -1;
+      else
+        diff = _style_property_compare (&props[i], source_props[j].property,
+                                        source_props[j].layer);
 
-      if (_style_iterator_forward_position (&iter, property, layer))
+      if (diff > 0)
+        {
+          _style_property_set_append (merged, &props[i], props[i].flags);
+          i++;
+        }
+      else if (diff < 0)
         {
-          /* Go to the last position for this
-           * property/layer and accumulate flags
+          _style_property_set_append (merged, &source_props[j],
+                                      source_props[j].flags);
+          j++;
+        }
+      else
+        {
+          /* Keep the whole group from @set, and add the source
+           * values for the flags that are still unset.
            */
-          while (!_style_iterator_finished (&iter) &&
-                 _style_iterator_check_group (&iter, property, layer))
+          property = props[i].property;
+          layer = props[i].layer;
+          flags_set = 0;
+
+          while (i < len &&
+                 props[i].property == property && props[i].layer == layer)
             {
-              prop = _style_iterator_current (&iter);
-              _style_iterator_next (&iter);
-              flags_set |= prop->flags;
-              found = TRUE;
+              _style_property_set_append (merged, &props[i], props[i].flags);
+              flags_set |= props[i].flags;
+              i++;
             }
-        }
 
-      /* Run through the source values for this group and add them,
-       * taking care of unsetting the flags that are already set
-       * in the destination.
-       */
-      while (!_style_iterator_finished (&source_iter) &&
-             _style_iterator_check_group (&source_iter, property, layer))
-        {
-          prop = _style_iterator_current (&source_iter);
-          _style_iterator_next (&source_iter);
-
-          if (found)
+          while (j < source_len &&
+                 source_props[j].property == property &&
+                 source_props[j].layer == layer)
             {
-              flags = prop->flags & ~(flags_set);
+              flags = source_props[j].flags & ~(flags_set);
 
-              if (flags == 0)
-                continue;
-            }
-          else
-            flags = prop->flags;
+              if (flags != 0)
+                _style_property_set_append (merged, &source_props[j], flags);
 
-          _style_iterator_add (&iter, prop->property, prop->layer,
-                               flags, &prop->value);
+              j++;
+            }
         }
     }
+
+  return merged;
 }
 
 static gboolean
@@ -696,7 +846,7 @@ _style_iterator_unpack (StyleIterator *iter,
     return FALSE;
 
   if (value)
-    *value = prop->value;
+    *value = prop->value->value;
 
   _style_iterator_next (iter);
   return TRUE;
@@ -731,7 +881,7 @@ _style_iterator_unpack_values (StyleIterator  *iter,
       for (val = 0; val < n_values; val++)
         {
           if (flags & 1)
-            values_out[val] = &prop->value;
+            values_out[val] = &prop->value->value;
 
           flags >>= 1;
 
@@ -792,7 +942,10 @@ _style_tree_node_free (StyleTreeNode *node)
 {
   guint i;
 
-  _style_property_set_free (node->properties);
+  _style_property_set_unref (node->properties);
+  g_clear_pointer (&node->resolved, _style_property_set_unref);
+  g_clear_object (&node->renderers[0]);
+  g_clear_object (&node->renderers[1]);
 
   for (i = 0; i < node->children->len; i++)
     _style_tree_node_free (g_array_index (node->children,
@@ -802,41 +955,156 @@ _style_tree_node_free (StyleTreeNode *node)
   g_free (node);
 }
 
+static void
+_style_tree_node_invalidate (StyleTreeNode *node)
+{
+  guint i;
+
+  g_clear_pointer (&node->resolved, _style_property_set_unref);
+  g_clear_object (&node->renderers[0]);
+  g_clear_object (&node->renderers[1]);
+
+  for (i = 0; i < node->children->len; i++)
+    _style_tree_node_invalidate (g_array_index (node->children,
+                                                StyleTreeNode *, i));
+}
+
+static StyleTreeNode *
+_style_tree_node_copy (StyleTreeNode *node,
+                       StyleTreeNode *parent)
+{
+  StyleTreeNode *copy, *child;
+  guint i;
+
+  copy = g_new0 (StyleTreeNode, 1);
+  copy->parent = parent;
+  copy->element = node->element;
+  copy->state_flags = node->state_flags;
+  copy->properties = _style_property_set_ref (node->properties);
+  copy->children = g_array_sized_new (FALSE, FALSE, sizeof (StyleTreeNode*),
+                                      node->children->len);
+
+  for (i = 0; i < node->children->len; i++)
+    {
+      child = _style_tree_node_copy (g_array_index (node->children,
+                                                    StyleTreeNode *, i),
+                                     copy);
+      g_array_append_val (copy->children, child);
+    }
+
+  return copy;
+}
+
+static StyleTree *
+_style_tree_new (StyleTreeNode *root)
+{
+  StyleTree *tree;
+
+  tree = g_slice_new0 (StyleTree);
+  tree->ref_count = 1;
+  tree->serial = ++tree_serial;
+  tree->root = root;
+  tree->font_contexts =
+    g_hash_table_new_full ((GHashFunc) pango_font_description_hash,
+                           (GEqualFunc) pango_font_description_equal,
+                           (GDestroyNotify) pango_font_description_free,
+                           (GDestroyNotify) g_object_unref);
+  return tree;
+}
+
+static StyleTree *
+_style_tree_ref (StyleTree *tree)
+{
+  g_atomic_int_inc (&tree->ref_count);
+  return tree;
+}
+
+static void
+_style_tree_unref (StyleTree *tree)
+{
+  if (!g_atomic_int_dec_and_test (&tree->ref_count))
+    return;
+
+  _style_tree_node_free (tree->root);
+  g_hash_table_destroy (tree->font_contexts);
+  g_slice_free (StyleTree, tree);
+}
+
+static void
+_style_tree_changed (StyleTree *tree)
+{
+  tree->serial = ++tree_serial;
+  _style_tree_node_invalidate (tree->root);
+}
+
 static gint
 _style_tree_node_compare (StyleTreeNode *node1,
                           GQuark         quark,
                           guint          state)
 {
+  /* Children are sorted by element, then state flags */
   if (node1->element < quark)
     return -1;
   else if (node1->element > quark)
     return 1;
+  else if (node1->state_flags < state)
+    return -1;
+  else if (node1->state_flags > state)
+    return 1;
   else
     return 0;
 }
 
-static void
-_style_tree_node_ensure_resolved (StyleTreeNode *node)
+/* Returns the position of the first child sorting after
+ * (elem_quark, state_flags)
+ */
+static guint
+_style_tree_node_bsearch (StyleTreeNode *node,
+                          GQuark         elem_quark,
+                          guint          state_flags)
 {
-  StyleTreeNode *parent;
+  guint min = 0, max = node->children->len, mid;
+  StyleTreeNode *child;
+  gint diff;
 
-  if (node->properties->resolved)
-    return;
+  while (min < max)
+    {
+      mid = (min + max) / 2;
+      child = g_array_index (node->children, StyleTreeNode *, mid);
+      diff = _style_tree_node_compare (child, elem_quark, state_flags);
+
+      if (diff <= 0)
+        min = mid + 1;
+      else
+        max = mid;
+    }
 
-  parent = node->parent;
+  return min;
+}
 
-  while (parent)
-    {
-      _style_property_set_combine (node->properties,
-                                   parent->properties);
+static StylePropertySet *
+_style_tree_node_ensure_resolved (StyleTreeNode *node)
+{
+  StylePropertySet *parent_set;
 
-      if (parent->properties->resolved)
-        break;
+  if (node->resolved)
+    return node->resolved;
 
-      parent = parent->parent;
+  if (!node->parent)
+    node->resolved = _style_property_set_ref (node->properties);
+  else
+    {
+      parent_set = _style_tree_node_ensure_resolved (node->parent);
+
+      /* Nodes without properties of their own share the parent set */
+      if (node->properties->properties->len == 0)
+        node->resolved = _style_property_set_ref (parent_set);
+      else
+        node->resolved = _style_property_set_merge (node->properties,
+                                                    parent_set);
     }
 
-  node->properties->resolved = TRUE;
+  return node->resolved;
 }
 
 static StyleTreeNode *
@@ -845,34 +1113,32 @@ _find_child_node (StyleTreeNode *node,
                   guint          state_flags,
                   gboolean       create)
 {
-  StyleTreeNode *child, *candidate = NULL;
-  gint diff, i;
+  StyleTreeNode *child;
+  guint i;
 
-  /* FIXME: binary search */
-  for (i = 0; i < node->children->len; i++)
+  if (!create)
     {
-      child = g_array_index (node->children, gpointer, i);
-      diff = _style_tree_node_compare (child, elem_quark, state_flags);
-
-      if (diff < 0)
-        continue;
-      else if (diff > 0)
-        break;
+      /* Children with state flags being a subset of state_flags
+       * all sort before it, pick the one with the highest flags.
+       */
+      i = _style_tree_node_bsearch (node, elem_quark, state_flags);
 
-      if ((child->state_flags & state_flags) == child->state_flags)
+      while (i > 0)
         {
-          candidate = child;
+          child = g_array_index (node->children, StyleTreeNode *, --i);
 
-          if (state_flags == child->state_flags)
+          if (child->element != elem_quark)
             break;
+
+          if ((child->state_flags & state_flags) == child->state_flags)
+            return child;
         }
-      else if (child->state_flags > state_flags)
-        break;
-    }
 
-  if (!create)
-    return candidate;
+      return NULL;
+    }
 
+  /* Newer nodes go after equal ones, so they are found first */
+  i = _style_tree_node_bsearch (node, elem_quark, state_flags);
   child = _style_tree_node_new (elem_quark, state_flags, node);
 
   if (i == node->children->len)
@@ -892,7 +1158,7 @@ _mech_style_resolve_path_node (MechStyle *style)
   gint i;
 
   priv = mech_style_get_instance_private (style);
-  node = priv->style_tree;
+  node = priv->tree->root;
 
   for (i = priv->path_context->len - 1; i >= 0; i--)
     {
@@ -911,7 +1177,7 @@ mech_style_init (MechStyle *style)
 
   priv = mech_style_get_instance_private (style);
   priv->path_context = g_array_new (FALSE, FALSE, sizeof (PathContext));
-  priv->style_tree = _style_tree_node_new (0, 0, NULL);
+  priv->tree = _style_tree_new (_style_tree_node_new (0, 0, NULL));
 }
 
 MechStyle *
@@ -920,6 +1186,40 @@ mech_style_new (void)
   return g_object_new (MECH_TYPE_STYLE, NULL);
 }
 
+MechStyle *
+_mech_style_copy (MechStyle *style)
+{
+  MechStylePrivate *priv, *copy_priv;
+  MechStyle *copy;
+
+  g_return_val_if_fail (MECH_IS_STYLE (style), NULL);
+
+  priv = mech_style_get_instance_private (style);
+  copy = mech_style_new ();
+  copy_priv = mech_style_get_instance_private (copy);
+
+  _style_tree_unref (copy_priv->tree);
+  copy_priv->tree = _style_tree_ref (priv->tree);
+
+  return copy;
+}
+
+static void
+_mech_style_ensure_writable (MechStyle *style)
+{
+  MechStylePrivate *priv;
+  StyleTree *tree;
+
+  priv = mech_style_get_instance_private (style);
+
+  if (g_atomic_int_get (&priv->tree->ref_count) == 1)
+    return;
+
+  tree = _style_tree_new (_style_tree_node_copy (priv->tree->root, NULL));
+  _style_tree_unref (priv->tree);
+  priv->tree = tree;
+}
+
 void
 _mech_style_push_path (MechStyle      *style,
                        const gchar    *element,
@@ -947,7 +1247,7 @@ _style_peek_context_properties (MechStyle *style)
   priv = mech_style_get_instance_private (style);
 
   if (priv->path_context->len == 0)
-    return priv->style_tree->properties;
+    return priv->tree->root->properties;
 
   context = &g_array_index (priv->path_context, PathContext,
                             priv->path_context->len - 1);
@@ -957,7 +1257,7 @@ _style_peek_context_properties (MechStyle *style)
 void
 _mech_style_pop_path (MechStyle *style)
 {
-  StylePropertySet *properties;
+  StylePropertySet *properties, *merged;
   MechStylePrivate *priv;
   StyleTreeNode *node;
 
@@ -972,12 +1272,16 @@ _mech_style_pop_path (MechStyle *style)
     }
 
   /* Transfer properties from the context to the style tree node */
+  _mech_style_ensure_writable (style);
   node = _mech_style_resolve_path_node (style);
   properties = _style_peek_context_properties (style);
-  _style_property_set_combine (node->properties, properties);
+  merged = _style_property_set_merge (node->properties, properties);
+  _style_property_set_unref (node->properties);
+  node->properties = merged;
+  _style_tree_changed (priv->tree);
 
   g_array_remove_index (priv->path_context, priv->path_context->len - 1);
-  _style_property_set_free (properties);
+  _style_property_set_unref (properties);
 }
 
 void
@@ -988,13 +1292,37 @@ _mech_style_set_property (MechStyle *style,
                           GValue    *value)
 {
   StyleIterator iter = { 0 };
+  StylePropertySet *properties;
+  MechStylePrivate *priv;
+  StyleTreeNode *root;
 
   g_return_if_fail (MECH_IS_STYLE (style));
   g_return_if_fail (value != NULL);
 
+  priv = mech_style_get_instance_private (style);
+
+  if (priv->path_context->len == 0)
+    {
+      _mech_style_ensure_writable (style);
+      root = priv->tree->root;
+
+      /* Tree copies and resolved sets share the root
+       * properties, these are modified in place below.
+       */
+      if (g_atomic_int_get (&root->properties->ref_count) > 1)
+        {
+          properties = _style_property_set_copy (root->properties);
+          _style_property_set_unref (root->properties);
+          root->properties = properties;
+        }
+    }
+
   iter.set = _style_peek_context_properties (style);
   _style_iterator_forward_position (&iter, property, layer);
   _style_iterator_add (&iter, property, layer, flags, value);
+
+  if (iter.set == priv->tree->root->properties)
+    _style_tree_changed (priv->tree);
 }
 
 static void
@@ -1074,50 +1402,193 @@ _style_create_renderer (StylePropertySet *properties)
   return renderer;
 }
 
+static void
+_style_share_font_context (MechStyle    *style,
+                           MechRenderer *renderer)
+{
+  const PangoFontDescription *desc;
+  MechStylePrivate *priv;
+  PangoContext *context;
+
+  priv = mech_style_get_instance_private (style);
+  desc = _mech_renderer_get_font_description (renderer);
+  context = g_hash_table_lookup (priv->tree->font_contexts, desc);
+
+  if (context)
+    _mech_renderer_set_font_context (renderer, context);
+  else
+    {
+      context = mech_renderer_get_font_context (renderer);
+      g_hash_table_insert (priv->tree->font_contexts,
+                           pango_font_description_copy (desc),
+                           g_object_ref (context));
+    }
+}
+
+static void
+_style_area_memo_free (StyleAreaMemo *memo)
+{
+  g_array_unref (memo->path);
+  g_slice_free (StyleAreaMemo, memo);
+}
+
+static gboolean
+_style_area_memo_path_matches (StyleAreaMemo *memo,
+                               MechArea      *area)
+{
+  guint i = 0;
+
+  while (area)
+    {
+      if (i >= memo->path->len ||
+          g_array_index (memo->path, GQuark, i) != mech_area_get_qname (area))
+        return FALSE;
+
+      area = mech_area_get_parent (area);
+      i++;
+    }
+
+  return i == memo->path->len;
+}
+
+static StyleAreaMemo *
+_style_area_memo_get (MechStyle *style,
+                      MechArea  *area)
+{
+  MechStylePrivate *priv;
+  StyleAreaMemo *memo;
+  MechArea *parent;
+  GQuark qname;
+
+  priv = mech_style_get_instance_private (style);
+  memo = g_object_get_qdata ((GObject *) area, quark_area_memo);
+
+  if (!memo)
+    {
+      memo = g_slice_new0 (StyleAreaMemo);
+      memo->path = g_array_new (FALSE, FALSE, sizeof (GQuark));
+      g_object_set_qdata_full ((GObject *) area, quark_area_memo, memo,
+                               (GDestroyNotify) _style_area_memo_free);
+    }
+  else if (memo->serial == priv->tree->serial &&
+           _style_area_memo_path_matches (memo, area))
+    return memo;
+
+  memo->serial = priv->tree->serial;
+  memo->n_entries = 0;
+  g_array_set_size (memo->path, 0);
+
+  for (parent = area; parent; parent = mech_area_get_parent (parent))
+    {
+      qname = mech_area_get_qname (parent);
+      g_array_append_val (memo->path, qname);
+    }
+
+  return memo;
+}
+
+static StyleMemoEntry *
+_style_area_memo_lookup (StyleAreaMemo *memo,
+                         guint          state)
+{
+  guint i;
+
+  for (i = 0; i < memo->n_entries; i++)
+    {
+      if (memo->entries[i].state == state)
+        return &memo->entries[i];
+    }
+
+  return NULL;
+}
+
+static void
+_style_area_memo_add (StyleAreaMemo *memo,
+                      guint          state,
+                      StyleTreeNode *node,
+                      gboolean       child_match)
+{
+  StyleMemoEntry *entry;
+
+  /* Evict the oldest entry when full */
+  if (memo->n_entries == N_MEMO_ENTRIES)
+    {
+      memmove (&memo->entries[0], &memo->entries[1],
+               (N_MEMO_ENTRIES - 1) * sizeof (StyleMemoEntry));
+      memo->n_entries--;
+    }
+
+  entry = &memo->entries[memo->n_entries++];
+  entry->state = state;
+  entry->node = node;
+  entry->child_match = (child_match == TRUE);
+}
+
 MechRenderer *
 mech_style_lookup_renderer (MechStyle      *style,
                             MechArea       *area,
                             MechStateFlags  state)
 {
   gboolean first = TRUE, child_match = FALSE;
+  MechRenderer *renderer, *copy;
   StyleTreeNode *node, *next;
   MechStylePrivate *priv;
+  StyleMemoEntry *entry;
+  StyleAreaMemo *memo;
   GQuark qname;
 
   g_return_val_if_fail (MECH_IS_STYLE (style), NULL);
   g_return_val_if_fail (MECH_IS_AREA (area), NULL);
 
   priv = mech_style_get_instance_private (style);
-  node = priv->style_tree;
+  memo = _style_area_memo_get (style, area);
+  entry = _style_area_memo_lookup (memo, state);
 
-  /* FIXME: Cache renderers */
-
-  while (area)
+  if (entry)
+    {
+      node = entry->node;
+      child_match = entry->child_match;
+    }
+  else
     {
-      qname = mech_area_get_qname (area);
-      next = _find_child_node (node, qname, state, FALSE);
+      node = priv->tree->root;
+
+      while (area)
+        {
+          qname = mech_area_get_qname (area);
+          next = _find_child_node (node, qname, state, FALSE);
 
-      if (next)
-        node = next;
-      else if (first)
-        child_match = TRUE;
+          if (next)
+            node = next;
+          else if (first)
+            child_match = TRUE;
 
-      area = mech_area_get_parent (area);
-      first = FALSE;
+          area = mech_area_get_parent (area);
+          first = FALSE;
+        }
+
+      child_match = (child_match && node->parent);
+      _style_area_memo_add (memo, state, node, child_match);
     }
 
-  _style_tree_node_ensure_resolved (node);
+  /* The state only takes part in picking the node,
+   * so renderers are cached there, and shared by all
+   * areas resolving to it.
+   */
+  if (node->renderers[child_match])
+    return g_object_ref (node->renderers[child_match]);
 
-  if (child_match && node->parent)
-    {
-      MechRenderer *renderer, *copy;
+  renderer = _style_create_renderer (_style_tree_node_ensure_resolved (node));
 
-      renderer = _style_create_renderer (node->properties);
+  if (child_match)
+    {
       copy = _mech_renderer_copy (renderer, MECH_RENDERER_COPY_FOREGROUND);
       g_object_unref (renderer);
-
-      return copy;
+      renderer = copy;
     }
-  else
-    return _style_create_renderer (node->properties);
+
+  _style_share_font_context (style, renderer);
+  node->renderers[child_match] = renderer;
+
+  return g_object_ref (renderer);
 }
@@ -108,6 +108,8 @@ void             _mech_surface_set_above        (MechSurface       *surface,
 MechSurfaceType  _mech_surface_get_surface_type  (MechSurface      *surface);
 MechRendererType _mech_surface_get_renderer_type (MechSurface      *surface);
 
+gsize            _mech_surface_get_memory_size  (MechSurface       *surface);
+
 
 G_END_DECLS
 
@@ -38,8 +38,16 @@
   }                                                                     \
   G_STMT_END
 
-#define EXTRA_PIXELS 400
-#define AGE_BUFFER_LIMIT 3
+/* Offscreen padding follows the scroll speed,
+ * enough to cover LOOKAHEAD_FRAMES of scrolling.
+ */
+#define MIN_EXTRA_PIXELS 64
+#define MAX_EXTRA_PIXELS 400
+#define EXTRA_PIXELS_STEP 64
+#define LOOKAHEAD_FRAMES 10
+
+/* Must cover the longest swapchain in backends */
+#define AGE_BUFFER_LIMIT 4
 
 typedef struct _MechSurfacePrivate MechSurfacePrivate;
 
@@ -72,6 +80,9 @@ struct _MechSurfacePrivate
   gdouble scale_x;
   gdouble scale_y;
 
+  gdouble scroll_speed;
+  gint extra_pixels;
+
   guint surface_type  : 3;
   guint renderer_type : 2;
 };
@@ -294,6 +305,7 @@ mech_surface_init (MechSurface *surface)
   priv = mech_surface_get_instance_private (surface);
   priv->scale_x = 1;
   priv->scale_y = 1;
+  priv->extra_pixels = MIN_EXTRA_PIXELS;
   priv->surface_type = MECH_SURFACE_TYPE_SOFTWARE;
   priv->renderer_type = MECH_RENDERER_TYPE_SOFTWARE;
   priv->damage_cache = g_array_new (FALSE, FALSE, sizeof (cairo_region_t *));
@@ -335,6 +347,53 @@ _mech_surface_update_scale (MechSurface *surface)
   return FALSE;
 }
 
+static gint
+_get_extra_pixels (MechSurface *surface)
+{
+  MechSurfacePrivate *priv;
+
+  priv = mech_surface_get_instance_private (surface);
+
+  if (!mech_area_get_clip (priv->area) &&
+      priv->surface_type == MECH_SURFACE_TYPE_OFFSCREEN)
+    return priv->extra_pixels;
+
+  return 0;
+}
+
+static void
+_mech_surface_update_extra_pixels (MechSurface *surface)
+{
+  MechSurfacePrivate *priv;
+  cairo_rectangle_t rect;
+  gdouble speed;
+  gint extra_pixels;
+
+  priv = mech_surface_get_instance_private (surface);
+
+  /* Nothing to compare against yet */
+  if (priv->cache_width == 0 || priv->cache_height == 0 ||
+      _get_extra_pixels (surface) == 0)
+    return;
+
+  _mech_area_get_visible_rect (priv->area, &rect);
+  speed = MAX (ABS (rect.x - priv->viewport_rect.x) * priv->scale_x,
+               ABS (rect.y - priv->viewport_rect.y) * priv->scale_y);
+  priv->scroll_speed = (priv->scroll_speed + speed) / 2;
+
+  extra_pixels = CLAMP (priv->scroll_speed * LOOKAHEAD_FRAMES,
+                        MIN_EXTRA_PIXELS, MAX_EXTRA_PIXELS);
+  extra_pixels = (extra_pixels + EXTRA_PIXELS_STEP - 1) / EXTRA_PIXELS_STEP;
+  extra_pixels = MIN (extra_pixels * EXTRA_PIXELS_STEP, MAX_EXTRA_PIXELS);
+
+  /* Grow right away, but only shrink after slowing down
+   * noticeably, so the backing store isn't resized often.
+   */
+  if (extra_pixels > priv->extra_pixels ||
+      extra_pixels <= priv->extra_pixels / 2)
+    priv->extra_pixels = extra_pixels;
+}
+
 static void
 _calculate_cache_size (MechSurface *surface,
                        gint        *width,
@@ -342,14 +401,11 @@ _calculate_cache_size (MechSurface *surface,
 {
   cairo_rectangle_t allocation;
   MechSurfacePrivate *priv;
-  gint extra_pixels = 0;
+  gint extra_pixels;
 
   priv = mech_surface_get_instance_private (surface);
   mech_area_get_allocated_size (priv->area, &allocation);
-
-  if (!mech_area_get_clip (priv->area) &&
-      priv->surface_type == MECH_SURFACE_TYPE_OFFSCREEN)
-    extra_pixels = EXTRA_PIXELS;
+  extra_pixels = _get_extra_pixels (surface);
 
   if (!_mech_area_get_node (priv->area)->parent)
     {
@@ -520,7 +576,7 @@ _mech_surface_update_cached_rect (MechSurface       *surface,
                                   gdouble           *dy)
 {
   cairo_rectangle_t new_surface_rect, allocation;
-  gint cache_width, cache_height, extra_pixels = 0;
+  gint cache_width, cache_height, extra_pixels;
   MechSurfacePrivate *priv;
 
   priv = mech_surface_get_instance_private (surface);
@@ -532,9 +588,7 @@ _mech_surface_update_cached_rect (MechSurface       *surface,
   if (dy)
     *dy = 0;
 
-  if (!mech_area_get_clip (priv->area) &&
-      priv->surface_type == MECH_SURFACE_TYPE_OFFSCREEN)
-    extra_pixels = EXTRA_PIXELS;
+  extra_pixels = _get_extra_pixels (surface);
 
   if (!_mech_area_get_node (priv->area)->parent)
     {
@@ -733,6 +787,7 @@ _mech_surface_cairo_create (MechSurface *surface)
   cairo_t *cr;
 
   priv = mech_surface_get_instance_private (surface);
+  _mech_surface_update_extra_pixels (surface);
   _mech_surface_update_surface (surface);
 
   cairo_surface = MECH_SURFACE_GET_CLASS (surface)->get_surface (surface);
@@ -1112,3 +1167,16 @@ _mech_surface_get_renderer_type (MechSurface *surface)
   priv = mech_surface_get_instance_private (surface);
   return priv->renderer_type;
 }
+
+gsize
+_mech_surface_get_memory_size (MechSurface *surface)
+{
+  MechSurfacePrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_SURFACE (surface), 0);
+
+  priv = mech_surface_get_instance_private (surface);
+
+  /* Estimated from the backing store size, as ARGB32 */
+  return (gsize) priv->cache_width * priv->cache_height * 4;
+}
@@ -18,12 +18,19 @@
 #include <gobject/gvaluecollector.h>
 #include <string.h>
 #include "mech-text-buffer.h"
+#include "mech-text-range.h"
+#include "mech-text-tree-private.h"
 #include "mech-marshal.h"
 
-#define NODE_STRING(n) ((n)->stored->string->str + (n)->pos)
+#define NODE_STRING(n) ((n)->stored->str + (n)->pos)
 #define NODE_STRING_POS(n,p) (NODE_STRING(n) + (p))
 #define ITER_STRING(i) (NODE_STRING_POS ((MechTextBufferNode*) g_sequence_get ((i)->iter), (i)->pos))
 #define STRING_CHUNK_SOFT_LIMIT 65535
+#define LOAD_CHUNK_SIZE (64 * 1024)
+#define SEARCH_SPAN_SIZE (1024 * 1024)
+#define SEARCH_MAX_CARRY (1024 * 1024)
+#define HISTORY_COALESCE_MAX_BYTES 32
+#define HISTORY_COALESCE_TIMEOUT G_USEC_PER_SEC
 
 #define INITIALIZE_ITER(i,b,s,p) G_STMT_START { \
   (i)->buffer = (b);                            \
@@ -41,10 +48,20 @@ typedef struct _MechStoredString MechStoredString;
 typedef struct _MechTextBufferMark MechTextBufferMark;
 typedef struct _MechTextSeqIterator MechTextSeqIterator;
 typedef struct _MechTextUserData MechTextUserData;
+typedef struct _MechTextSearch MechTextSearch;
+typedef struct _MechTextSearchMatch MechTextSearchMatch;
+typedef struct _MechTextDataChange MechTextDataChange;
+typedef struct _MechTextUndoPiece MechTextUndoPiece;
+typedef struct _MechTextUndoRecord MechTextUndoRecord;
+typedef struct _MechTextUndoAction MechTextUndoAction;
 
 struct _MechStoredString
 {
+  /* Either growable or mapped, str/len point to the contents */
   GString *string;
+  GMappedFile *mapped;
+  gchar *str;
+  gsize len;
   gint node_count;
 };
 
@@ -53,8 +70,11 @@ struct _MechTextBufferNode
   MechStoredString *stored;
   gsize pos;
   gsize len;
+  gsize n_chars;
 
   GArray *data;
+  GPtrArray *marks;
+  MechTextTreeNode *tree_node;
 };
 
 struct _MechTextNodeData
@@ -90,18 +110,96 @@ struct _MechTextUserData
   gint ref_count;
 };
 
+/* History references the removed/inserted text
+ * in the stored strings, which never change.
+ */
+struct _MechTextUndoPiece
+{
+  MechStoredString *stored;
+  gsize pos;
+  gsize len;
+};
+
+struct _MechTextUndoRecord
+{
+  gsize offset;
+  gsize len;
+  GArray *pieces;
+  guint is_insert : 1;
+};
+
+struct _MechTextUndoAction
+{
+  GArray *records;
+  gsize size;
+  gint64 time;
+  guint sealed : 1;
+};
+
+struct _MechTextDataChange
+{
+  gsize start;
+  gsize end;
+  guint id;
+  MechTextUserData *data;
+};
+
+struct _MechTextSearchMatch
+{
+  gsize start;
+  gsize end;
+};
+
+struct _MechTextSearch
+{
+  gchar *pattern;
+  gsize pattern_len;
+  GRegex *regex;
+
+  /* Bytes preceding the current span that a
+   * match may still start from, see
+   * _text_search_literal_span()/_text_search_regex_span()
+   */
+  GString *carry;
+  gsize carry_offset;
+  gchar prev_byte;
+
+  GArray *matches;
+  gsize last_end;
+  guint max_matches;
+  guint caseless : 1;
+};
+
 struct _MechTextBufferPrivate
 {
   GPtrArray *strings;
   GSequence *buffer;
+  MechTextTree *tree;
   GArray *registered_data;
-  GArray *marks;
+  GHashTable *marks;
+  GPtrArray *end_marks;
 
   guint last_registered_id;
   guint paragraph_break_id;
 
+  MechStoredString *loading;
+  MechStoredString *restoring;
+
+  GQueue undo_stack;
+  GQueue redo_stack;
+  MechTextUndoAction *group_action;
+  gsize history_size;
+  gsize max_history_size;
+  guint user_action_depth;
+
+  GString *pending;
+  guint flush_id;
+  guint max_paragraphs;
+
   guint paragraph;
   guint mark;
+
+  guint applying_history : 1;
 };
 
 enum {
@@ -180,101 +278,259 @@ _mech_text_user_data_unref (MechTextUserData *data)
     }
 }
 
+static gboolean
+_mech_text_user_data_internable (const MechTextUserData *data)
+{
+  switch (G_TYPE_FUNDAMENTAL (G_VALUE_TYPE (&data->value)))
+    {
+    case G_TYPE_BOOLEAN:
+    case G_TYPE_CHAR:
+    case G_TYPE_UCHAR:
+    case G_TYPE_INT:
+    case G_TYPE_UINT:
+    case G_TYPE_LONG:
+    case G_TYPE_ULONG:
+    case G_TYPE_INT64:
+    case G_TYPE_UINT64:
+    case G_TYPE_ENUM:
+    case G_TYPE_FLAGS:
+    case G_TYPE_FLOAT:
+    case G_TYPE_DOUBLE:
+    case G_TYPE_POINTER:
+    case G_TYPE_OBJECT:
+    case G_TYPE_STRING:
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
+/* Values are compared by contents for strings, and by
+ * the raw GValue storage otherwise, which g_value_init()
+ * zero fills, so pointer types compare by identity. Boxed
+ * values are left out, g_value_copy() gives each a new
+ * pointer, so equal ones would never compare equal.
+ */
 static guint
-_mech_text_mark_get_insert_position (MechTextBuffer *buffer,
-                                     GSequenceIter  *iter,
-                                     gsize           pos)
+_mech_text_user_data_hash (gconstpointer user_data)
+{
+  const MechTextUserData *data = user_data;
+  guint64 v;
+
+  if (!_mech_text_user_data_internable (data))
+    return g_direct_hash (data);
+
+  if (G_VALUE_HOLDS_STRING (&data->value))
+    {
+      if (!data->value.data[0].v_pointer)
+        return 0;
+
+      return g_str_hash (data->value.data[0].v_pointer);
+    }
+
+  v = data->value.data[0].v_uint64;
+
+  return (guint) (v ^ (v >> 32)) ^ G_VALUE_TYPE (&data->value);
+}
+
+static gboolean
+_mech_text_user_data_equal (gconstpointer user_data1,
+                            gconstpointer user_data2)
+{
+  const MechTextUserData *data1 = user_data1, *data2 = user_data2;
+
+  if (data1 == data2)
+    return TRUE;
+
+  if (G_VALUE_TYPE (&data1->value) != G_VALUE_TYPE (&data2->value) ||
+      !_mech_text_user_data_internable (data1))
+    return FALSE;
+
+  if (G_VALUE_HOLDS_STRING (&data1->value))
+    return g_strcmp0 (data1->value.data[0].v_pointer,
+                      data2->value.data[0].v_pointer) == 0;
+
+  return data1->value.data[0].v_uint64 == data2->value.data[0].v_uint64;
+}
+
+static void
+_mech_text_mark_free (MechTextBufferMark *mark)
+{
+  g_slice_free (MechTextBufferMark, mark);
+}
+
+/* Marks are kept on the node they point to, sorted by
+ * position, marks at the buffer end go on a separate list.
+ */
+static GPtrArray **
+_mech_text_buffer_get_mark_list (MechTextBuffer *buffer,
+                                 GSequenceIter  *iter)
 {
   MechTextBufferPrivate *priv;
+  MechTextBufferNode *node;
+
+  if (g_sequence_iter_is_end (iter))
+    {
+      priv = mech_text_buffer_get_instance_private (buffer);
+      return &priv->end_marks;
+    }
+
+  node = g_sequence_get (iter);
+  return &node->marks;
+}
+
+static guint
+_mech_text_mark_list_search (GPtrArray *marks,
+                             gsize      pos)
+{
   MechTextBufferMark *mark;
-  gint min, max, mid;
+  guint min, max, mid;
 
-  priv = mech_text_buffer_get_instance_private (buffer);
+  /* Returns the first mark at or after pos */
   min = 0;
-  max = priv->marks->len - 1;
-  mid = (min + max) / 2;
+  max = marks->len;
 
-  while (max >= min)
+  while (min < max)
     {
       mid = (min + max) / 2;
-      mark = &g_array_index (priv->marks, MechTextBufferMark, mid);
+      mark = g_ptr_array_index (marks, mid);
 
-      if (iter == mark->iter.iter)
-        {
-          if (pos == mark->iter.pos)
-            return mid;
-          else if (pos > mark->iter.pos)
-            min = mid + 1;
-          else
-            max = mid - 1;
-        }
-      else if (g_sequence_iter_compare (iter, mark->iter.iter) > 0)
+      if ((gsize) mark->iter.pos < pos)
         min = mid + 1;
       else
-        max = mid - 1;
+        max = mid;
     }
 
-  return MAX (min, max);
+  return min;
 }
 
-static MechTextBufferMark *
-_mech_text_mark_find (MechTextBuffer *buffer,
-                      guint           mark_id,
-                      guint          *pos)
+static void
+_mech_text_mark_attach (MechTextBuffer     *buffer,
+                        MechTextBufferMark *mark)
 {
-  MechTextBufferPrivate *priv;
-  MechTextBufferMark *mark;
-  guint i;
+  GPtrArray **marks;
+  guint pos;
 
-  priv = mech_text_buffer_get_instance_private (buffer);
+  marks = _mech_text_buffer_get_mark_list (buffer, mark->iter.iter);
 
-  for (i = 0; i < priv->marks->len; i++)
-    {
-      mark = &g_array_index (priv->marks, MechTextBufferMark, i);
+  if (!*marks)
+    *marks = g_ptr_array_new ();
 
-      if (mark->id == mark_id)
-        {
-          if (pos)
-            *pos = i;
+  /* Insert after any other mark on the same position */
+  pos = _mech_text_mark_list_search (*marks, mark->iter.pos + 1);
+  g_ptr_array_add (*marks, mark);
 
-          return mark;
-        }
+  if (pos < (*marks)->len - 1)
+    {
+      memmove (&(*marks)->pdata[pos + 1], &(*marks)->pdata[pos],
+               ((*marks)->len - pos - 1) * sizeof (gpointer));
+      (*marks)->pdata[pos] = mark;
     }
+}
 
-  return NULL;
+static void
+_mech_text_mark_detach (MechTextBuffer     *buffer,
+                        MechTextBufferMark *mark)
+{
+  GPtrArray **marks;
+  guint pos;
+
+  marks = _mech_text_buffer_get_mark_list (buffer, mark->iter.iter);
+  pos = _mech_text_mark_list_search (*marks, mark->iter.pos);
+
+  while (g_ptr_array_index (*marks, pos) != mark)
+    pos++;
+
+  g_ptr_array_remove_index (*marks, pos);
+
+  if ((*marks)->len == 0)
+    {
+      g_ptr_array_unref (*marks);
+      *marks = NULL;
+    }
 }
 
 static void
 _mech_text_buffer_split_marks (MechTextBuffer *buffer,
                                GSequenceIter  *iter,
-                               gssize          pos)
+                               gsize           pos)
 {
-  MechTextBufferPrivate *priv;
+  MechTextBufferNode *node, *next_node;
   MechTextBufferMark *mark;
   GSequenceIter *next;
-  gint mark_pos;
+  guint i, first;
 
   if (g_sequence_iter_is_end (iter))
     return;
 
+  node = g_sequence_get (iter);
+
+  if (!node->marks)
+    return;
+
+  first = _mech_text_mark_list_search (node->marks, pos);
+
+  if (first == node->marks->len)
+    return;
+
   /* Assume the node has been already split, so the next iter
    * already points to the second half of the previous data.
    */
-  priv = mech_text_buffer_get_instance_private (buffer);
   next = g_sequence_iter_next (iter);
-  mark_pos = _mech_text_mark_get_insert_position (buffer, iter, pos);
+  next_node = g_sequence_get (next);
+  g_assert (next_node->marks == NULL);
+  next_node->marks = g_ptr_array_sized_new (node->marks->len - first);
 
-  while (pos < priv->marks->len)
+  for (i = first; i < node->marks->len; i++)
     {
-      mark = &g_array_index (priv->marks,
-                             MechTextBufferMark, mark_pos);
+      mark = g_ptr_array_index (node->marks, i);
+      INITIALIZE_ITER (&mark->iter, buffer, next, mark->iter.pos - pos);
+      g_ptr_array_add (next_node->marks, mark);
+    }
 
-      if (mark->iter.iter != iter)
-        break;
+  if (first == 0)
+    {
+      g_ptr_array_unref (node->marks);
+      node->marks = NULL;
+    }
+  else
+    g_ptr_array_remove_range (node->marks, first, node->marks->len - first);
+}
+
+static void
+_mech_text_buffer_join_marks (MechTextBuffer *buffer,
+                              GSequenceIter  *iter,
+                              GSequenceIter  *dest,
+                              gsize           offset)
+{
+  MechTextBufferNode *node, *dest_node;
+  MechTextBufferMark *mark;
+  guint i;
+
+  /* Moves marks from a node being merged into dest, these
+   * are all after the ones already in dest.
+   */
+  node = g_sequence_get (iter);
+  dest_node = g_sequence_get (dest);
+
+  if (!node->marks)
+    return;
+
+  for (i = 0; i < node->marks->len; i++)
+    {
+      mark = g_ptr_array_index (node->marks, i);
+      INITIALIZE_ITER (&mark->iter, buffer, dest, mark->iter.pos + offset);
 
-      INITIALIZE_ITER (&mark->iter, buffer, next, 0);
-      mark_pos++;
+      if (dest_node->marks)
+        g_ptr_array_add (dest_node->marks, mark);
     }
+
+  if (!dest_node->marks)
+    dest_node->marks = node->marks;
+  else
+    g_ptr_array_unref (node->marks);
+
+  node->marks = NULL;
 }
 
 static void
@@ -282,35 +538,54 @@ _mech_text_buffer_collapse_marks (MechTextBuffer *buffer,
                                   GSequenceIter  *start,
                                   GSequenceIter  *end)
 {
-  MechTextBufferPrivate *priv;
+  MechTextBufferNode *node;
   MechTextBufferMark *mark;
-  gint mark_pos;
+  GPtrArray *collapsed = NULL, **marks;
+  GSequenceIter *iter;
+  guint i;
+
+  for (iter = start; iter != end; iter = g_sequence_iter_next (iter))
+    {
+      node = g_sequence_get (iter);
+
+      if (!node->marks)
+        continue;
+
+      if (!collapsed)
+        collapsed = g_ptr_array_new ();
+
+      for (i = 0; i < node->marks->len; i++)
+        {
+          mark = g_ptr_array_index (node->marks, i);
+          INITIALIZE_ITER (&mark->iter, buffer, end, 0);
+          g_ptr_array_add (collapsed, mark);
+        }
+
+      g_ptr_array_unref (node->marks);
+      node->marks = NULL;
+    }
 
-  if (g_sequence_iter_is_end (start))
+  if (!collapsed)
     return;
 
-  priv = mech_text_buffer_get_instance_private (buffer);
-  mark_pos = _mech_text_mark_get_insert_position (buffer, start, 0);
+  /* Collapsed marks go before those already at end */
+  marks = _mech_text_buffer_get_mark_list (buffer, end);
 
-  while (mark_pos < priv->marks->len)
+  if (*marks)
     {
-      mark = &g_array_index (priv->marks,
-                             MechTextBufferMark, mark_pos);
-
-      if (g_sequence_iter_compare (mark->iter.iter, end) >= 0)
-        break;
+      for (i = 0; i < (*marks)->len; i++)
+        g_ptr_array_add (collapsed, g_ptr_array_index (*marks, i));
 
-      INITIALIZE_ITER (&mark->iter, buffer, end, 0);
-      mark_pos++;
+      g_ptr_array_unref (*marks);
     }
+
+  *marks = collapsed;
 }
 
 static MechStoredString *
-_mech_stored_string_new (MechTextBuffer *buffer,
-                         const gchar    *text,
-                         gssize          len)
+_mech_stored_string_alloc (MechTextBuffer *buffer)
 {
-  MechStoredString *stored, *new = NULL;
+  MechStoredString *stored;
   MechTextBufferPrivate *priv;
   guint i;
 
@@ -320,20 +595,41 @@ _mech_stored_string_new (MechTextBuffer *buffer,
     {
       stored = g_ptr_array_index (priv->strings, i);
 
-      if (!stored->string)
-        {
-          new = stored;
-          break;
-        }
+      if (!stored->str)
+        return stored;
     }
 
-  if (!new)
-    {
-      new = g_slice_new0 (MechStoredString);
-      g_ptr_array_add (priv->strings, new);
-    }
+  stored = g_slice_new0 (MechStoredString);
+  g_ptr_array_add (priv->strings, stored);
+
+  return stored;
+}
 
+static MechStoredString *
+_mech_stored_string_new (MechTextBuffer *buffer,
+                         const gchar    *text,
+                         gssize          len)
+{
+  MechStoredString *new;
+
+  new = _mech_stored_string_alloc (buffer);
   new->string = g_string_new_len (text, len);
+  new->str = new->string->str;
+  new->len = new->string->len;
+
+  return new;
+}
+
+static MechStoredString *
+_mech_stored_string_new_mapped (MechTextBuffer *buffer,
+                                GMappedFile    *mapped)
+{
+  MechStoredString *new;
+
+  new = _mech_stored_string_alloc (buffer);
+  new->mapped = g_mapped_file_ref (mapped);
+  new->str = g_mapped_file_get_contents (mapped);
+  new->len = g_mapped_file_get_length (mapped);
 
   return new;
 }
@@ -347,16 +643,44 @@ _mech_stored_string_append (MechStoredString  *stored,
   gsize prev_len = stored->string->len;
 
   g_string_append_len (stored->string, text, len);
+  stored->str = stored->string->str;
+  stored->len = stored->string->len;
 
   if (string_start)
-    *string_start = stored->string->str + prev_len;
+    *string_start = stored->str + prev_len;
 }
 
 static void
-_mech_stored_string_free (MechStoredString *stored)
+_mech_stored_string_clear (MechStoredString *stored)
 {
   if (stored->string)
     g_string_free (stored->string, TRUE);
+  if (stored->mapped)
+    g_mapped_file_unref (stored->mapped);
+
+  stored->string = NULL;
+  stored->mapped = NULL;
+  stored->str = NULL;
+  stored->len = 0;
+}
+
+static void
+_mech_stored_string_hold (MechStoredString *stored)
+{
+  g_atomic_int_inc (&stored->node_count);
+}
+
+static void
+_mech_stored_string_release (MechStoredString *stored)
+{
+  if (g_atomic_int_dec_and_test (&stored->node_count))
+    _mech_stored_string_clear (stored);
+}
+
+static void
+_mech_stored_string_free (MechStoredString *stored)
+{
+  _mech_stored_string_clear (stored);
   g_slice_free (MechStoredString, stored);
 }
 
@@ -373,6 +697,7 @@ _mech_text_buffer_node_new (MechStoredString *stored,
   node->stored = stored;
   node->pos = pos;
   node->len = len;
+  node->n_chars = g_utf8_strlen (NODE_STRING (node), len);
 
   if (data)
     {
@@ -387,60 +712,75 @@ _mech_text_buffer_node_new (MechStoredString *stored,
         }
     }
 
-  g_atomic_int_inc (&stored->node_count);
+  _mech_stored_string_hold (stored);
 
   return node;
 }
 
+static guint
+_mech_text_buffer_node_data_search (MechTextBufferNode *node,
+                                    guint               id)
+{
+  MechTextNodeData *node_data;
+  guint min, max, mid;
+
+  /* Returns the position of id, or the one it'd be inserted at */
+  min = 0;
+  max = node->data->len;
+
+  while (min < max)
+    {
+      mid = (min + max) / 2;
+      node_data = &g_array_index (node->data, MechTextNodeData, mid);
+
+      if (node_data->id < id)
+        min = mid + 1;
+      else
+        max = mid;
+    }
+
+  return min;
+}
+
 static void
 _mech_text_buffer_node_set_data (MechTextBufferNode *node,
                                  MechTextBuffer     *buffer,
                                  guint               id,
                                  MechTextUserData   *data)
 {
-  MechTextNodeData new = { 0 };
+  MechTextNodeData *node_data = NULL, new = { 0 };
   guint i;
 
-  if (!node->data && data)
-    node->data = g_array_new (FALSE, FALSE, sizeof (MechTextNodeData));
-
-  /* FIXME: binary insertion should help here */
-  for (i = 0; i < node->data->len; i++)
+  if (!node->data)
     {
-      MechTextNodeData *node_data;
+      if (!data)
+        return;
 
-      node_data = &g_array_index (node->data, MechTextNodeData, i);
+      node->data = g_array_new (FALSE, FALSE, sizeof (MechTextNodeData));
+    }
 
-      if (node_data->id == id)
-        {
-          if (node_data->data == data)
-            return;
+  i = _mech_text_buffer_node_data_search (node, id);
 
-          if (node_data->data)
-            {
-              _mech_text_user_data_unref (node_data->data);
-              node_data->data = NULL;
-            }
+  if (i < node->data->len)
+    node_data = &g_array_index (node->data, MechTextNodeData, i);
 
-          if (data)
-            node_data->data = _mech_text_user_data_ref (data);
-          else
-            g_array_remove_index_fast (node->data, i);
-          return;
-        }
-      else if (data && node_data->id > id)
-        break;
-    }
+  if (node_data && node_data->id == id)
+    {
+      if (node_data->data == data)
+        return;
 
-  if (data)
+      _mech_text_user_data_unref (node_data->data);
+
+      if (data)
+        node_data->data = _mech_text_user_data_ref (data);
+      else
+        g_array_remove_index (node->data, i);
+    }
+  else if (data)
     {
       new.id = id;
       new.data = _mech_text_user_data_ref (data);
-
-      if (i < node->data->len)
-        g_array_insert_val (node->data, i, new);
-      else
-        g_array_append_val (node->data, new);
+      g_array_insert_val (node->data, i, new);
     }
 }
 
@@ -448,52 +788,222 @@ static MechTextUserData *
 _mech_text_buffer_node_get_data (MechTextBufferNode *node,
                                  guint               id)
 {
+  MechTextNodeData *node_data;
   guint i;
 
   if (!node->data)
     return NULL;
 
-  for (i = 0; i < node->data->len; i++)
-    {
-      MechTextNodeData *node_data;
+  i = _mech_text_buffer_node_data_search (node, id);
+
+  if (i == node->data->len)
+    return NULL;
 
-      node_data = &g_array_index (node->data, MechTextNodeData, i);
+  node_data = &g_array_index (node->data, MechTextNodeData, i);
 
-      if (node_data->id == id)
-        return node_data->data;
-    }
+  if (node_data->id != id)
+    return NULL;
 
-  return NULL;
+  return node_data->data;
 }
 
 static void
-_mech_text_buffer_node_free (MechTextBufferNode *node)
+_mech_text_buffer_node_sync (MechTextBufferNode *node,
+                             gboolean            breaks)
 {
-  MechStoredString *stored;
-  guint i;
+  _mech_text_tree_node_set_counts (node->tree_node, node->len,
+                                   node->n_chars, breaks ? 1 : 0);
+}
 
-  stored = node->stored;
+static gboolean
+_mech_text_buffer_node_breaks (MechTextBufferNode *node)
+{
+  return _mech_text_tree_node_get_count (node->tree_node,
+                                         MECH_TEXT_TREE_PARAGRAPHS) != 0;
+}
 
-  if (node->data)
-    {
-      for (i = 0; i < node->data->len; i++)
-        {
-          MechTextNodeData *node_data;
+static GSequenceIter *
+_mech_text_buffer_insert_node (MechTextBuffer     *buffer,
+                               GSequenceIter      *next,
+                               MechTextBufferNode *node)
+{
+  MechTextTreeNode *sibling = NULL;
+  MechTextBufferPrivate *priv;
+  GSequenceIter *iter;
 
-          node_data = &g_array_index (node->data, MechTextNodeData, i);
-          _mech_text_user_data_unref (node_data->data);
-        }
+  priv = mech_text_buffer_get_instance_private (buffer);
 
-      g_array_unref (node->data);
-    }
+  if (!g_sequence_iter_is_end (next))
+    sibling = ((MechTextBufferNode *) g_sequence_get (next))->tree_node;
 
-  g_slice_free (MechTextBufferNode, node);
+  iter = g_sequence_insert_before (next, node);
+  node->tree_node = _mech_text_tree_insert_before (priv->tree, sibling, iter);
+  _mech_text_buffer_node_sync (node, FALSE);
 
-  if (g_atomic_int_dec_and_test (&stored->node_count))
-    {
-      g_string_free (stored->string, TRUE);
-      stored->string = NULL;
+  return iter;
+}
+
+static void
+_mech_text_buffer_remove_node (MechTextBuffer *buffer,
+                               GSequenceIter  *iter)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferNode *node;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  node = g_sequence_get (iter);
+  _mech_text_tree_remove (priv->tree, node->tree_node);
+  g_sequence_remove (iter);
+}
+
+/* A node breaks a paragraph if the next one belongs to a
+ * different paragraph, as that depends on the next node,
+ * the node before start is updated too.
+ */
+static void
+_mech_text_buffer_update_breaks (MechTextBuffer *buffer,
+                                 GSequenceIter  *start,
+                                 GSequenceIter  *end)
+{
+  MechTextBufferPrivate *priv;
+  GSequenceIter *iter, *next;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  iter = start;
+
+  if (!g_sequence_iter_is_begin (iter))
+    iter = g_sequence_iter_prev (iter);
+
+  while (!g_sequence_iter_is_end (iter))
+    {
+      MechTextUserData *paragraph, *next_paragraph;
+      MechTextBufferNode *node;
+      gboolean breaks = TRUE;
+
+      node = g_sequence_get (iter);
+      next = g_sequence_iter_next (iter);
+
+      if (!g_sequence_iter_is_end (next))
+        {
+          paragraph =
+            _mech_text_buffer_node_get_data (node, priv->paragraph_break_id);
+          next_paragraph =
+            _mech_text_buffer_node_get_data (g_sequence_get (next),
+                                             priv->paragraph_break_id);
+          breaks = paragraph != next_paragraph;
+        }
+
+      _mech_text_buffer_node_sync (node, breaks);
+
+      if (iter == end)
+        break;
+
+      iter = next;
+    }
+}
+
+static gsize
+_text_buffer_iter_get_offset (MechTextBuffer     *buffer,
+                              const MechTextIter *iter,
+                              MechTextTreeMetric  metric)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferNode *node;
+  gsize offset;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (g_sequence_iter_is_end (iter->iter))
+    return _mech_text_tree_get_total (priv->tree, metric);
+
+  node = g_sequence_get (iter->iter);
+  offset = _mech_text_tree_node_get_offset (node->tree_node, metric);
+
+  if (metric == MECH_TEXT_TREE_BYTES)
+    offset += iter->pos;
+  else if (metric == MECH_TEXT_TREE_CHARS)
+    offset += g_utf8_strlen (NODE_STRING (node), iter->pos);
+
+  return offset;
+}
+
+static void
+_text_buffer_get_paragraph_start (MechTextBuffer *buffer,
+                                  gsize           paragraph,
+                                  MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+  MechTextTreeNode *tree_node;
+  GSequenceIter *seq_iter;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (paragraph == 0)
+    seq_iter = g_sequence_get_begin_iter (priv->buffer);
+  else
+    {
+      /* Paragraph starts right after the node breaking the previous one */
+      tree_node = _mech_text_tree_lookup (priv->tree,
+                                          MECH_TEXT_TREE_PARAGRAPHS,
+                                          paragraph - 1, NULL);
+      if (tree_node)
+        {
+          seq_iter = _mech_text_tree_node_get_data (tree_node);
+          seq_iter = g_sequence_iter_next (seq_iter);
+        }
+      else
+        seq_iter = g_sequence_get_end_iter (priv->buffer);
+    }
+
+  INITIALIZE_ITER (iter, buffer, seq_iter, 0);
+}
+
+static void
+_text_buffer_get_iter_at_byte_offset (MechTextBuffer *buffer,
+                                      gsize           offset,
+                                      MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+  MechTextTreeNode *tree_node;
+  gsize node_offset;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  tree_node = _mech_text_tree_lookup (priv->tree, MECH_TEXT_TREE_BYTES,
+                                      offset, &node_offset);
+  if (!tree_node)
+    mech_text_buffer_get_bounds (buffer, NULL, iter);
+  else
+    INITIALIZE_ITER (iter, buffer,
+                     _mech_text_tree_node_get_data (tree_node),
+                     node_offset);
+}
+
+static void
+_mech_text_buffer_node_free (MechTextBufferNode *node)
+{
+  MechStoredString *stored;
+  guint i;
+
+  stored = node->stored;
+
+  if (node->data)
+    {
+      for (i = 0; i < node->data->len; i++)
+        {
+          MechTextNodeData *node_data;
+
+          node_data = &g_array_index (node->data, MechTextNodeData, i);
+          _mech_text_user_data_unref (node_data->data);
+        }
+
+      g_array_unref (node->data);
     }
+
+  if (node->marks)
+    g_ptr_array_unref (node->marks);
+
+  g_slice_free (MechTextBufferNode, node);
+  _mech_stored_string_release (stored);
 }
 
 static GArray *
@@ -541,11 +1051,15 @@ static gboolean
 _mech_text_buffer_node_data_equals (MechTextBufferNode *node1,
                                     MechTextBufferNode *node2)
 {
-  if ((node1->data != NULL) != (node2->data != NULL))
-    return FALSE;
+  guint len1, len2;
+
+  len1 = node1->data ? node1->data->len : 0;
+  len2 = node2->data ? node2->data->len : 0;
 
-  if (node1->data->len != node2->data->len)
+  if (len1 != len2)
     return FALSE;
+  else if (len1 == 0)
+    return TRUE;
 
   return memcmp (node1->data->data, node2->data->data,
                  g_array_get_element_size (node1->data) * node1->data->len) == 0;
@@ -577,10 +1091,15 @@ _mech_text_buffer_node_split (MechTextBuffer  *buffer,
                                     node->pos + split_pos,
                                     node->len - split_pos,
                                     node->data);
-  end_iter = g_sequence_insert_before (next, new);
+  end_iter = _mech_text_buffer_insert_node (buffer, next, new);
 
-  /* Trim text after cur_start in original node */
+  /* Trim text after cur_start in original node, both halves
+   * share paragraph, so only the second one may break it.
+   */
+  _mech_text_buffer_node_sync (new, _mech_text_buffer_node_breaks (node));
   node->len = split_pos;
+  node->n_chars -= new->n_chars;
+  _mech_text_buffer_node_sync (node, FALSE);
 
   if (end)
     *end = end_iter;
@@ -596,7 +1115,20 @@ _mech_text_buffer_delete_nodes (MechTextBuffer *buffer,
                                 GSequenceIter  *start,
                                 GSequenceIter  *end)
 {
+  MechTextBufferPrivate *priv;
+  GSequenceIter *iter;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
   _mech_text_buffer_collapse_marks (buffer, start, end);
+
+  for (iter = start; iter != end; iter = g_sequence_iter_next (iter))
+    {
+      MechTextBufferNode *node;
+
+      node = g_sequence_get (iter);
+      _mech_text_tree_remove (priv->tree, node->tree_node);
+    }
+
   g_sequence_remove_range (start, end);
 }
 
@@ -625,19 +1157,6 @@ _text_buffer_iter_node_terminates_paragraph (GSequenceIter *iter)
   return _text_buffer_is_line_terminator (ch);
 }
 
-static guint
-_mech_text_buffer_node_get_paragraph (MechTextBuffer     *buffer,
-                                      MechTextBufferNode *node)
-{
-  MechTextBufferPrivate *priv;
-  MechTextUserData *data;
-
-  priv = mech_text_buffer_get_instance_private (buffer);
-  data = _mech_text_buffer_node_get_data (node, priv->paragraph_break_id);
-
-  return g_value_get_uint (&data->value);
-}
-
 static MechTextUserData *
 _text_buffer_find_paragraph (MechTextBuffer *buffer,
                              MechTextIter   *iter)
@@ -669,14 +1188,13 @@ _text_buffer_next_paragraph (MechTextBuffer *buffer)
 {
   MechTextBufferPrivate *priv;
   MechTextUserData *paragraph;
-  GValue value = { 0 };
 
   priv = mech_text_buffer_get_instance_private (buffer);
 
-  g_value_init (&value, G_TYPE_UINT);
-  g_value_set_uint (&value, ++priv->paragraph);
-  paragraph = _mech_text_user_data_new (&value);
-  g_value_unset (&value);
+  paragraph = g_slice_new0 (MechTextUserData);
+  g_value_init (&paragraph->value, G_TYPE_UINT);
+  g_value_set_uint (&paragraph->value, ++priv->paragraph);
+  paragraph->ref_count = 1;
 
   return paragraph;
 }
@@ -688,8 +1206,20 @@ _text_buffer_intern_string (MechTextBuffer  *buffer,
                             gssize           len,
                             const gchar    **start)
 {
+  MechTextBufferPrivate *priv;
   MechStoredString *stored = NULL;
 
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  /* Text restored from history is already stored */
+  if (priv->restoring)
+    {
+      if (start)
+        *start = text;
+
+      return priv->restoring;
+    }
+
   if (iter && iter->pos == 0 && !g_sequence_iter_is_begin (iter->iter))
     {
       MechTextBufferNode *node;
@@ -698,8 +1228,9 @@ _text_buffer_intern_string (MechTextBuffer  *buffer,
       prev = g_sequence_iter_prev (iter->iter);
       node = g_sequence_get (prev);
 
-      if (node->pos + node->len == node->stored->string->len &&
-          node->stored->string->len < STRING_CHUNK_SOFT_LIMIT)
+      if (node->stored->string &&
+          node->pos + node->len == node->stored->len &&
+          node->stored->len < STRING_CHUNK_SOFT_LIMIT)
         {
           stored = node->stored;
           _mech_stored_string_append (stored, text, len, start);
@@ -711,20 +1242,26 @@ _text_buffer_intern_string (MechTextBuffer  *buffer,
       stored = _mech_stored_string_new (buffer, text, len);
 
       if (start)
-        *start = stored->string->str;
+        *start = stored->str;
     }
 
   return stored;
 }
 
-gboolean
-_mech_text_buffer_store_user_data (MechTextBuffer   *buffer,
-                                   MechTextIter     *start,
-                                   MechTextIter     *end,
-                                   guint             id,
-                                   MechTextUserData *user_data)
+static gboolean
+_mech_text_buffer_store_user_data_array (MechTextBuffer    *buffer,
+                                         MechTextIter      *start,
+                                         MechTextIter      *end,
+                                         const guint       *ids,
+                                         MechTextUserData **user_data,
+                                         guint              n_ids)
 {
   GSequenceIter *iter, *update_start, *update_end;
+  MechTextBufferPrivate *priv;
+  gboolean breaks = FALSE;
+  guint i;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
 
   if (g_sequence_iter_is_end (start->iter) ||
       mech_text_buffer_iter_compare (start, end) == 0)
@@ -741,15 +1278,35 @@ _mech_text_buffer_store_user_data (MechTextBuffer   *buffer,
       g_assert (!g_sequence_iter_is_end (iter));
 
       node = g_sequence_get (iter);
-      _mech_text_buffer_node_set_data (node, buffer, id, user_data);
+
+      for (i = 0; i < n_ids; i++)
+        _mech_text_buffer_node_set_data (node, buffer, ids[i], user_data[i]);
+
       iter = g_sequence_iter_next (iter);
     }
 
+  for (i = 0; i < n_ids; i++)
+    breaks |= ids[i] == priv->paragraph_break_id;
+
+  if (breaks)
+    _mech_text_buffer_update_breaks (buffer, update_start, update_end);
+
   INITIALIZE_ITER (start, buffer, update_start, 0);
   INITIALIZE_ITER (end, buffer, update_end, 0);
   return TRUE;
 }
 
+gboolean
+_mech_text_buffer_store_user_data (MechTextBuffer   *buffer,
+                                   MechTextIter     *start,
+                                   MechTextIter     *end,
+                                   guint             id,
+                                   MechTextUserData *user_data)
+{
+  return _mech_text_buffer_store_user_data_array (buffer, start, end,
+                                                  &id, &user_data, 1);
+}
+
 static gboolean
 _text_buffer_check_node_append (MechTextBuffer *buffer,
                                 MechTextIter   *insert,
@@ -769,7 +1326,7 @@ _text_buffer_check_node_append (MechTextBuffer *buffer,
   node = g_sequence_get (prev);
   g_assert (node != NULL);
 
-  if (node->stored->string->str + node->pos + node->len != text)
+  if (NODE_STRING_POS (node, node->len) != text)
     return FALSE;
 
   if (_text_buffer_iter_node_terminates_paragraph (prev) &&
@@ -778,32 +1335,86 @@ _text_buffer_check_node_append (MechTextBuffer *buffer,
 
   INITIALIZE_ITER (insert, buffer, prev, node->len);
   node->len += len;
+  node->n_chars += g_utf8_strlen (text, len);
+  _mech_text_buffer_node_sync (node, _mech_text_buffer_node_breaks (node));
 
   return TRUE;
 }
 
+/* Returns the end of the paragraph starting at str, line
+ * terminators are all ASCII or start with a byte that never
+ * appears within other UTF-8 sequences, so bytes are scanned.
+ */
 static const gchar *
-_find_next_paragraph_break (const gchar *string)
+_find_paragraph_end (const gchar *str,
+                     const gchar *end)
 {
   gboolean last_was_break = FALSE;
-  const gchar *str = string;
-  gunichar ch;
+  const guchar *p;
 
-  if (!string || !*string)
-    return NULL;
+  p = (const guchar *) g_utf8_next_char (str);
 
-  while (str && *str &&
-         (str = g_utf8_next_char (str)) != NULL)
+  while (p < (const guchar *) end)
     {
-      ch = g_utf8_get_char (str);
-
-      if (_text_buffer_is_line_terminator (ch))
-        last_was_break = TRUE;
+      if (*p == '\n' || *p == '\r')
+        {
+          last_was_break = TRUE;
+          p++;
+        }
+      else if (*p == 0xe2 && (const gchar *) p + 2 < end &&
+               p[1] == 0x80 && p[2] == 0xa9)
+        {
+          last_was_break = TRUE;
+          p += 3;
+        }
       else if (last_was_break)
         break;
+      else
+        p++;
+    }
+
+  return MIN ((const gchar *) p, end);
+}
+
+static void
+_text_buffer_load_nodes (MechTextBuffer   *buffer,
+                         MechStoredString *stored,
+                         MechTextIter     *start,
+                         MechTextIter     *end)
+{
+  MechTextBufferPrivate *priv;
+  const gchar *str, *next, *str_end;
+  GSequenceIter *end_iter;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  end_iter = g_sequence_get_end_iter (priv->buffer);
+  str = stored->str;
+  str_end = stored->str + stored->len;
+
+  /* Buffer is empty here, so every paragraph is a single
+   * node appended at the end, with no neighbours to check.
+   */
+  while (str < str_end)
+    {
+      MechTextUserData *paragraph;
+      MechTextBufferNode *node;
+
+      next = _find_paragraph_end (str, str_end);
+      node = _mech_text_buffer_node_new (stored, str - stored->str,
+                                         next - str, NULL);
+      paragraph = _text_buffer_next_paragraph (buffer);
+      _mech_text_buffer_node_set_data (node, buffer,
+                                       priv->paragraph_break_id,
+                                       paragraph);
+      _mech_text_user_data_unref (paragraph);
+
+      _mech_text_buffer_insert_node (buffer, end_iter, node);
+      _mech_text_buffer_node_sync (node, TRUE);
+      str = next;
     }
 
-  return str;
+  INITIALIZE_ITER (start, buffer, g_sequence_get_begin_iter (priv->buffer), 0);
+  INITIALIZE_ITER (end, buffer, end_iter, 0);
 }
 
 static void
@@ -889,16 +1500,21 @@ _mech_text_buffer_check_reunite_nodes (MechTextBuffer *buffer,
       node = g_sequence_get (start->iter);
       check = g_sequence_get (check_iter);
 
-      if (node != check &&
-          NODE_STRING_POS (check, check->len + 1) == NODE_STRING (node) &&
+      if (node != check && check->stored == node->stored &&
+          NODE_STRING_POS (check, check->len) == NODE_STRING (node) &&
           _mech_text_buffer_node_data_equals (node, check))
         {
           gboolean same_position;
 
           same_position = start->iter == end->iter;
-          new_iter_pos = check->len + 1;
+          new_iter_pos = check->len;
           check->len += node->len;
-          g_sequence_remove (start->iter);
+          check->n_chars += node->n_chars;
+          _mech_text_buffer_node_sync (check,
+                                       _mech_text_buffer_node_breaks (node));
+          _mech_text_buffer_join_marks (buffer, start->iter,
+                                        check_iter, new_iter_pos);
+          _mech_text_buffer_remove_node (buffer, start->iter);
           INITIALIZE_ITER (start, buffer, check_iter, new_iter_pos);
 
           /* No need to check the end iter */
@@ -914,87 +1530,516 @@ _mech_text_buffer_check_reunite_nodes (MechTextBuffer *buffer,
       node = g_sequence_get (end->iter);
       check = g_sequence_get (check_iter);
 
-      if (node != check &&
-          NODE_STRING_POS (check, check->len + 1) == NODE_STRING (node) &&
+      if (node != check && check->stored == node->stored &&
+          NODE_STRING_POS (check, check->len) == NODE_STRING (node) &&
           _mech_text_buffer_node_data_equals (node, check))
         {
-          new_iter_pos = check->len + 1;
+          new_iter_pos = check->len;
           check->len += node->len;
-          g_sequence_remove (end->iter);
+          check->n_chars += node->n_chars;
+          _mech_text_buffer_node_sync (check,
+                                       _mech_text_buffer_node_breaks (node));
+          _mech_text_buffer_join_marks (buffer, end->iter,
+                                        check_iter, new_iter_pos);
+          _mech_text_buffer_remove_node (buffer, end->iter);
           INITIALIZE_ITER (end, buffer, check_iter, new_iter_pos);
         }
     }
 }
 
+/* Merges every run of reunitable nodes between the node
+ * before start and end, both included.
+ */
 static void
-mech_text_buffer_finalize (GObject *object)
+_mech_text_buffer_reunite_range (MechTextBuffer *buffer,
+                                 GSequenceIter  *start,
+                                 GSequenceIter  *end)
 {
-  MechTextBufferPrivate *priv;
+  MechTextBufferNode *node, *check;
+  GSequenceIter *check_iter, *iter;
+  gboolean last;
+  gsize offset;
 
-  priv = mech_text_buffer_get_instance_private ((MechTextBuffer *) object);
-  mech_text_buffer_unregister_data ((MechTextBuffer *) object,
-                                    object, priv->paragraph_break_id);
+  check_iter = start;
 
-  g_array_unref (priv->registered_data);
-  g_array_unref (priv->marks);
-  g_sequence_free (priv->buffer);
-  g_ptr_array_unref (priv->strings);
+  if (!g_sequence_iter_is_begin (start))
+    check_iter = g_sequence_iter_prev (start);
 
-  G_OBJECT_CLASS (mech_text_buffer_parent_class)->finalize (object);
+  while (check_iter != end && !g_sequence_iter_is_end (check_iter))
+    {
+      iter = g_sequence_iter_next (check_iter);
+
+      if (g_sequence_iter_is_end (iter))
+        break;
+
+      check = g_sequence_get (check_iter);
+      node = g_sequence_get (iter);
+
+      if (check->stored != node->stored ||
+          NODE_STRING_POS (check, check->len) != NODE_STRING (node) ||
+          !_mech_text_buffer_node_data_equals (node, check))
+        {
+          check_iter = iter;
+          continue;
+        }
+
+      last = iter == end;
+      offset = check->len;
+      check->len += node->len;
+      check->n_chars += node->n_chars;
+      _mech_text_buffer_node_sync (check,
+                                   _mech_text_buffer_node_breaks (node));
+      _mech_text_buffer_join_marks (buffer, iter, check_iter, offset);
+      _mech_text_buffer_remove_node (buffer, iter);
+
+      if (last)
+        break;
+    }
 }
 
-static void
-_mech_text_buffer_insert_impl (MechTextBuffer *buffer,
-                               MechTextIter   *start,
-                               MechTextIter   *end,
-                               const gchar    *text,
-                               gulong          len)
+static gboolean
+_text_buffer_history_enabled (MechTextBuffer *buffer)
 {
-  GSequenceIter *insert_pos, *last = NULL;
-  MechTextBufferNode *new, *node = NULL;
-  MechStoredString *stored = NULL;
-  MechTextUserData *paragraph;
   MechTextBufferPrivate *priv;
-  GArray *data_array = NULL;
-  gboolean is_first = TRUE;
-  const gchar *str, *next;
-  MechTextIter insert;
 
   priv = mech_text_buffer_get_instance_private (buffer);
-  insert = *start;
 
-  if (!g_sequence_iter_is_end (insert.iter))
+  return (priv->max_history_size > 0 &&
+          !priv->applying_history &&
+          !priv->loading);
+}
+
+static void
+_text_undo_pieces_free (GArray *pieces)
+{
+  MechTextUndoPiece *piece;
+  guint i;
+
+  for (i = 0; i < pieces->len; i++)
     {
-      node = g_sequence_get (insert.iter);
-      g_return_if_fail (insert.pos <= node->len);
+      piece = &g_array_index (pieces, MechTextUndoPiece, i);
+      _mech_stored_string_release (piece->stored);
     }
 
-  stored = _text_buffer_intern_string (buffer, &insert, text,
-                                       len, &str);
+  g_array_unref (pieces);
+}
 
-  /* Find insertion point */
-  if (!node || insert.pos == 0)
-    {
-      insert_pos = insert.iter;
-      next = _find_next_paragraph_break (str);
+/* Takes over the stored string reference held by piece */
+static void
+_text_undo_pieces_add (GArray            *pieces,
+                       MechTextUndoPiece *piece,
+                       gboolean           prepend)
+{
+  MechTextUndoPiece *other;
 
-      /* Check whether part/all of the string
-       * can be appended to the previous node
-       */
-      if (_text_buffer_check_node_append (buffer, start, str, next - str))
+  if (pieces->len > 0)
+    {
+      if (prepend)
         {
-          is_first = FALSE;
-          last = insert_pos;
-          str = next;
+          other = &g_array_index (pieces, MechTextUndoPiece, 0);
+
+          if (other->stored == piece->stored &&
+              piece->pos + piece->len == other->pos)
+            {
+              other->pos = piece->pos;
+              other->len += piece->len;
+              _mech_stored_string_release (piece->stored);
+              return;
+            }
         }
+      else
+        {
+          other = &g_array_index (pieces, MechTextUndoPiece, pieces->len - 1);
 
-      data_array =
-        _mech_text_buffer_node_intersect_data (insert_pos,
-                                               g_sequence_iter_prev (insert_pos));
+          if (other->stored == piece->stored &&
+              other->pos + other->len == piece->pos)
+            {
+              other->len += piece->len;
+              _mech_stored_string_release (piece->stored);
+              return;
+            }
+        }
     }
-  else if (insert.pos == node->len)
-    {
-      insert_pos = g_sequence_iter_next (insert.iter);
+
+  if (prepend)
+    g_array_prepend_val (pieces, *piece);
+  else
+    g_array_append_val (pieces, *piece);
+}
+
+static GArray *
+_text_buffer_history_collect (MechTextBuffer     *buffer,
+                              const MechTextIter *start,
+                              const MechTextIter *end,
+                              gsize              *len)
+{
+  MechTextUndoPiece piece;
+  MechTextBufferNode *node;
+  GSequenceIter *iter;
+  GArray *pieces;
+  gsize piece_end;
+
+  pieces = g_array_new (FALSE, FALSE, sizeof (MechTextUndoPiece));
+  *len = 0;
+
+  for (iter = start->iter;
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      node = g_sequence_get (iter);
+      piece.stored = node->stored;
+      piece.pos = node->pos;
+      piece_end = node->pos + node->len;
+
+      if (iter == start->iter)
+        piece.pos += start->pos;
+      if (iter == end->iter)
+        piece_end = node->pos + end->pos;
+
+      if (piece_end > piece.pos)
+        {
+          piece.len = piece_end - piece.pos;
+          *len += piece.len;
+          _mech_stored_string_hold (piece.stored);
+          _text_undo_pieces_add (pieces, &piece, FALSE);
+        }
+
+      if (iter == end->iter)
+        break;
+    }
+
+  return pieces;
+}
+
+static void
+_text_undo_action_free (MechTextUndoAction *action)
+{
+  MechTextUndoRecord *record;
+  guint i;
+
+  for (i = 0; i < action->records->len; i++)
+    {
+      record = &g_array_index (action->records, MechTextUndoRecord, i);
+      _text_undo_pieces_free (record->pieces);
+    }
+
+  g_array_unref (action->records);
+  g_slice_free (MechTextUndoAction, action);
+}
+
+static void
+_text_buffer_history_clear_redo (MechTextBuffer *buffer)
+{
+  MechTextBufferPrivate *priv;
+  MechTextUndoAction *action;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  while ((action = g_queue_pop_head (&priv->redo_stack)) != NULL)
+    {
+      priv->history_size -= action->size;
+      _text_undo_action_free (action);
+    }
+}
+
+static void
+_text_buffer_history_clear (MechTextBuffer *buffer)
+{
+  MechTextBufferPrivate *priv;
+  MechTextUndoAction *action;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  _text_buffer_history_clear_redo (buffer);
+
+  while ((action = g_queue_pop_head (&priv->undo_stack)) != NULL)
+    _text_undo_action_free (action);
+
+  priv->group_action = NULL;
+  priv->history_size = 0;
+}
+
+static void
+_text_buffer_history_trim (MechTextBuffer *buffer)
+{
+  MechTextBufferPrivate *priv;
+  MechTextUndoAction *action;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  /* Drop the oldest actions first, the one
+   * being grouped is kept until it's done.
+   */
+  while (priv->history_size > priv->max_history_size)
+    {
+      action = g_queue_peek_tail (&priv->undo_stack);
+
+      if (!action || action == priv->group_action)
+        break;
+
+      g_queue_pop_tail (&priv->undo_stack);
+      priv->history_size -= action->size;
+      _text_undo_action_free (action);
+    }
+}
+
+static gboolean
+_text_undo_record_merge (MechTextUndoRecord *record,
+                         gboolean            is_insert,
+                         gsize               offset,
+                         gsize               len,
+                         GArray             *pieces)
+{
+  gboolean prepend;
+  guint i;
+
+  if (record->is_insert != is_insert)
+    return FALSE;
+
+  if (is_insert)
+    {
+      /* Typing forward */
+      if (offset != record->offset + record->len)
+        return FALSE;
+
+      prepend = FALSE;
+    }
+  else if (offset + len == record->offset)
+    {
+      /* Backspacing */
+      record->offset = offset;
+      prepend = TRUE;
+    }
+  else if (offset == record->offset)
+    {
+      /* Deleting forward */
+      prepend = FALSE;
+    }
+  else
+    return FALSE;
+
+  if (prepend)
+    {
+      for (i = pieces->len; i > 0; i--)
+        _text_undo_pieces_add (record->pieces,
+                               &g_array_index (pieces, MechTextUndoPiece, i - 1),
+                               TRUE);
+    }
+  else
+    {
+      for (i = 0; i < pieces->len; i++)
+        _text_undo_pieces_add (record->pieces,
+                               &g_array_index (pieces, MechTextUndoPiece, i),
+                               FALSE);
+    }
+
+  record->len += len;
+
+  /* References were taken over by the record */
+  g_array_unref (pieces);
+
+  return TRUE;
+}
+
+static gboolean
+_text_undo_pieces_break_paragraph (GArray *pieces)
+{
+  MechTextUndoPiece *piece;
+  guint i;
+
+  for (i = 0; i < pieces->len; i++)
+    {
+      piece = &g_array_index (pieces, MechTextUndoPiece, i);
+
+      if (_find_paragraph_end (piece->stored->str + piece->pos,
+                               piece->stored->str + piece->pos + piece->len) <
+          piece->stored->str + piece->pos + piece->len)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+_text_buffer_history_record (MechTextBuffer *buffer,
+                             gboolean        is_insert,
+                             gsize           offset,
+                             gsize           len,
+                             GArray         *pieces)
+{
+  MechTextUndoRecord *last = NULL, record;
+  MechTextBufferPrivate *priv;
+  MechTextUndoAction *action;
+  gboolean coalesce;
+  gsize size;
+  gint64 now;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  _text_buffer_history_clear_redo (buffer);
+  now = g_get_monotonic_time ();
+
+  if (priv->user_action_depth > 0)
+    {
+      action = priv->group_action;
+      coalesce = action != NULL;
+    }
+  else
+    {
+      /* Coalesce keystroke sized edits happening in a row,
+       * a paragraph break starts a new action.
+       */
+      action = g_queue_peek_head (&priv->undo_stack);
+      coalesce = (action && !action->sealed &&
+                  len <= HISTORY_COALESCE_MAX_BYTES &&
+                  now - action->time < HISTORY_COALESCE_TIMEOUT &&
+                  !_text_undo_pieces_break_paragraph (pieces));
+    }
+
+  if (coalesce && action->records->len > 0)
+    last = &g_array_index (action->records, MechTextUndoRecord,
+                           action->records->len - 1);
+
+  if (last && _text_undo_record_merge (last, is_insert, offset, len, pieces))
+    size = len;
+  else
+    {
+      size = 0;
+
+      /* Outside groups, only contiguous edits share an action */
+      if (!coalesce || priv->user_action_depth == 0)
+        {
+          if ((action = g_queue_peek_head (&priv->undo_stack)) != NULL)
+            action->sealed = TRUE;
+
+          action = g_slice_new0 (MechTextUndoAction);
+          action->records = g_array_new (FALSE, FALSE,
+                                         sizeof (MechTextUndoRecord));
+          g_queue_push_head (&priv->undo_stack, action);
+          size += sizeof (MechTextUndoAction);
+
+          if (priv->user_action_depth > 0)
+            priv->group_action = action;
+        }
+
+      record.is_insert = is_insert;
+      record.offset = offset;
+      record.len = len;
+      record.pieces = pieces;
+      g_array_append_val (action->records, record);
+      size += len + sizeof (MechTextUndoRecord);
+    }
+
+  action->size += size;
+  priv->history_size += size;
+  action->time = now;
+  _text_buffer_history_trim (buffer);
+}
+
+static void
+mech_text_buffer_finalize (GObject *object)
+{
+  MechTextBufferPrivate *priv;
+
+  priv = mech_text_buffer_get_instance_private ((MechTextBuffer *) object);
+  mech_text_buffer_unregister_data ((MechTextBuffer *) object,
+                                    object, priv->paragraph_break_id);
+  _text_buffer_history_clear ((MechTextBuffer *) object);
+
+  if (priv->flush_id)
+    g_source_remove (priv->flush_id);
+  if (priv->pending)
+    g_string_free (priv->pending, TRUE);
+
+  g_array_unref (priv->registered_data);
+  g_hash_table_unref (priv->marks);
+
+  if (priv->end_marks)
+    g_ptr_array_unref (priv->end_marks);
+
+  _mech_text_tree_free (priv->tree);
+  g_sequence_free (priv->buffer);
+  g_ptr_array_unref (priv->strings);
+
+  G_OBJECT_CLASS (mech_text_buffer_parent_class)->finalize (object);
+}
+
+static void
+_mech_text_buffer_insert_impl (MechTextBuffer *buffer,
+                               MechTextIter   *start,
+                               MechTextIter   *end,
+                               const gchar    *text,
+                               gulong          len)
+{
+  GSequenceIter *insert_pos, *last = NULL;
+  MechTextBufferNode *new, *node = NULL;
+  MechStoredString *stored = NULL;
+  MechTextUserData *paragraph;
+  MechTextBufferPrivate *priv;
+  const gchar *str, *str_end, *next;
+  GArray *data_array = NULL;
+  gboolean is_first = TRUE;
+  MechTextUndoPiece piece;
+  GArray *pieces = NULL;
+  MechTextIter insert;
+  gsize offset = 0;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (priv->loading)
+    {
+      _text_buffer_load_nodes (buffer, priv->loading, start, end);
+      return;
+    }
+
+  if (_text_buffer_history_enabled (buffer))
+    offset = _text_buffer_iter_get_offset (buffer, start,
+                                           MECH_TEXT_TREE_BYTES);
+  insert = *start;
+
+  if (!g_sequence_iter_is_end (insert.iter))
+    {
+      node = g_sequence_get (insert.iter);
+      g_return_if_fail (insert.pos <= node->len);
+    }
+
+  stored = _text_buffer_intern_string (buffer, &insert, text,
+                                       len, &str);
+  str_end = str + len;
+
+  if (_text_buffer_history_enabled (buffer))
+    {
+      /* The inserted text is a single stored piece */
+      piece.stored = stored;
+      piece.pos = str - stored->str;
+      piece.len = len;
+      _mech_stored_string_hold (stored);
+
+      pieces = g_array_new (FALSE, FALSE, sizeof (MechTextUndoPiece));
+      g_array_append_val (pieces, piece);
+    }
+
+  /* Find insertion point */
+  if (!node || insert.pos == 0)
+    {
+      insert_pos = insert.iter;
+      next = _find_paragraph_end (str, str_end);
+
+      /* Check whether part/all of the string
+       * can be appended to the previous node
+       */
+      if (_text_buffer_check_node_append (buffer, start, str, next - str))
+        {
+          is_first = FALSE;
+          last = insert_pos;
+          str = next;
+        }
+
+      data_array =
+        _mech_text_buffer_node_intersect_data (insert_pos,
+                                               g_sequence_iter_prev (insert_pos));
+    }
+  else if (insert.pos == node->len)
+    {
+      insert_pos = g_sequence_iter_next (insert.iter);
       data_array = _mech_text_buffer_node_intersect_data (insert.iter,
 							  insert_pos);
     }
@@ -1007,16 +2052,18 @@ _mech_text_buffer_insert_impl (MechTextBuffer *buffer,
 
   paragraph = _text_buffer_find_paragraph (buffer, &insert);
 
-  while ((next = _find_next_paragraph_break (str)) != NULL)
+  while (str < str_end)
     {
+      next = _find_paragraph_end (str, str_end);
+
       if (paragraph)
         _mech_text_user_data_ref (paragraph);
       else
         paragraph = _text_buffer_next_paragraph (buffer);
 
-      new = _mech_text_buffer_node_new (stored, str - stored->string->str,
+      new = _mech_text_buffer_node_new (stored, str - stored->str,
                                         next - str, data_array);
-      last = g_sequence_insert_before (insert_pos, new);
+      last = _mech_text_buffer_insert_node (buffer, insert_pos, new);
 
       if (is_first)
         {
@@ -1034,6 +2081,7 @@ _mech_text_buffer_insert_impl (MechTextBuffer *buffer,
     }
 
   INITIALIZE_ITER (end, buffer, insert_pos, 0);
+  _mech_text_buffer_update_breaks (buffer, start->iter, end->iter);
 
   /* Check paragraph number on trailing text after
    * the inserted text, as it might have changed
@@ -1042,6 +2090,9 @@ _mech_text_buffer_insert_impl (MechTextBuffer *buffer,
 
   if (data_array)
     g_array_unref (data_array);
+
+  if (pieces)
+    _text_buffer_history_record (buffer, TRUE, offset, len, pieces);
 }
 
 static void
@@ -1050,6 +2101,15 @@ _mech_text_buffer_delete_impl (MechTextBuffer *buffer,
                                MechTextIter   *end)
 {
   GSequenceIter *delete_start, *delete_end;
+  GArray *pieces = NULL;
+  gsize offset, len;
+
+  if (_text_buffer_history_enabled (buffer))
+    {
+      offset = _text_buffer_iter_get_offset (buffer, start,
+                                             MECH_TEXT_TREE_BYTES);
+      pieces = _text_buffer_history_collect (buffer, start, end, &len);
+    }
 
   _mech_text_buffer_node_split (buffer, end->iter, end->pos, &delete_end);
   _mech_text_buffer_node_split (buffer, start->iter, start->pos, &delete_start);
@@ -1058,7 +2118,11 @@ _mech_text_buffer_delete_impl (MechTextBuffer *buffer,
   /* Both iters point now to the same position */
   INITIALIZE_ITER (start, buffer, delete_end, 0);
   INITIALIZE_ITER (end, buffer, delete_end, 0);
+  _mech_text_buffer_update_breaks (buffer, delete_end, delete_end);
   _text_buffer_check_trailing_paragraph (buffer, end, end);
+
+  if (pieces)
+    _text_buffer_history_record (buffer, FALSE, offset, len, pieces);
 }
 
 static void
@@ -1071,17 +2135,21 @@ mech_text_buffer_class_init (MechTextBufferClass *klass)
   klass->insert = _mech_text_buffer_insert_impl;
   klass->delete = _mech_text_buffer_delete_impl;
 
+  /* The inserted text is passed as a pointer, it may point
+   * into stored or mapped contents, and is not nul-terminated,
+   * handlers must only read the given length.
+   */
   signals[INSERT] =
     g_signal_new ("insert",
                   G_TYPE_FROM_CLASS (klass),
                   G_SIGNAL_RUN_LAST,
                   G_STRUCT_OFFSET (MechTextBufferClass, insert),
                   NULL, NULL,
-                  _mech_marshal_VOID__BOXED_BOXED_STRING_ULONG,
+                  _mech_marshal_VOID__BOXED_BOXED_POINTER_ULONG,
                   G_TYPE_NONE, 4,
                   MECH_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
                   MECH_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
-		  G_TYPE_STRING, G_TYPE_ULONG);
+		  G_TYPE_POINTER, G_TYPE_ULONG);
   signals[DELETE] =
     g_signal_new ("delete",
                   G_TYPE_FROM_CLASS (klass),
@@ -1103,7 +2171,10 @@ mech_text_buffer_init (MechTextBuffer *buffer)
   priv->strings =
     g_ptr_array_new_with_free_func ((GDestroyNotify) _mech_stored_string_free);
   priv->buffer = g_sequence_new ((GDestroyNotify) _mech_text_buffer_node_free);
-  priv->marks = g_array_new (FALSE, FALSE, sizeof (MechTextBufferMark));
+  priv->tree = _mech_text_tree_new ();
+  priv->marks =
+    g_hash_table_new_full (NULL, NULL, NULL,
+                           (GDestroyNotify) _mech_text_mark_free);
   priv->registered_data =
     g_array_new (FALSE, FALSE, sizeof (MechTextRegisteredData));
   priv->paragraph_break_id =
@@ -1116,50 +2187,345 @@ mech_text_buffer_new (void)
   return g_object_new (MECH_TYPE_TEXT_BUFFER, NULL);
 }
 
-void
-mech_text_buffer_set_text (MechTextBuffer *buffer,
-                           const gchar    *text,
-                           gint            len)
+static void
+_text_buffer_apply_max_paragraphs (MechTextBuffer *buffer)
 {
+  MechTextBufferPrivate *priv;
   MechTextIter start, end;
+  gsize n_paragraphs;
 
-  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
-  g_return_if_fail (text != NULL);
+  priv = mech_text_buffer_get_instance_private (buffer);
 
-  mech_text_buffer_get_bounds (buffer, &start, &end);
-  mech_text_buffer_delete (buffer, &start, &end);
+  if (priv->max_paragraphs == 0)
+    return;
 
-  mech_text_buffer_get_bounds (buffer, &start, NULL);
-  mech_text_buffer_insert (buffer, &start, text, len);
-}
+  n_paragraphs = _mech_text_tree_get_total (priv->tree,
+                                            MECH_TEXT_TREE_PARAGRAPHS);
+  if (n_paragraphs <= priv->max_paragraphs)
+    return;
 
-gint
-mech_text_buffer_iter_compare (const MechTextIter *a,
-                               const MechTextIter *b)
-{
-  if (a->iter == b->iter)
-    return a->pos - b->pos;
-  else
-    return g_sequence_iter_compare (a->iter, b->iter);
+  /* Drop the oldest paragraphs in one go */
+  mech_text_buffer_get_bounds (buffer, &start, NULL);
+  _text_buffer_get_paragraph_start (buffer,
+                                    n_paragraphs - priv->max_paragraphs,
+                                    &end);
+  mech_text_buffer_delete (buffer, &start, &end);
 }
 
 static void
-_mech_text_iter_ensure_order (MechTextBuffer     *buffer,
-                              const MechTextIter *a,
-                              const MechTextIter *b,
-                              MechTextIter       *minor_ret,
-                              MechTextIter       *major_ret)
+_text_buffer_flush_appends (MechTextBuffer *buffer)
 {
-  if (!a || !b)
-    mech_text_buffer_get_bounds (buffer, minor_ret, major_ret);
+  MechTextBufferPrivate *priv;
+  MechTextIter end;
+  GString *pending;
 
-  if (a)
-    *minor_ret = *a;
+  priv = mech_text_buffer_get_instance_private (buffer);
 
-  if (b)
-    *major_ret = *b;
+  if (priv->flush_id)
+    {
+      g_source_remove (priv->flush_id);
+      priv->flush_id = 0;
+    }
 
-  if (mech_text_buffer_iter_compare (minor_ret, major_ret) > 0)
+  if (priv->pending)
+    {
+      pending = priv->pending;
+      priv->pending = NULL;
+
+      mech_text_buffer_get_bounds (buffer, NULL, &end);
+      mech_text_buffer_insert (buffer, &end, pending->str, pending->len);
+      g_string_free (pending, TRUE);
+    }
+
+  _text_buffer_apply_max_paragraphs (buffer);
+}
+
+static gboolean
+_text_buffer_flush_appends_idle (gpointer user_data)
+{
+  MechTextBufferPrivate *priv;
+
+  priv = mech_text_buffer_get_instance_private (user_data);
+  priv->flush_id = 0;
+  _text_buffer_flush_appends (user_data);
+
+  return FALSE;
+}
+
+/* Commits pending appends ahead of an edit. The edit
+ * iters keep their byte offsets, and trimming to
+ * max_paragraphs is left to the idle flush, as it
+ * would invalidate the caller iters.
+ */
+static void
+_text_buffer_flush_appends_for_edit (MechTextBuffer *buffer,
+                                     MechTextIter   *iter1,
+                                     MechTextIter   *iter2)
+{
+  MechTextBufferPrivate *priv;
+  gsize offset1 = 0, offset2 = 0;
+  MechTextIter end;
+  GString *pending;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (!priv->pending)
+    return;
+
+  if (iter1)
+    offset1 = _text_buffer_iter_get_offset (buffer, iter1,
+                                            MECH_TEXT_TREE_BYTES);
+  if (iter2)
+    offset2 = _text_buffer_iter_get_offset (buffer, iter2,
+                                            MECH_TEXT_TREE_BYTES);
+
+  pending = priv->pending;
+  priv->pending = NULL;
+
+  mech_text_buffer_get_bounds (buffer, NULL, &end);
+  mech_text_buffer_insert (buffer, &end, pending->str, pending->len);
+  g_string_free (pending, TRUE);
+
+  if (iter1)
+    _text_buffer_get_iter_at_byte_offset (buffer, offset1, iter1);
+  if (iter2)
+    _text_buffer_get_iter_at_byte_offset (buffer, offset2, iter2);
+
+  if (!priv->flush_id && priv->max_paragraphs > 0)
+    priv->flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                      _text_buffer_flush_appends_idle,
+                                      buffer, NULL);
+}
+
+void
+mech_text_buffer_set_text (MechTextBuffer *buffer,
+                           const gchar    *text,
+                           gint            len)
+{
+  MechTextIter start, end;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (text != NULL);
+
+  mech_text_buffer_get_bounds (buffer, &start, &end);
+  mech_text_buffer_delete (buffer, &start, &end);
+
+  mech_text_buffer_get_bounds (buffer, &start, NULL);
+  mech_text_buffer_insert (buffer, &start, text, len);
+}
+
+static void
+_text_buffer_load_stored (MechTextBuffer   *buffer,
+                          MechStoredString *stored)
+{
+  MechTextBufferPrivate *priv;
+  MechTextIter start, end;
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  mech_text_buffer_get_bounds (buffer, &start, &end);
+  mech_text_buffer_delete (buffer, &start, &end);
+
+  if (stored->len == 0)
+    {
+      _mech_stored_string_clear (stored);
+      return;
+    }
+
+  /* Emit a single insertion for the whole contents, the
+   * default handler builds the nodes from the stored string
+   */
+  mech_text_buffer_get_bounds (buffer, &start, NULL);
+  end = start;
+
+  priv->loading = stored;
+  g_signal_emit (buffer, signals[INSERT], 0, &start, &end,
+                 stored->str, (gulong) stored->len);
+  priv->loading = NULL;
+
+  if (stored->node_count == 0)
+    _mech_stored_string_clear (stored);
+
+  /* A freshly loaded buffer has no history */
+  _text_buffer_history_clear (buffer);
+}
+
+void
+mech_text_buffer_append (MechTextBuffer *buffer,
+                         const gchar    *text,
+                         gssize          len)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (text != NULL);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (len < 0)
+    len = strlen (text);
+
+  if (len == 0)
+    return;
+
+  /* Appends are coalesced into a single insertion,
+   * committed before the next frame is processed.
+   */
+  if (!priv->pending)
+    priv->pending = g_string_sized_new (len);
+
+  g_string_append_len (priv->pending, text, len);
+
+  if (!priv->flush_id)
+    priv->flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                                      _text_buffer_flush_appends_idle,
+                                      buffer, NULL);
+}
+
+void
+mech_text_buffer_flush_appends (MechTextBuffer *buffer)
+{
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+
+  _text_buffer_flush_appends (buffer);
+}
+
+void
+mech_text_buffer_set_max_paragraphs (MechTextBuffer *buffer,
+                                     guint           max_paragraphs)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  priv->max_paragraphs = max_paragraphs;
+  _text_buffer_apply_max_paragraphs (buffer);
+}
+
+guint
+mech_text_buffer_get_max_paragraphs (MechTextBuffer *buffer)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return priv->max_paragraphs;
+}
+
+gboolean
+mech_text_buffer_load_from_stream (MechTextBuffer  *buffer,
+                                   GInputStream    *stream,
+                                   GCancellable    *cancellable,
+                                   GError         **error)
+{
+  MechStoredString *stored;
+  const gchar *invalid;
+  GString *string;
+  gssize n_read;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+
+  string = g_string_sized_new (LOAD_CHUNK_SIZE);
+
+  do
+    {
+      g_string_set_size (string, string->len + LOAD_CHUNK_SIZE);
+      n_read = g_input_stream_read (stream,
+                                    string->str + string->len - LOAD_CHUNK_SIZE,
+                                    LOAD_CHUNK_SIZE, cancellable, error);
+      if (n_read < 0)
+        {
+          g_string_free (string, TRUE);
+          return FALSE;
+        }
+
+      g_string_set_size (string, string->len - LOAD_CHUNK_SIZE + n_read);
+    }
+  while (n_read > 0);
+
+  if (!g_utf8_validate (string->str, string->len, &invalid))
+    {
+      g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                   "Invalid UTF-8 at offset %" G_GSIZE_FORMAT,
+                   (gsize) (invalid - string->str));
+      g_string_free (string, TRUE);
+      return FALSE;
+    }
+
+  stored = _mech_stored_string_alloc (buffer);
+  stored->string = string;
+  stored->str = string->str;
+  stored->len = string->len;
+  _text_buffer_load_stored (buffer, stored);
+
+  return TRUE;
+}
+
+gboolean
+mech_text_buffer_load_from_mapped_file (MechTextBuffer  *buffer,
+                                        GMappedFile     *file,
+                                        GError         **error)
+{
+  const gchar *contents, *invalid;
+  MechTextIter start, end;
+  gsize len;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (file != NULL, FALSE);
+
+  contents = g_mapped_file_get_contents (file);
+  len = g_mapped_file_get_length (file);
+
+  if (len == 0)
+    {
+      mech_text_buffer_get_bounds (buffer, &start, &end);
+      mech_text_buffer_delete (buffer, &start, &end);
+      return TRUE;
+    }
+
+  if (!g_utf8_validate (contents, len, &invalid))
+    {
+      g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                   "Invalid UTF-8 at offset %" G_GSIZE_FORMAT,
+                   (gsize) (invalid - contents));
+      return FALSE;
+    }
+
+  /* Nodes reference the mapped contents directly */
+  _text_buffer_load_stored (buffer,
+                            _mech_stored_string_new_mapped (buffer, file));
+  return TRUE;
+}
+
+gint
+mech_text_buffer_iter_compare (const MechTextIter *a,
+                               const MechTextIter *b)
+{
+  if (a->iter == b->iter)
+    return a->pos - b->pos;
+  else
+    return g_sequence_iter_compare (a->iter, b->iter);
+}
+
+static void
+_mech_text_iter_ensure_order (MechTextBuffer     *buffer,
+                              const MechTextIter *a,
+                              const MechTextIter *b,
+                              MechTextIter       *minor_ret,
+                              MechTextIter       *major_ret)
+{
+  if (!a || !b)
+    mech_text_buffer_get_bounds (buffer, minor_ret, major_ret);
+
+  if (a)
+    *minor_ret = *a;
+
+  if (b)
+    *major_ret = *b;
+
+  if (mech_text_buffer_iter_compare (minor_ret, major_ret) > 0)
     {
       MechTextIter tmp;
 
@@ -1291,6 +2657,7 @@ mech_text_buffer_delete (MechTextBuffer *buffer,
   g_return_if_fail (!start || IS_VALID_ITER (start, buffer));
   g_return_if_fail (!end || IS_VALID_ITER (end, buffer));
 
+  _text_buffer_flush_appends_for_edit (buffer, start, end);
   _mech_text_iter_ensure_order (buffer, start, end, &minor, &major);
 
   if (g_sequence_iter_is_end (minor.iter) ||
@@ -1324,6 +2691,7 @@ mech_text_buffer_insert (MechTextBuffer *buffer,
   if (len == 0)
     return;
 
+  _text_buffer_flush_appends_for_edit (buffer, iter, NULL);
   start = end = *iter;
   g_signal_emit (buffer, signals[INSERT], 0, &start, &end, text, (gulong) len);
   *iter = end;
@@ -1538,8 +2906,9 @@ mech_text_buffer_set_data (MechTextBuffer *buffer,
                            ...)
 {
   MechTextIter minor, major;
+  GPtrArray *user_data;
   va_list varargs;
-  gboolean retval;
+  GArray *ids;
   guint id;
 
   g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
@@ -1552,11 +2921,12 @@ mech_text_buffer_set_data (MechTextBuffer *buffer,
   va_start (varargs, end);
   id = va_arg (varargs, gint);
   _mech_text_iter_ensure_order (buffer, start, end, &minor, &major);
+  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  user_data = g_ptr_array_new_with_free_func ((GDestroyNotify) _mech_text_user_data_unref);
 
   while (id)
     {
       MechTextRegisteredData *registered;
-      MechTextUserData *user_data;
       GValue value = { 0 };
       gchar *error;
 
@@ -1578,21 +2948,23 @@ mech_text_buffer_set_data (MechTextBuffer *buffer,
 	  break;
 	}
 
-      /* FIXME: should we better precompute a user
-       * data array and store it in one go? */
-      user_data = _mech_text_user_data_new (&value);
-      retval = _mech_text_buffer_store_user_data (buffer, &minor, &major,
-                                                  id, user_data);
-      _mech_text_user_data_unref (user_data);
+      g_array_append_val (ids, id);
+      g_ptr_array_add (user_data, _mech_text_user_data_new (&value));
       g_value_unset (&value);
 
-      if (!retval)
-        break;
-
       id = va_arg (varargs, gint);
     }
 
-  _mech_text_buffer_check_reunite_nodes (buffer, &minor, &major);
+  /* Split the range once, and store all data in one go */
+  if (ids->len > 0 &&
+      _mech_text_buffer_store_user_data_array (buffer, &minor, &major,
+                                               (guint *) ids->data,
+                                               (MechTextUserData **) user_data->pdata,
+                                               ids->len))
+    _mech_text_buffer_check_reunite_nodes (buffer, &minor, &major);
+
+  g_ptr_array_unref (user_data);
+  g_array_unref (ids);
   va_end (varargs);
 
   if (start)
@@ -1602,103 +2974,251 @@ mech_text_buffer_set_data (MechTextBuffer *buffer,
     *end = major;
 }
 
-void
-mech_text_buffer_paragraph_extents (MechTextBuffer     *buffer,
-                                    const MechTextIter *iter,
-                                    MechTextIter       *paragraph_start,
-                                    MechTextIter       *paragraph_end)
+static gint
+_text_data_change_compare (gconstpointer a,
+                           gconstpointer b)
 {
-  MechTextBufferNode *iter_node, *node;
-  GSequenceIter *check_iter;
-  guint para, check;
-
-  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
-  g_return_if_fail (IS_VALID_ITER (iter, buffer));
-
-  if (g_sequence_iter_is_end (iter->iter))
-    {
-      if (paragraph_start)
-        *paragraph_start = *iter;
-      if (paragraph_end)
-        *paragraph_end = *iter;
-      return;
-    }
+  const MechTextDataChange *change1 = a, *change2 = b;
 
-  iter_node = g_sequence_get (iter->iter);
-  para = _mech_text_buffer_node_get_paragraph (buffer, iter_node);
+  if (change1->start != change2->start)
+    return (change1->start < change2->start) ? -1 : 1;
 
-  if (paragraph_start)
-    {
-      check_iter = g_sequence_iter_prev (iter->iter);
-      INITIALIZE_ITER (paragraph_start, buffer, iter->iter, 0);
+  if (change1->end != change2->end)
+    return (change1->end < change2->end) ? -1 : 1;
 
-      while (!g_sequence_iter_is_begin (paragraph_start->iter))
-        {
-          node = g_sequence_get (check_iter);
-          check = _mech_text_buffer_node_get_paragraph (buffer, node);
+  return 0;
+}
 
-          if (check != para)
-            break;
+static MechTextUserData *
+_text_buffer_intern_user_data (GHashTable   *interned,
+                               const GValue *value)
+{
+  MechTextUserData *data, *found;
 
-          paragraph_start->iter = check_iter;
-          check_iter = g_sequence_iter_prev (check_iter);
-        }
-    }
+  data = _mech_text_user_data_new ((GValue *) value);
+  found = g_hash_table_lookup (interned, data);
 
-  if (paragraph_end)
+  if (found)
     {
-      INITIALIZE_ITER (paragraph_end, buffer, iter->iter, 0);
-
-      while (!g_sequence_iter_is_end (paragraph_end->iter))
-        {
-          node = g_sequence_get (paragraph_end->iter);
-          check = _mech_text_buffer_node_get_paragraph (buffer, node);
+      _mech_text_user_data_unref (data);
+      return found;
+    }
 
-          if (check != para)
-            break;
+  /* The table holds a reference until the batch is applied */
+  g_hash_table_add (interned, data);
 
-          paragraph_end->iter = g_sequence_iter_next (paragraph_end->iter);
-        }
-    }
+  return data;
 }
 
-gboolean
-mech_text_buffer_find_forward (MechTextIter     *iter,
-                               MechTextFindFunc  func,
-                               gpointer          user_data)
+static MechTextUserData *
+_text_buffer_find_equal_data (MechTextBuffer   *buffer,
+                              gsize             offset,
+                              guint             id,
+                              MechTextUserData *data)
 {
+  MechTextBufferPrivate *priv;
+  MechTextTreeNode *tree_node;
+  MechTextUserData *other;
   MechTextBufferNode *node;
-  gchar *str;
-  gsize pos;
 
-  g_return_val_if_fail (iter != NULL, FALSE);
-  g_return_val_if_fail (func != NULL, FALSE);
+  priv = mech_text_buffer_get_instance_private (buffer);
+  tree_node = _mech_text_tree_lookup (priv->tree, MECH_TEXT_TREE_BYTES,
+                                      offset, NULL);
+  if (!tree_node)
+    return NULL;
 
-  if (g_sequence_iter_is_end (iter->iter))
-    return FALSE;
+  node = g_sequence_get (_mech_text_tree_node_get_data (tree_node));
+  other = _mech_text_buffer_node_get_data (node, id);
 
-  node = g_sequence_get (iter->iter);
+  if (other && _mech_text_user_data_equal (other, data))
+    return other;
 
-  while (!g_sequence_iter_is_end (iter->iter))
+  return NULL;
+}
+
+void
+mech_text_buffer_set_data_spans (MechTextBuffer         *buffer,
+                                 const MechTextDataSpan *spans,
+                                 guint                   n_spans)
+{
+  MechTextDataChange *change, *other, new;
+  MechTextIter start, end;
+  MechTextUserData *equal;
+  GPtrArray *user_data;
+  GHashTable *interned;
+  GArray *changes, *ids;
+  gsize min_offset, max_offset;
+  guint i, j;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (n_spans == 0 || spans != NULL);
+
+  for (i = 0; i < n_spans; i++)
     {
-      str = g_utf8_next_char (NODE_STRING_POS (node, iter->pos));
-      iter->pos = str - NODE_STRING (node);
+      g_return_if_fail (IS_VALID_ITER (&spans[i].start, buffer));
+      g_return_if_fail (IS_VALID_ITER (&spans[i].end, buffer));
+    }
 
-      if (iter->pos >= node->len)
+  changes = g_array_sized_new (FALSE, FALSE,
+                               sizeof (MechTextDataChange), n_spans);
+  interned = g_hash_table_new_full (_mech_text_user_data_hash,
+                                    _mech_text_user_data_equal,
+                                    (GDestroyNotify) _mech_text_user_data_unref,
+                                    NULL);
+  min_offset = G_MAXSIZE;
+  max_offset = 0;
+
+  /* Iters are turned into offsets upfront, as
+   * applying each change splits nodes around.
+   */
+  for (i = 0; i < n_spans; i++)
+    {
+      new.start = _text_buffer_iter_get_offset (buffer, &spans[i].start,
+                                                MECH_TEXT_TREE_BYTES);
+      new.end = _text_buffer_iter_get_offset (buffer, &spans[i].end,
+                                              MECH_TEXT_TREE_BYTES);
+      if (new.start == new.end)
+        continue;
+      else if (new.start > new.end)
         {
-          iter->iter = g_sequence_iter_next (iter->iter);
-          iter->pos = pos = 0;
+          gsize tmp;
 
-          if (!g_sequence_iter_is_end (iter->iter))
-            node = g_sequence_get (iter->iter);
+          tmp = new.start;
+          new.start = new.end;
+          new.end = tmp;
         }
 
-      if (func (iter, g_utf8_get_char (str), user_data))
-        return TRUE;
-    }
+      new.id = spans[i].id;
+      new.data = NULL;
 
-  return FALSE;
-}
+      /* Equal values share a single user data */
+      if (G_IS_VALUE (&spans[i].value))
+        new.data = _text_buffer_intern_user_data (interned, &spans[i].value);
+
+      g_array_append_val (changes, new);
+      min_offset = MIN (min_offset, new.start);
+      max_offset = MAX (max_offset, new.end);
+    }
+
+  g_array_sort (changes, _text_data_change_compare);
+  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  user_data = g_ptr_array_new ();
+
+  for (i = 0; i < changes->len; i = j)
+    {
+      change = &g_array_index (changes, MechTextDataChange, i);
+      g_array_set_size (ids, 0);
+      g_ptr_array_set_size (user_data, 0);
+
+      /* Changes on the same range are stored together */
+      for (j = i; j < changes->len; j++)
+        {
+          other = &g_array_index (changes, MechTextDataChange, j);
+
+          if (other->start != change->start || other->end != change->end)
+            break;
+
+          /* Reuse the surrounding data if equal, so the nodes can merge */
+          equal = NULL;
+
+          if (other->data && other->start > 0)
+            equal = _text_buffer_find_equal_data (buffer, other->start - 1,
+                                                  other->id, other->data);
+          if (other->data && !equal)
+            equal = _text_buffer_find_equal_data (buffer, other->end,
+                                                  other->id, other->data);
+
+          g_array_append_val (ids, other->id);
+          g_ptr_array_add (user_data, equal ? equal : other->data);
+        }
+
+      _text_buffer_get_iter_at_byte_offset (buffer, change->start, &start);
+      _text_buffer_get_iter_at_byte_offset (buffer, change->end, &end);
+      _mech_text_buffer_store_user_data_array (buffer, &start, &end,
+                                               (guint *) ids->data,
+                                               (MechTextUserData **) user_data->pdata,
+                                               ids->len);
+    }
+
+  if (changes->len > 0)
+    {
+      _text_buffer_get_iter_at_byte_offset (buffer, min_offset, &start);
+      _text_buffer_get_iter_at_byte_offset (buffer, max_offset, &end);
+      _mech_text_buffer_reunite_range (buffer, start.iter, end.iter);
+    }
+
+  g_ptr_array_unref (user_data);
+  g_array_unref (ids);
+  g_array_unref (changes);
+  g_hash_table_unref (interned);
+}
+
+void
+mech_text_buffer_paragraph_extents (MechTextBuffer     *buffer,
+                                    const MechTextIter *iter,
+                                    MechTextIter       *paragraph_start,
+                                    MechTextIter       *paragraph_end)
+{
+  gsize para;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (IS_VALID_ITER (iter, buffer));
+
+  if (g_sequence_iter_is_end (iter->iter))
+    {
+      if (paragraph_start)
+        *paragraph_start = *iter;
+      if (paragraph_end)
+        *paragraph_end = *iter;
+      return;
+    }
+
+  para = _text_buffer_iter_get_offset (buffer, iter,
+                                       MECH_TEXT_TREE_PARAGRAPHS);
+  if (paragraph_start)
+    _text_buffer_get_paragraph_start (buffer, para, paragraph_start);
+
+  if (paragraph_end)
+    _text_buffer_get_paragraph_start (buffer, para + 1, paragraph_end);
+}
+
+gboolean
+mech_text_buffer_find_forward (MechTextIter     *iter,
+                               MechTextFindFunc  func,
+                               gpointer          user_data)
+{
+  MechTextBufferNode *node;
+  gchar *str;
+  gsize pos;
+
+  g_return_val_if_fail (iter != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+
+  if (g_sequence_iter_is_end (iter->iter))
+    return FALSE;
+
+  node = g_sequence_get (iter->iter);
+
+  while (!g_sequence_iter_is_end (iter->iter))
+    {
+      str = g_utf8_next_char (NODE_STRING_POS (node, iter->pos));
+      iter->pos = str - NODE_STRING (node);
+
+      if (iter->pos >= node->len)
+        {
+          iter->iter = g_sequence_iter_next (iter->iter);
+          iter->pos = pos = 0;
+
+          if (!g_sequence_iter_is_end (iter->iter))
+            node = g_sequence_get (iter->iter);
+        }
+
+      if (func (iter, g_utf8_get_char (str), user_data))
+        return TRUE;
+    }
+
+  return FALSE;
+}
 
 gboolean
 mech_text_buffer_find_backward (MechTextIter     *iter,
@@ -1740,420 +3260,1278 @@ mech_text_buffer_find_backward (MechTextIter     *iter,
   return FALSE;
 }
 
-gboolean
-mech_text_buffer_iter_move_bytes (MechTextIter *iter,
-                                  gssize        bytes)
+static gchar
+_text_buffer_iter_get_prev_byte (const MechTextIter *iter)
 {
   MechTextBufferNode *node;
-  gssize remaining;
 
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  if (iter->pos > 0)
+    return ITER_STRING (iter)[-1];
 
-  remaining = ABS (bytes);
+  /* The buffer start counts as a line start */
+  if (g_sequence_iter_is_begin (iter->iter))
+    return '\n';
 
-  if (bytes == 0)
-    return TRUE;
+  node = g_sequence_get (g_sequence_iter_prev (iter->iter));
 
-  if (bytes > 0)
+  if (node->len == 0)
+    return '\n';
+
+  return NODE_STRING (node)[node->len - 1];
+}
+
+static gboolean
+_text_search_pattern_is_ascii (const gchar *pattern)
+{
+  while (*pattern)
     {
-      while (remaining > 0 &&
-             !g_sequence_iter_is_end (iter->iter))
-        {
-          node = g_sequence_get (iter->iter);
+      if ((guchar) *pattern >= 0x80)
+        return FALSE;
 
-          if (node->len > iter->pos + remaining)
-            {
-              iter->pos += remaining;
-              remaining = 0;
-            }
-          else
-            {
-              remaining -= node->len - iter->pos;
-              iter->iter = g_sequence_iter_next (iter->iter);
-              iter->pos = 0;
-            }
-        }
+      pattern++;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+_text_search_init (MechTextSearch       *search,
+                   const gchar          *pattern,
+                   MechTextSearchFlags   flags,
+                   guint                 max_matches,
+                   GError              **error)
+{
+  GRegexCompileFlags compile_flags;
+  gchar *escaped;
+
+  memset (search, 0, sizeof (MechTextSearch));
+  search->caseless = (flags & MECH_TEXT_SEARCH_CASE_INSENSITIVE) != 0;
+  search->max_matches = max_matches;
+
+  if ((flags & MECH_TEXT_SEARCH_REGEX) == 0 &&
+      (!search->caseless || _text_search_pattern_is_ascii (pattern)))
+    {
+      /* Literal search, case folding is ASCII only here */
+      if (search->caseless)
+        search->pattern = g_ascii_strdown (pattern, -1);
+      else
+        search->pattern = g_strdup (pattern);
+
+      search->pattern_len = strlen (search->pattern);
     }
   else
     {
-      while (TRUE)
+      compile_flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+
+      if (search->caseless)
+        compile_flags |= G_REGEX_CASELESS;
+
+      if (flags & MECH_TEXT_SEARCH_REGEX)
+        search->regex = g_regex_new (pattern, compile_flags, 0, error);
+      else
         {
-          if (g_sequence_iter_is_end (iter->iter))
-            {
-              iter->iter = g_sequence_iter_prev (iter->iter);
-              continue;
-            }
+          /* Caseless non-ASCII literals need unicode folding */
+          escaped = g_regex_escape_string (pattern, -1);
+          search->regex = g_regex_new (escaped, compile_flags, 0, error);
+          g_free (escaped);
+        }
 
-          node = g_sequence_get (iter->iter);
+      if (!search->regex)
+        return FALSE;
+    }
 
-          if (node->len <= remaining)
-            {
-              remaining -= node->len;
-              iter->pos = 0;
+  search->carry = g_string_new (NULL);
+  search->matches = g_array_new (FALSE, FALSE, sizeof (MechTextSearchMatch));
 
-              if (g_sequence_iter_is_begin (iter->iter))
-                  break;
+  return TRUE;
+}
 
-              iter->iter = g_sequence_iter_prev (iter->iter);
-            }
-          else
-            {
-              iter->pos = node->len - remaining;
-              remaining = 0;
-              break;
-            }
-        }
-    }
+static void
+_text_search_clear (MechTextSearch *search)
+{
+  g_free (search->pattern);
 
-  if (iter->pos != 0 &&
-      !g_sequence_iter_is_end (iter->iter))
+  if (search->regex)
+    g_regex_unref (search->regex);
+
+  g_string_free (search->carry, TRUE);
+  g_array_unref (search->matches);
+}
+
+static gboolean
+_text_search_add_match (MechTextSearch *search,
+                        gsize           start,
+                        gsize           end)
+{
+  MechTextSearchMatch match;
+
+  /* Matches don't overlap, nor empty ones repeat */
+  if (search->matches->len > 0 &&
+      (start < search->last_end ||
+       (start == end && start == search->last_end)))
+    return TRUE;
+
+  match.start = start;
+  match.end = end;
+  g_array_append_val (search->matches, match);
+  search->last_end = end;
+
+  return (search->max_matches == 0 ||
+          search->matches->len < search->max_matches);
+}
+
+static const gchar *
+_text_search_find_literal (MechTextSearch *search,
+                           const gchar    *text,
+                           const gchar    *end)
+{
+  gsize len = search->pattern_len;
+  gchar first = search->pattern[0];
+
+  while (text + len <= end)
     {
-      const gchar *str;
+      if (search->caseless && g_ascii_isalpha (first))
+        {
+          while (text + len <= end && g_ascii_tolower (*text) != first)
+            text++;
 
-      node = g_sequence_get (iter->iter);
+          if (text + len > end)
+            return NULL;
+        }
+      else if ((text = memchr (text, first, end - text - len + 1)) == NULL)
+        return NULL;
 
-      /* Ensure iter points to the beginning of a character */
-      str = NODE_STRING_POS (node, iter->pos);
-      str = g_utf8_next_char (g_utf8_prev_char (str));
-      iter->pos = NODE_STRING (node) - str;
+      if (search->caseless ?
+          g_ascii_strncasecmp (text + 1, search->pattern + 1, len - 1) == 0 :
+          memcmp (text + 1, search->pattern + 1, len - 1) == 0)
+        return text;
+
+      text++;
     }
 
-  return remaining == 0;
+  return NULL;
 }
 
-gboolean
-mech_text_buffer_iter_next_paragraph (MechTextBuffer *buffer,
-                                      MechTextIter   *iter)
+static gboolean
+_text_search_literal_span (MechTextSearch *search,
+                           const gchar    *text,
+                           gsize           len,
+                           gsize           offset)
 {
-  MechTextBufferPrivate *priv;
+  gsize keep, tail_len, match_offset;
+  const gchar *p, *join_end;
 
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
-  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), FALSE);
+  keep = search->pattern_len - 1;
 
-  priv = mech_text_buffer_get_instance_private (buffer);
-  return mech_text_buffer_iter_next_section (iter, NULL,
-                                             priv->paragraph_break_id);
+  if (search->carry->len > 0)
+    {
+      /* Look for matches starting in the last bytes
+       * of previous spans and ending within this one.
+       */
+      tail_len = search->carry->len;
+      g_string_append_len (search->carry, text, MIN (len, keep));
+      join_end = search->carry->str + search->carry->len;
+      p = search->carry->str;
+
+      while ((p = _text_search_find_literal (search, p, join_end)) != NULL &&
+             p < search->carry->str + tail_len)
+        {
+          match_offset = offset - tail_len + (p - search->carry->str);
+
+          if (!_text_search_add_match (search, match_offset,
+                                       match_offset + search->pattern_len))
+            return FALSE;
+
+          p++;
+        }
+
+      g_string_truncate (search->carry, tail_len);
+    }
+
+  p = text;
+
+  while ((p = _text_search_find_literal (search, p, text + len)) != NULL)
+    {
+      match_offset = offset + (p - text);
+
+      if (!_text_search_add_match (search, match_offset,
+                                   match_offset + search->pattern_len))
+        return FALSE;
+
+      p++;
+    }
+
+  if (keep == 0)
+    return TRUE;
+
+  if (len >= keep)
+    {
+      g_string_truncate (search->carry, 0);
+      g_string_append_len (search->carry, text + len - keep, keep);
+    }
+  else
+    {
+      g_string_append_len (search->carry, text, len);
+
+      if (search->carry->len > keep)
+        g_string_erase (search->carry, 0, search->carry->len - keep);
+    }
+
+  return TRUE;
 }
 
-gboolean
-mech_text_buffer_iter_previous_paragraph (MechTextBuffer *buffer,
-                                          MechTextIter   *iter)
+static gboolean
+_text_search_regex_span (MechTextSearch *search,
+                         const gchar    *text,
+                         gsize           len,
+                         gsize           offset,
+                         gboolean        last)
 {
-  MechTextBufferPrivate *priv;
+  GRegexMatchFlags match_flags = 0;
+  GMatchInfo *match_info;
+  gboolean partial;
+  gint start, end;
+  gsize pos = 0;
+
+  if (search->carry->len > 0)
+    {
+      /* Resume from the partial match the previous span left */
+      g_string_append_len (search->carry, text, len);
+      text = search->carry->str;
+      len = search->carry->len;
+      offset = search->carry_offset;
+    }
+
+  if (search->last_end > offset)
+    pos = search->last_end - offset;
+
+  if (!last)
+    match_flags |= G_REGEX_MATCH_PARTIAL_HARD;
+  if (search->prev_byte != '\n')
+    match_flags |= G_REGEX_MATCH_NOTBOL;
+
+  while (pos <= len)
+    {
+      g_regex_match_full (search->regex, text, len, pos,
+                          match_flags, &match_info, NULL);
+
+      if (g_match_info_matches (match_info))
+        {
+          g_match_info_fetch_pos (match_info, 0, &start, &end);
+          g_match_info_free (match_info);
+
+          if (!_text_search_add_match (search, offset + start, offset + end))
+            return FALSE;
+
+          if (end > start)
+            pos = end;
+          else if ((gsize) end < len)
+            pos = g_utf8_next_char (text + end) - text;
+          else
+            break;
+
+          continue;
+        }
+
+      partial = g_match_info_is_partial_match (match_info);
+      g_match_info_free (match_info);
+
+      if (!partial)
+        break;
+
+      if (len - pos > SEARCH_MAX_CARRY)
+        {
+          /* Don't look further than this for the match
+           * end, settle for what's within this span.
+           */
+          match_flags &= ~G_REGEX_MATCH_PARTIAL_HARD;
+          continue;
+        }
+
+      /* A match may start from pos and end in the next span */
+      if (pos > 0)
+        search->prev_byte = text[pos - 1];
+
+      search->carry_offset = offset + pos;
+
+      if (text == search->carry->str)
+        g_string_erase (search->carry, 0, pos);
+      else
+        {
+          g_string_truncate (search->carry, 0);
+          g_string_append_len (search->carry, text + pos, len - pos);
+        }
+
+      return TRUE;
+    }
+
+  if (len > 0)
+    search->prev_byte = text[len - 1];
+
+  g_string_truncate (search->carry, 0);
+
+  return TRUE;
+}
+
+static gboolean
+_text_buffer_search (MechTextBuffer      *buffer,
+                     MechTextSearch      *search,
+                     const MechTextIter  *start,
+                     const MechTextIter  *limit,
+                     GCancellable        *cancellable,
+                     GError             **error)
+{
+  MechTextSeqIterator iterator;
+  gchar *str = NULL, *span = NULL;
+  gsize offset, span_len = 0;
+  gboolean more = TRUE, cont;
+  gssize len = 0;
+
+  _mech_text_seq_iterator_init (&iterator, buffer, start, limit);
+  offset = _text_buffer_iter_get_offset (buffer, &iterator.start,
+                                         MECH_TEXT_TREE_BYTES);
+  search->prev_byte = _text_buffer_iter_get_prev_byte (&iterator.start);
+
+  while (more)
+    {
+      more = _mech_text_seq_iterator_next (&iterator, NULL, &str, &len);
+
+      /* Nodes laid out contiguously on the same stored
+       * string are searched in place as a single span.
+       */
+      if (more && span && str == span + span_len &&
+          span_len < SEARCH_SPAN_SIZE)
+        {
+          span_len += len;
+          continue;
+        }
+
+      if (span)
+        {
+          if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+          if (search->regex)
+            cont = _text_search_regex_span (search, span, span_len,
+                                            offset, !more);
+          else
+            cont = _text_search_literal_span (search, span, span_len, offset);
+
+          if (!cont)
+            break;
+
+          offset += span_len;
+        }
+
+      span = str;
+      span_len = len;
+    }
+
+  return TRUE;
+}
+
+gboolean
+mech_text_buffer_search (MechTextBuffer       *buffer,
+                         const gchar          *pattern,
+                         MechTextSearchFlags   flags,
+                         const MechTextIter   *start,
+                         const MechTextIter   *limit,
+                         MechTextIter         *match_start,
+                         MechTextIter         *match_end,
+                         GCancellable         *cancellable,
+                         GError              **error)
+{
+  MechTextSearchMatch *match;
+  MechTextSearch search;
+  gboolean found = FALSE;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (pattern != NULL && *pattern != '\0', FALSE);
+  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), FALSE);
+  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, buffer), FALSE);
+
+  if (!_text_search_init (&search, pattern, flags, 1, error))
+    return FALSE;
+
+  if (_text_buffer_search (buffer, &search, start, limit,
+                           cancellable, error) &&
+      search.matches->len > 0)
+    {
+      match = &g_array_index (search.matches, MechTextSearchMatch, 0);
+
+      if (match_start)
+        _text_buffer_get_iter_at_byte_offset (buffer, match->start,
+                                              match_start);
+      if (match_end)
+        _text_buffer_get_iter_at_byte_offset (buffer, match->end,
+                                              match_end);
+      found = TRUE;
+    }
+
+  _text_search_clear (&search);
+
+  return found;
+}
+
+GPtrArray *
+mech_text_buffer_search_all (MechTextBuffer       *buffer,
+                             const gchar          *pattern,
+                             MechTextSearchFlags   flags,
+                             const MechTextIter   *start,
+                             const MechTextIter   *limit,
+                             GCancellable         *cancellable,
+                             GError              **error)
+{
+  MechTextIter match_start, match_end;
+  MechTextSearchMatch *match;
+  MechTextSearch search;
+  MechTextRange *range;
+  GPtrArray *ranges;
+  guint i;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), NULL);
+  g_return_val_if_fail (pattern != NULL && *pattern != '\0', NULL);
+  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), NULL);
+  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, buffer), NULL);
+
+  if (!_text_search_init (&search, pattern, flags, 0, error))
+    return NULL;
+
+  if (!_text_buffer_search (buffer, &search, start, limit,
+                            cancellable, error))
+    {
+      _text_search_clear (&search);
+      return NULL;
+    }
+
+  ranges = g_ptr_array_new_full (search.matches->len, g_object_unref);
+
+  for (i = 0; i < search.matches->len; i++)
+    {
+      match = &g_array_index (search.matches, MechTextSearchMatch, i);
+      _text_buffer_get_iter_at_byte_offset (buffer, match->start,
+                                            &match_start);
+      _text_buffer_get_iter_at_byte_offset (buffer, match->end, &match_end);
+
+      range = mech_text_range_new ();
+      mech_text_range_set_bounds (range, &match_start, &match_end);
+      g_ptr_array_add (ranges, range);
+    }
+
+  _text_search_clear (&search);
+
+  return ranges;
+}
+
+gboolean
+mech_text_buffer_iter_move_bytes (MechTextIter *iter,
+                                  gssize        bytes)
+{
+  MechTextBufferNode *node;
+  gssize remaining;
+
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+
+  remaining = ABS (bytes);
+
+  if (bytes == 0)
+    return TRUE;
+
+  if (bytes > 0)
+    {
+      while (remaining > 0 &&
+             !g_sequence_iter_is_end (iter->iter))
+        {
+          node = g_sequence_get (iter->iter);
+
+          if (node->len > iter->pos + remaining)
+            {
+              iter->pos += remaining;
+              remaining = 0;
+            }
+          else
+            {
+              remaining -= node->len - iter->pos;
+              iter->iter = g_sequence_iter_next (iter->iter);
+              iter->pos = 0;
+            }
+        }
+    }
+  else
+    {
+      while (TRUE)
+        {
+          if (g_sequence_iter_is_end (iter->iter))
+            {
+              iter->iter = g_sequence_iter_prev (iter->iter);
+              continue;
+            }
+
+          node = g_sequence_get (iter->iter);
+
+          if (node->len <= remaining)
+            {
+              remaining -= node->len;
+              iter->pos = 0;
+
+              if (g_sequence_iter_is_begin (iter->iter))
+                  break;
+
+              iter->iter = g_sequence_iter_prev (iter->iter);
+            }
+          else
+            {
+              iter->pos = node->len - remaining;
+              remaining = 0;
+              break;
+            }
+        }
+    }
+
+  if (iter->pos != 0 &&
+      !g_sequence_iter_is_end (iter->iter))
+    {
+      const gchar *str;
+
+      node = g_sequence_get (iter->iter);
+
+      /* Ensure iter points to the beginning of a character */
+      str = NODE_STRING_POS (node, iter->pos);
+      str = g_utf8_next_char (g_utf8_prev_char (str));
+      iter->pos = NODE_STRING (node) - str;
+    }
+
+  return remaining == 0;
+}
+
+gboolean
+mech_text_buffer_iter_next_paragraph (MechTextBuffer *buffer,
+                                      MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), FALSE);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return mech_text_buffer_iter_next_section (iter, NULL,
+                                             priv->paragraph_break_id);
+}
+
+gboolean
+mech_text_buffer_iter_previous_paragraph (MechTextBuffer *buffer,
+                                          MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), FALSE);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return mech_text_buffer_iter_previous_section (iter, NULL,
+                                                 priv->paragraph_break_id);
+}
+
+typedef struct
+{
+  guint count;
+  guint cur;
+} CountCharsData;
+
+static gboolean
+_iter_find_nth_char (const MechTextIter *iter,
+                     gunichar            ch,
+                     gpointer            user_data)
+{
+  CountCharsData *data = user_data;
+
+  data->cur++;
+  return data->cur == data->count;
+}
+
+gboolean
+mech_text_buffer_iter_next (MechTextIter *iter,
+                            guint         count)
+{
+  CountCharsData data = { count, 0 };
+
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+
+  if (count == 0)
+    return TRUE;
+
+  if (g_sequence_iter_is_end (iter->iter))
+    return FALSE;
+
+  return mech_text_buffer_find_forward (iter, _iter_find_nth_char, &data);
+}
+
+gboolean
+mech_text_buffer_iter_previous (MechTextIter *iter,
+                                guint         count)
+{
+  CountCharsData data = { count, 0 };
+
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+
+  if (count == 0)
+    return TRUE;
+
+  if (g_sequence_iter_is_begin (iter->iter) && iter->pos == 0)
+    return FALSE;
+
+  return mech_text_buffer_find_backward (iter, _iter_find_nth_char, &data);
+}
+
+gboolean
+mech_text_buffer_iter_is_start (MechTextIter *iter)
+{
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+
+  return g_sequence_iter_is_begin (iter->iter) && iter->pos == 0;
+}
+
+gboolean
+mech_text_buffer_iter_is_end (MechTextIter *iter)
+{
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+
+  return g_sequence_iter_is_end (iter->iter);
+}
+
+gunichar
+mech_text_buffer_iter_get_char (MechTextIter *iter)
+{
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), 0);
+
+  if (mech_text_buffer_iter_is_end (iter))
+    return 0;
+
+  return g_utf8_get_char (ITER_STRING (iter));
+}
+
+gboolean
+mech_text_buffer_iter_next_section (MechTextIter       *iter,
+                                    const MechTextIter *limit,
+                                    guint               id)
+{
+  MechTextUserData *user_data, *check;
+  MechTextBufferNode *node;
+
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, iter->buffer), FALSE);
+
+  if ((limit && mech_text_buffer_iter_compare (iter, limit) == 0) ||
+      g_sequence_iter_is_end (iter->iter))
+    return FALSE;
+
+  node = g_sequence_get (iter->iter);
+  check = _mech_text_buffer_node_get_data (node, id);
+
+  while (!g_sequence_iter_is_end (iter->iter))
+    {
+      node = g_sequence_get (iter->iter);
+      user_data = _mech_text_buffer_node_get_data (node, id);
+
+      if (check != user_data)
+        return TRUE;
+
+      if (limit && limit->iter == iter->iter)
+        {
+          *iter = *limit;
+          break;
+        }
+
+      iter->iter = g_sequence_iter_next (iter->iter);
+      iter->pos = 0;
+    }
+
+  return FALSE;
+}
+
+gboolean
+mech_text_buffer_iter_previous_section (MechTextIter       *iter,
+                                        const MechTextIter *limit,
+                                        guint               id)
+{
+  MechTextUserData *user_data, *check = NULL;
+  MechTextBufferNode *node;
+
+  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, iter->buffer), FALSE);
+
+  if ((limit && mech_text_buffer_iter_compare (iter, limit) == 0) ||
+      g_sequence_iter_is_begin (iter->iter))
+    return FALSE;
+
+  if (!g_sequence_iter_is_end (iter->iter))
+    {
+      node = g_sequence_get (iter->iter);
+      check = _mech_text_buffer_node_get_data (node, id);
+    }
+
+  while (TRUE)
+    {
+      if (!g_sequence_iter_is_end (iter->iter))
+        {
+          node = g_sequence_get (iter->iter);
+          user_data = _mech_text_buffer_node_get_data (node, id);
+
+          if (check != user_data)
+            return TRUE;
+        }
+
+      if (limit && limit->iter == iter->iter)
+        {
+          *iter = *limit;
+          break;
+        }
+
+      if (g_sequence_iter_is_begin (iter->iter))
+        break;
+
+      iter->iter = g_sequence_iter_prev (iter->iter);
+      iter->pos = 0;
+    }
+
+  return FALSE;
+}
+
+gssize
+mech_text_buffer_get_char_count (MechTextBuffer     *buffer,
+                                 const MechTextIter *start,
+                                 const MechTextIter *end)
+{
+  MechTextBufferPrivate *priv;
+  gsize start_offset, end_offset;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), 0);
+  g_return_val_if_fail (!end || IS_VALID_ITER (end, buffer), 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  start_offset = end_offset = 0;
+
+  if (start)
+    start_offset = _text_buffer_iter_get_offset (buffer, start,
+                                                 MECH_TEXT_TREE_CHARS);
+  if (end)
+    end_offset = _text_buffer_iter_get_offset (buffer, end,
+                                               MECH_TEXT_TREE_CHARS);
+  else
+    end_offset = _mech_text_tree_get_total (priv->tree, MECH_TEXT_TREE_CHARS);
+
+  if (start_offset > end_offset)
+    return start_offset - end_offset;
+  else
+    return end_offset - start_offset;
+}
+
+gssize
+mech_text_buffer_get_byte_offset (MechTextBuffer     *buffer,
+                                  const MechTextIter *start,
+                                  const MechTextIter *end)
+{
+  MechTextBufferPrivate *priv;
+  gsize start_offset, end_offset;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), 0);
+  g_return_val_if_fail (!end || IS_VALID_ITER (end, buffer), 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  start_offset = end_offset = 0;
+
+  if (start)
+    start_offset = _text_buffer_iter_get_offset (buffer, start,
+                                                 MECH_TEXT_TREE_BYTES);
+  if (end)
+    end_offset = _text_buffer_iter_get_offset (buffer, end,
+                                               MECH_TEXT_TREE_BYTES);
+  else
+    end_offset = _mech_text_tree_get_total (priv->tree, MECH_TEXT_TREE_BYTES);
+
+  return (gssize) end_offset - (gssize) start_offset;
+}
+
+gboolean
+mech_text_buffer_get_iter_at_offset (MechTextBuffer *buffer,
+                                     MechTextIter   *iter,
+                                     gsize           offset)
+{
+  MechTextBufferPrivate *priv;
+  MechTextTreeNode *tree_node;
+  MechTextBufferNode *node;
+  GSequenceIter *seq_iter;
+  gsize node_offset;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (iter != NULL, FALSE);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  tree_node = _mech_text_tree_lookup (priv->tree, MECH_TEXT_TREE_CHARS,
+                                      offset, &node_offset);
+  if (!tree_node)
+    {
+      mech_text_buffer_get_bounds (buffer, NULL, iter);
+      return offset == _mech_text_tree_get_total (priv->tree,
+                                                  MECH_TEXT_TREE_CHARS);
+    }
+
+  seq_iter = _mech_text_tree_node_get_data (tree_node);
+  node = g_sequence_get (seq_iter);
+  INITIALIZE_ITER (iter, buffer, seq_iter,
+                   g_utf8_offset_to_pointer (NODE_STRING (node),
+                                             node_offset) - NODE_STRING (node));
+  return TRUE;
+}
+
+gboolean
+mech_text_buffer_get_iter_at_paragraph (MechTextBuffer *buffer,
+                                        MechTextIter   *iter,
+                                        guint           paragraph)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (iter != NULL, FALSE);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  if (paragraph >= _mech_text_tree_get_total (priv->tree,
+                                              MECH_TEXT_TREE_PARAGRAPHS))
+    {
+      mech_text_buffer_get_bounds (buffer, NULL, iter);
+      return FALSE;
+    }
+
+  _text_buffer_get_paragraph_start (buffer, paragraph, iter);
+  return TRUE;
+}
+
+guint
+mech_text_buffer_get_paragraph_count (MechTextBuffer *buffer)
+{
+  MechTextBufferPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return _mech_text_tree_get_total (priv->tree, MECH_TEXT_TREE_PARAGRAPHS);
+}
+
+guint
+mech_text_buffer_iter_get_paragraph (MechTextBuffer     *buffer,
+                                     const MechTextIter *iter)
+{
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), 0);
+
+  return _text_buffer_iter_get_offset (buffer, iter,
+                                       MECH_TEXT_TREE_PARAGRAPHS);
+}
+
+guint
+mech_text_buffer_create_mark (MechTextBuffer *buffer,
+                              MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
+
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
+  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  mark = g_slice_new (MechTextBufferMark);
+  mark->id = ++priv->mark;
+  mark->iter = *iter;
+
+  _mech_text_mark_attach (buffer, mark);
+  g_hash_table_insert (priv->marks, GUINT_TO_POINTER (mark->id), mark);
+
+  return mark->id;
+}
+
+void
+mech_text_buffer_create_marks (MechTextBuffer     *buffer,
+                               const MechTextIter *iters,
+                               guint               n_iters,
+                               guint              *mark_ids)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
+  guint i;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (n_iters == 0 || iters != NULL);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+
+  for (i = 0; i < n_iters; i++)
+    {
+      g_return_if_fail (IS_VALID_ITER (&iters[i], buffer));
+
+      mark = g_slice_new (MechTextBufferMark);
+      mark->id = ++priv->mark;
+      mark->iter = iters[i];
+
+      _mech_text_mark_attach (buffer, mark);
+      g_hash_table_insert (priv->marks, GUINT_TO_POINTER (mark->id), mark);
+
+      if (mark_ids)
+        mark_ids[i] = mark->id;
+    }
+}
+
+void
+mech_text_buffer_update_mark (MechTextBuffer *buffer,
+                              guint           mark_id,
+                              MechTextIter   *iter)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (IS_VALID_ITER (iter, buffer));
+  g_return_if_fail (mark_id != 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  mark = g_hash_table_lookup (priv->marks, GUINT_TO_POINTER (mark_id));
+
+  if (!mark)
+    return;
+
+  if (mark->iter.iter == iter->iter && mark->iter.pos == iter->pos)
+    return;
+
+  _mech_text_mark_detach (buffer, mark);
+  mark->iter = *iter;
+  _mech_text_mark_attach (buffer, mark);
+}
+
+void
+mech_text_buffer_delete_mark (MechTextBuffer *buffer,
+                              guint           mark_id)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (mark_id != 0);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  mark = g_hash_table_lookup (priv->marks, GUINT_TO_POINTER (mark_id));
+
+  if (!mark)
+    return;
+
+  _mech_text_mark_detach (buffer, mark);
+  g_hash_table_remove (priv->marks, GUINT_TO_POINTER (mark_id));
+}
+
+void
+mech_text_buffer_delete_marks (MechTextBuffer *buffer,
+                               const guint    *mark_ids,
+                               guint           n_marks)
+{
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
+  GPtrArray **marks, *deleted;
+  GHashTableIter iter;
+  GHashTable *lists;
+  guint i, j;
+
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
+  g_return_if_fail (n_marks == 0 || mark_ids != NULL);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  lists = g_hash_table_new (NULL, NULL);
+  deleted = g_ptr_array_new_with_free_func ((GDestroyNotify) _mech_text_mark_free);
+
+  /* Flag the marks first, so each affected mark
+   * list is compacted just once afterwards.
+   */
+  for (i = 0; i < n_marks; i++)
+    {
+      mark = g_hash_table_lookup (priv->marks, GUINT_TO_POINTER (mark_ids[i]));
+
+      if (!mark)
+        continue;
 
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
-  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), FALSE);
+      g_hash_table_steal (priv->marks, GUINT_TO_POINTER (mark_ids[i]));
+      g_hash_table_add (lists,
+                        _mech_text_buffer_get_mark_list (buffer,
+                                                         mark->iter.iter));
+      g_ptr_array_add (deleted, mark);
+      mark->id = 0;
+    }
 
-  priv = mech_text_buffer_get_instance_private (buffer);
-  return mech_text_buffer_iter_previous_section (iter, NULL,
-                                                 priv->paragraph_break_id);
-}
+  g_hash_table_iter_init (&iter, lists);
 
-typedef struct
-{
-  guint count;
-  guint cur;
-} CountCharsData;
+  while (g_hash_table_iter_next (&iter, (gpointer *) &marks, NULL))
+    {
+      for (i = 0, j = 0; i < (*marks)->len; i++)
+        {
+          mark = g_ptr_array_index (*marks, i);
 
-static gboolean
-_iter_find_nth_char (const MechTextIter *iter,
-                     gunichar            ch,
-                     gpointer            user_data)
-{
-  CountCharsData *data = user_data;
+          if (mark->id != 0)
+            (*marks)->pdata[j++] = mark;
+        }
 
-  data->cur++;
-  return data->cur == data->count;
+      if (j == 0)
+        {
+          g_ptr_array_unref (*marks);
+          *marks = NULL;
+        }
+      else
+        g_ptr_array_set_size (*marks, j);
+    }
+
+  g_hash_table_unref (lists);
+  g_ptr_array_unref (deleted);
 }
 
 gboolean
-mech_text_buffer_iter_next (MechTextIter *iter,
-                            guint         count)
+mech_text_buffer_get_iter_at_mark (MechTextBuffer *buffer,
+                                   guint           mark_id,
+                                   MechTextIter   *iter)
 {
-  CountCharsData data = { count, 0 };
+  MechTextBufferPrivate *priv;
+  MechTextBufferMark *mark;
 
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (mark_id != 0, FALSE);
 
-  if (count == 0)
-    return TRUE;
+  priv = mech_text_buffer_get_instance_private (buffer);
+  mark = g_hash_table_lookup (priv->marks, GUINT_TO_POINTER (mark_id));
 
-  if (g_sequence_iter_is_end (iter->iter))
+  if (!mark)
     return FALSE;
 
-  return mech_text_buffer_find_forward (iter, _iter_find_nth_char, &data);
+  if (iter)
+    *iter = mark->iter;
+
+  return TRUE;
 }
 
-gboolean
-mech_text_buffer_iter_previous (MechTextIter *iter,
-                                guint         count)
+static void
+_text_buffer_apply_record (MechTextBuffer     *buffer,
+                           MechTextUndoRecord *record,
+                           gboolean            insert)
 {
-  CountCharsData data = { count, 0 };
+  MechTextBufferPrivate *priv;
+  MechTextUndoPiece *piece;
+  MechTextIter start, end;
+  gsize offset;
+  guint i;
 
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  priv = mech_text_buffer_get_instance_private (buffer);
 
-  if (count == 0)
-    return TRUE;
+  if (!insert)
+    {
+      _text_buffer_get_iter_at_byte_offset (buffer, record->offset, &start);
+      _text_buffer_get_iter_at_byte_offset (buffer,
+                                            record->offset + record->len,
+                                            &end);
+      mech_text_buffer_delete (buffer, &start, &end);
+      return;
+    }
 
-  if (g_sequence_iter_is_begin (iter->iter) && iter->pos == 0)
-    return FALSE;
+  offset = record->offset;
 
-  return mech_text_buffer_find_backward (iter, _iter_find_nth_char, &data);
-}
+  /* Nodes are created on the recorded pieces, no text is copied */
+  for (i = 0; i < record->pieces->len; i++)
+    {
+      piece = &g_array_index (record->pieces, MechTextUndoPiece, i);
+      _text_buffer_get_iter_at_byte_offset (buffer, offset, &start);
 
-gboolean
-mech_text_buffer_iter_is_start (MechTextIter *iter)
-{
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+      priv->restoring = piece->stored;
+      mech_text_buffer_insert (buffer, &start,
+                               piece->stored->str + piece->pos, piece->len);
+      priv->restoring = NULL;
 
-  return g_sequence_iter_is_begin (iter->iter) && iter->pos == 0;
+      offset += piece->len;
+    }
 }
 
 gboolean
-mech_text_buffer_iter_is_end (MechTextIter *iter)
+mech_text_buffer_can_undo (MechTextBuffer *buffer)
 {
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
+  MechTextBufferPrivate *priv;
 
-  return g_sequence_iter_is_end (iter->iter);
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
+
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return !g_queue_is_empty (&priv->undo_stack);
 }
 
-gunichar
-mech_text_buffer_iter_get_char (MechTextIter *iter)
+gboolean
+mech_text_buffer_can_redo (MechTextBuffer *buffer)
 {
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), 0);
+  MechTextBufferPrivate *priv;
 
-  if (mech_text_buffer_iter_is_end (iter))
-    return 0;
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
 
-  return g_utf8_get_char (ITER_STRING (iter));
+  priv = mech_text_buffer_get_instance_private (buffer);
+  return !g_queue_is_empty (&priv->redo_stack);
 }
 
 gboolean
-mech_text_buffer_iter_next_section (MechTextIter       *iter,
-                                    const MechTextIter *limit,
-                                    guint               id)
+mech_text_buffer_undo (MechTextBuffer *buffer)
 {
-  MechTextUserData *user_data, *check;
-  MechTextBufferNode *node;
-
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
-  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, iter->buffer), FALSE);
+  MechTextBufferPrivate *priv;
+  MechTextUndoRecord *record;
+  MechTextUndoAction *action;
+  guint i;
 
-  if ((limit && mech_text_buffer_iter_compare (iter, limit) == 0) ||
-      g_sequence_iter_is_end (iter->iter))
-    return FALSE;
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
 
-  node = g_sequence_get (iter->iter);
-  check = _mech_text_buffer_node_get_data (node, id);
+  priv = mech_text_buffer_get_instance_private (buffer);
+  g_return_val_if_fail (priv->user_action_depth == 0, FALSE);
 
-  while (!g_sequence_iter_is_end (iter->iter))
-    {
-      node = g_sequence_get (iter->iter);
-      user_data = _mech_text_buffer_node_get_data (node, id);
+  /* Pending appends are recorded first */
+  _text_buffer_flush_appends (buffer);
+  action = g_queue_pop_head (&priv->undo_stack);
 
-      if (check != user_data)
-        return TRUE;
+  if (!action)
+    return FALSE;
 
-      if (limit && limit->iter == iter->iter)
-        {
-          *iter = *limit;
-          break;
-        }
+  priv->applying_history = TRUE;
 
-      iter->iter = g_sequence_iter_next (iter->iter);
-      iter->pos = 0;
+  for (i = action->records->len; i > 0; i--)
+    {
+      record = &g_array_index (action->records, MechTextUndoRecord, i - 1);
+      _text_buffer_apply_record (buffer, record, !record->is_insert);
     }
 
-  return FALSE;
+  priv->applying_history = FALSE;
+  action->sealed = TRUE;
+  g_queue_push_head (&priv->redo_stack, action);
+
+  return TRUE;
 }
 
 gboolean
-mech_text_buffer_iter_previous_section (MechTextIter       *iter,
-                                        const MechTextIter *limit,
-                                        guint               id)
+mech_text_buffer_redo (MechTextBuffer *buffer)
 {
-  MechTextUserData *user_data, *check = NULL;
-  MechTextBufferNode *node;
-
-  g_return_val_if_fail (IS_VALID_ITER (iter, NULL), FALSE);
-  g_return_val_if_fail (!limit || IS_VALID_ITER (limit, iter->buffer), FALSE);
-
-  if ((limit && mech_text_buffer_iter_compare (iter, limit) == 0) ||
-      g_sequence_iter_is_begin (iter->iter))
-    return FALSE;
+  MechTextBufferPrivate *priv;
+  MechTextUndoRecord *record;
+  MechTextUndoAction *action;
+  guint i;
 
-  if (!g_sequence_iter_is_end (iter->iter))
-    {
-      node = g_sequence_get (iter->iter);
-      check = _mech_text_buffer_node_get_data (node, id);
-    }
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
 
-  while (TRUE)
-    {
-      if (!g_sequence_iter_is_end (iter->iter))
-        {
-          node = g_sequence_get (iter->iter);
-          user_data = _mech_text_buffer_node_get_data (node, id);
+  priv = mech_text_buffer_get_instance_private (buffer);
+  g_return_val_if_fail (priv->user_action_depth == 0, FALSE);
 
-          if (check != user_data)
-            return TRUE;
-        }
+  _text_buffer_flush_appends (buffer);
+  action = g_queue_pop_head (&priv->redo_stack);
 
-      if (limit && limit->iter == iter->iter)
-        {
-          *iter = *limit;
-          break;
-        }
+  if (!action)
+    return FALSE;
 
-      if (g_sequence_iter_is_begin (iter->iter))
-        break;
+  priv->applying_history = TRUE;
 
-      iter->iter = g_sequence_iter_prev (iter->iter);
-      iter->pos = 0;
+  for (i = 0; i < action->records->len; i++)
+    {
+      record = &g_array_index (action->records, MechTextUndoRecord, i);
+      _text_buffer_apply_record (buffer, record, record->is_insert);
     }
 
-  return FALSE;
-}
-
-gssize
-mech_text_buffer_get_char_count (MechTextBuffer     *buffer,
-                                 const MechTextIter *start,
-                                 const MechTextIter *end)
-{
-  MechTextSeqIterator iterator;
-  gssize len, count = 0;
-  gchar *str;
-
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
-  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), 0);
-  g_return_val_if_fail (!end || IS_VALID_ITER (end, buffer), 0);
-
-  _mech_text_seq_iterator_init (&iterator, buffer, start, end);
-
-  while (_mech_text_seq_iterator_next (&iterator, NULL, &str, &len))
-    count += g_utf8_strlen (str, len);
+  priv->applying_history = FALSE;
+  g_queue_push_head (&priv->undo_stack, action);
 
-  return count;
+  return TRUE;
 }
 
-gssize
-mech_text_buffer_get_byte_offset (MechTextBuffer     *buffer,
-                                  const MechTextIter *start,
-                                  const MechTextIter *end)
+void
+mech_text_buffer_begin_user_action (MechTextBuffer *buffer)
 {
-  MechTextSeqIterator iterator;
-  gssize len, count = 0;
+  MechTextBufferPrivate *priv;
+  MechTextUndoAction *action;
 
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
-  g_return_val_if_fail (!start || IS_VALID_ITER (start, buffer), 0);
-  g_return_val_if_fail (!end || IS_VALID_ITER (end, buffer), 0);
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
 
-  _mech_text_seq_iterator_init (&iterator, buffer, start, end);
+  priv = mech_text_buffer_get_instance_private (buffer);
+  priv->user_action_depth++;
 
-  while (_mech_text_seq_iterator_next (&iterator, NULL, NULL, &len))
-    count += len;
+  if (priv->user_action_depth > 1)
+    return;
 
-  if (start && end && mech_text_buffer_iter_compare (start, end) > 0)
-    count *= -1;
+  /* Edits until the outermost end_user_action() make up one action */
+  if ((action = g_queue_peek_head (&priv->undo_stack)) != NULL)
+    action->sealed = TRUE;
 
-  return count;
+  priv->group_action = NULL;
 }
 
-guint
-mech_text_buffer_create_mark (MechTextBuffer *buffer,
-                              MechTextIter   *iter)
+void
+mech_text_buffer_end_user_action (MechTextBuffer *buffer)
 {
   MechTextBufferPrivate *priv;
-  MechTextBufferMark new;
-  gint pos;
 
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
-  g_return_val_if_fail (IS_VALID_ITER (iter, buffer), 0);
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
 
   priv = mech_text_buffer_get_instance_private (buffer);
-  new.id = ++priv->mark;
-  new.iter = *iter;
-  pos = _mech_text_mark_get_insert_position (buffer, iter->iter, iter->pos);
+  g_return_if_fail (priv->user_action_depth > 0);
 
-  if (pos >= priv->marks->len)
-    g_array_append_val (priv->marks, new);
-  else
-    g_array_insert_val (priv->marks, pos, new);
+  priv->user_action_depth--;
 
-  return new.id;
+  if (priv->user_action_depth > 0)
+    return;
+
+  if (priv->group_action)
+    {
+      priv->group_action->sealed = TRUE;
+      priv->group_action = NULL;
+    }
+
+  _text_buffer_history_trim (buffer);
 }
 
 void
-mech_text_buffer_update_mark (MechTextBuffer *buffer,
-                              guint           mark_id,
-                              MechTextIter   *iter)
+mech_text_buffer_set_history_size (MechTextBuffer *buffer,
+                                   gsize           max_size)
 {
-  MechTextBufferMark *mark, new;
   MechTextBufferPrivate *priv;
-  guint del_pos, pos;
 
   g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
-  g_return_if_fail (IS_VALID_ITER (iter, buffer));
-  g_return_if_fail (mark_id != 0);
-
-  mark = _mech_text_mark_find (buffer, mark_id, &del_pos);
-
-  if (!mark)
-    return;
 
   priv = mech_text_buffer_get_instance_private (buffer);
-  pos = _mech_text_mark_get_insert_position (buffer, iter->iter, iter->pos);
+  priv->max_history_size = max_size;
 
-  if (pos == del_pos)
-    {
-      mark->iter = *iter;
-      return;
-    }
-
-  new.id = mark_id;
-  new.iter = *iter;
-
-  if (del_pos > pos)
-    del_pos++;
-
-  if (pos >= priv->marks->len)
-    g_array_append_val (priv->marks, new);
+  if (max_size == 0)
+    _text_buffer_history_clear (buffer);
   else
-    g_array_insert_val (priv->marks, pos, new);
+    {
+      /* Redo actions go first, then the oldest undo ones */
+      if (priv->history_size > max_size)
+        _text_buffer_history_clear_redo (buffer);
 
-  g_array_remove_index (priv->marks, del_pos);
+      _text_buffer_history_trim (buffer);
+    }
 }
 
-void
-mech_text_buffer_delete_mark (MechTextBuffer *buffer,
-                              guint           mark_id)
+gsize
+mech_text_buffer_get_history_size (MechTextBuffer *buffer)
 {
   MechTextBufferPrivate *priv;
-  guint pos;
 
-  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
-  g_return_if_fail (mark_id != 0);
+  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), 0);
 
   priv = mech_text_buffer_get_instance_private (buffer);
-
-  if (_mech_text_mark_find (buffer, mark_id, &pos))
-    g_array_remove_index (priv->marks, pos);
+  return priv->max_history_size;
 }
 
-gboolean
-mech_text_buffer_get_iter_at_mark (MechTextBuffer *buffer,
-                                   guint           mark_id,
-                                   MechTextIter   *iter)
+void
+mech_text_buffer_clear_history (MechTextBuffer *buffer)
 {
-  MechTextBufferMark *mark;
-
-  g_return_val_if_fail (MECH_IS_TEXT_BUFFER (buffer), FALSE);
-  g_return_val_if_fail (mark_id != 0, FALSE);
+  MechTextBufferPrivate *priv;
 
-  if ((mark = _mech_text_mark_find (buffer, mark_id, NULL)) == NULL)
-    return FALSE;
+  g_return_if_fail (MECH_IS_TEXT_BUFFER (buffer));
 
-  if (iter)
-    *iter = mark->iter;
+  priv = mech_text_buffer_get_instance_private (buffer);
+  g_return_if_fail (priv->user_action_depth == 0);
 
-  return TRUE;
+  _text_buffer_history_clear (buffer);
 }
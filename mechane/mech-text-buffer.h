@@ -18,7 +18,8 @@
 #ifndef __MECH_TEXT_BUFFER_H__
 #define __MECH_TEXT_BUFFER_H__
 
-#include <glib-object.h>
+#include <gio/gio.h>
+#include <mechane/mech-enums.h>
 
 G_BEGIN_DECLS
 
@@ -34,6 +35,7 @@ G_BEGIN_DECLS
 typedef struct _MechTextBuffer MechTextBuffer;
 typedef struct _MechTextBufferClass MechTextBufferClass;
 typedef struct _MechTextIter MechTextIter;
+typedef struct _MechTextDataSpan MechTextDataSpan;
 
 typedef gboolean (* MechTextFindFunc) (const MechTextIter *iter,
                                        gunichar            ch,
@@ -65,6 +67,14 @@ struct _MechTextIter
   gint pos;
 };
 
+struct _MechTextDataSpan
+{
+  MechTextIter start;
+  MechTextIter end;
+  guint id;
+  GValue value;
+};
+
 GType            mech_text_iter_get_type (void) G_GNUC_CONST;
 MechTextIter *   mech_text_iter_copy     (MechTextIter *iter);
 void             mech_text_iter_free     (MechTextIter *iter);
@@ -80,6 +90,23 @@ gchar          * mech_text_buffer_get_text   (MechTextBuffer *buffer,
                                               MechTextIter   *start,
                                               MechTextIter   *end);
 
+gboolean         mech_text_buffer_load_from_stream      (MechTextBuffer  *buffer,
+                                                         GInputStream    *stream,
+                                                         GCancellable    *cancellable,
+                                                         GError         **error);
+gboolean         mech_text_buffer_load_from_mapped_file (MechTextBuffer  *buffer,
+                                                         GMappedFile     *file,
+                                                         GError         **error);
+
+/* Log-style appends */
+void             mech_text_buffer_append              (MechTextBuffer *buffer,
+                                                       const gchar    *text,
+                                                       gssize          len);
+void             mech_text_buffer_flush_appends       (MechTextBuffer *buffer);
+void             mech_text_buffer_set_max_paragraphs  (MechTextBuffer *buffer,
+                                                       guint           max_paragraphs);
+guint            mech_text_buffer_get_max_paragraphs  (MechTextBuffer *buffer);
+
 void             mech_text_buffer_get_bounds (MechTextBuffer *buffer,
                                               MechTextIter   *start,
                                               MechTextIter   *end);
@@ -96,8 +123,18 @@ gssize           mech_text_buffer_get_char_count (MechTextBuffer     *buffer,
 gssize           mech_text_buffer_get_byte_offset   (MechTextBuffer     *buffer,
                                                      const MechTextIter *start,
                                                      const MechTextIter *end);
+guint            mech_text_buffer_get_paragraph_count (MechTextBuffer   *buffer);
 
 /* Iterators */
+gboolean         mech_text_buffer_get_iter_at_offset    (MechTextBuffer *buffer,
+                                                         MechTextIter   *iter,
+                                                         gsize           offset);
+gboolean         mech_text_buffer_get_iter_at_paragraph (MechTextBuffer *buffer,
+                                                         MechTextIter   *iter,
+                                                         guint           paragraph);
+guint            mech_text_buffer_iter_get_paragraph    (MechTextBuffer     *buffer,
+                                                         const MechTextIter *iter);
+
 void             mech_text_buffer_paragraph_extents (MechTextBuffer     *buffer,
                                                      const MechTextIter *iter,
                                                      MechTextIter       *paragraph_start,
@@ -110,6 +147,24 @@ gboolean         mech_text_buffer_find_backward (MechTextIter     *iter,
                                                  MechTextFindFunc  func,
                                                  gpointer          user_data);
 
+/* Search */
+gboolean         mech_text_buffer_search        (MechTextBuffer       *buffer,
+                                                 const gchar          *pattern,
+                                                 MechTextSearchFlags   flags,
+                                                 const MechTextIter   *start,
+                                                 const MechTextIter   *limit,
+                                                 MechTextIter         *match_start,
+                                                 MechTextIter         *match_end,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+GPtrArray      * mech_text_buffer_search_all    (MechTextBuffer       *buffer,
+                                                 const gchar          *pattern,
+                                                 MechTextSearchFlags   flags,
+                                                 const MechTextIter   *start,
+                                                 const MechTextIter   *limit,
+                                                 GCancellable         *cancellable,
+                                                 GError              **error);
+
 gboolean         mech_text_buffer_iter_move_bytes (MechTextIter *iter,
                                                    gssize        bytes);
 
@@ -164,6 +219,23 @@ void             mech_text_buffer_set_data            (MechTextBuffer     *buffe
                                                        MechTextIter       *start,
                                                        MechTextIter       *end,
                                                        ...);
+void             mech_text_buffer_set_data_spans      (MechTextBuffer         *buffer,
+                                                       const MechTextDataSpan *spans,
+                                                       guint                   n_spans);
+
+/* History */
+gboolean         mech_text_buffer_can_undo            (MechTextBuffer *buffer);
+gboolean         mech_text_buffer_can_redo            (MechTextBuffer *buffer);
+gboolean         mech_text_buffer_undo                (MechTextBuffer *buffer);
+gboolean         mech_text_buffer_redo                (MechTextBuffer *buffer);
+
+void             mech_text_buffer_begin_user_action   (MechTextBuffer *buffer);
+void             mech_text_buffer_end_user_action     (MechTextBuffer *buffer);
+
+void             mech_text_buffer_set_history_size    (MechTextBuffer *buffer,
+                                                       gsize           max_size);
+gsize            mech_text_buffer_get_history_size    (MechTextBuffer *buffer);
+void             mech_text_buffer_clear_history       (MechTextBuffer *buffer);
 
 /* Marks */
 void             mech_text_buffer_update_mark         (MechTextBuffer *buffer,
@@ -174,6 +246,14 @@ guint            mech_text_buffer_create_mark         (MechTextBuffer *buffer,
 void             mech_text_buffer_delete_mark         (MechTextBuffer *buffer,
                                                        guint           mark_id);
 
+void             mech_text_buffer_create_marks        (MechTextBuffer     *buffer,
+                                                       const MechTextIter *iters,
+                                                       guint               n_iters,
+                                                       guint              *mark_ids);
+void             mech_text_buffer_delete_marks        (MechTextBuffer     *buffer,
+                                                       const guint        *mark_ids,
+                                                       guint               n_marks);
+
 gboolean         mech_text_buffer_get_iter_at_mark    (MechTextBuffer *buffer,
                                                        guint           mark,
                                                        MechTextIter   *iter);
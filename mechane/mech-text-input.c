@@ -16,6 +16,7 @@
  */
 
 #include <xkbcommon/xkbcommon-keysyms.h>
+#include <math.h>
 #include "mech-text.h"
 #include "mech-text-input.h"
 
@@ -61,6 +62,31 @@ mech_text_input_notify (GObject    *object,
     }
 }
 
+static void
+_text_input_add_cursor_damage (MechTextInput  *input,
+                               MechTextIter   *iter,
+                               cairo_region_t *region)
+{
+  cairo_rectangle_int_t damage;
+  MechRenderer *renderer;
+  cairo_rectangle_t rect;
+  MechBorder border;
+
+  if (!mech_text_view_get_cursor_locations ((MechTextView *) input,
+                                            iter, &rect, NULL))
+    return;
+
+  renderer = mech_area_get_renderer ((MechArea *) input);
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_CONTENT, &border);
+
+  /* The caret is stroked 1px wide, leave room for antialiasing */
+  damage.x = floor (rect.x + border.left) - 1;
+  damage.y = floor (rect.y + border.top) - 1;
+  damage.width = ceil (rect.width) + 3;
+  damage.height = ceil (rect.height) + 2;
+  cairo_region_union_rectangle (region, &damage);
+}
+
 static void
 mech_text_input_draw (MechArea *area,
                       cairo_t  *cr)
@@ -95,9 +121,10 @@ mech_text_input_handle_event (MechArea  *area,
                               MechEvent *event)
 {
   MechTextInputPrivate *priv;
+  gboolean update_ins_x;
+  cairo_region_t *damage;
   MechTextBuffer *buffer;
   cairo_rectangle_t rect;
-  gboolean update_ins_x;
   MechTextView *view;
   MechTextIter ins;
   MechPoint point;
@@ -121,6 +148,8 @@ mech_text_input_handle_event (MechArea  *area,
         return TRUE;
 
       update_ins_x = TRUE;
+      damage = cairo_region_create ();
+      _text_input_add_cursor_damage ((MechTextInput *) area, &ins, damage);
 
       if (event->key.keyval == XKB_KEY_Return ||
                event->key.keyval == XKB_KEY_KP_Enter)
@@ -161,9 +190,11 @@ mech_text_input_handle_event (MechArea  *area,
           len = g_unichar_to_utf8 (event->key.unicode_char, buf);
           mech_text_buffer_insert (buffer, &ins, buf, len);
         }
-
       else
-        return FALSE;
+        {
+          cairo_region_destroy (damage);
+          return FALSE;
+        }
 
       if (update_ins_x)
         {
@@ -172,7 +203,14 @@ mech_text_input_handle_event (MechArea  *area,
         }
 
       mech_text_buffer_update_mark (buffer, priv->insertion_mark_id, &ins);
-      mech_area_redraw (area, NULL);
+
+      /* Only the old and new caret positions need repainting
+       * here, the text view damages the lines changed by edits.
+       */
+      _text_input_add_cursor_damage ((MechTextInput *) area, &ins, damage);
+      mech_area_redraw (area, damage);
+
+      cairo_region_destroy (damage);
       break;
     case MECH_BUTTON_PRESS:
       if (buffer && priv->insertion_mark_id)
@@ -185,10 +223,22 @@ mech_text_input_handle_event (MechArea  *area,
 
           if (mech_text_view_get_iter_at_point (view, &point, &iter))
             {
+              damage = cairo_region_create ();
+
+              if (mech_text_buffer_get_iter_at_mark (buffer,
+                                                     priv->insertion_mark_id,
+                                                     &ins))
+                _text_input_add_cursor_damage ((MechTextInput *) area,
+                                               &ins, damage);
+
               mech_text_buffer_update_mark (buffer, priv->insertion_mark_id, &iter);
               mech_text_view_get_cursor_locations (view, &iter, &rect, NULL);
               priv->last_ins_x = rect.x;
-              mech_area_redraw (area, NULL);
+
+              _text_input_add_cursor_damage ((MechTextInput *) area,
+                                             &iter, damage);
+              mech_area_redraw (area, damage);
+              cairo_region_destroy (damage);
             }
         }
       break;
@@ -0,0 +1,53 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_TEXT_MEASURE_PRIVATE_H__
+#define __MECH_TEXT_MEASURE_PRIVATE_H__
+
+#include <pango/pango.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MechTextMeasure MechTextMeasure;
+
+typedef void (* MechTextMeasureFunc) (MechTextMeasure *measure,
+                                      gpointer         user_data);
+
+MechTextMeasure * _mech_text_measure_new        (PangoContext        *context,
+                                                 gdouble              width);
+void              _mech_text_measure_add        (MechTextMeasure     *measure,
+                                                 guint                paragraph,
+                                                 gchar               *text,
+                                                 PangoAttrList       *attrs);
+gsize             _mech_text_measure_get_size   (MechTextMeasure     *measure);
+guint             _mech_text_measure_get_n_paragraphs
+                                                (MechTextMeasure     *measure);
+void              _mech_text_measure_get_paragraph
+                                                (MechTextMeasure     *measure,
+                                                 guint                index,
+                                                 guint               *paragraph,
+                                                 gdouble             *height);
+
+void              _mech_text_measure_run_async  (MechTextMeasure     *measure,
+                                                 MechTextMeasureFunc  func,
+                                                 gpointer             user_data);
+void              _mech_text_measure_cancel     (MechTextMeasure     *measure);
+void              _mech_text_measure_free       (MechTextMeasure     *measure);
+
+G_END_DECLS
+
+#endif /* __MECH_TEXT_MEASURE_PRIVATE_H__ */
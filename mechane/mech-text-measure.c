@@ -0,0 +1,239 @@
+/* Mechane:
+ * Copyright (C) 2013 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pango/pangocairo.h>
+#include <string.h>
+#include "mech-text-measure-private.h"
+
+typedef struct _MeasureParagraph MeasureParagraph;
+
+struct _MeasureParagraph
+{
+  guint paragraph;
+  gchar *text;
+  PangoAttrList *attrs;
+  gdouble height;
+};
+
+struct _MechTextMeasure
+{
+  PangoFontDescription *font_desc;
+  cairo_font_options_t *font_options;
+  gdouble resolution;
+  gdouble width;
+
+  GArray *paragraphs;
+  gsize size;
+
+  MechTextMeasureFunc func;
+  gpointer user_data;
+  volatile gint cancelled;
+};
+
+/* Font maps are not shareable across threads, so each
+ * worker lazily creates its own, Pango supports using
+ * those from other threads since 1.32.6.
+ */
+static GPrivate font_map_key = G_PRIVATE_INIT (g_object_unref);
+
+static gboolean
+_text_measure_dispatch (gpointer user_data)
+{
+  MechTextMeasure *measure = user_data;
+
+  if (!g_atomic_int_get (&measure->cancelled))
+    measure->func (measure, measure->user_data);
+
+  _mech_text_measure_free (measure);
+
+  return FALSE;
+}
+
+static void
+_text_measure_func (gpointer data,
+                    gpointer user_data)
+{
+  MechTextMeasure *measure = data;
+  MeasureParagraph *paragraph;
+  PangoFontMap *font_map;
+  PangoContext *context;
+  PangoLayout *layout;
+  gint height;
+  guint i;
+
+  font_map = g_private_get (&font_map_key);
+
+  if (!font_map)
+    {
+      font_map = pango_cairo_font_map_new ();
+      g_private_set (&font_map_key, font_map);
+    }
+
+  context = pango_font_map_create_context (font_map);
+  pango_context_set_font_description (context, measure->font_desc);
+  pango_cairo_context_set_resolution (context, measure->resolution);
+
+  if (measure->font_options)
+    pango_cairo_context_set_font_options (context, measure->font_options);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_width (layout, measure->width * PANGO_SCALE);
+
+  for (i = 0; i < measure->paragraphs->len; i++)
+    {
+      if (g_atomic_int_get (&measure->cancelled))
+        break;
+
+      paragraph = &g_array_index (measure->paragraphs, MeasureParagraph, i);
+      pango_layout_set_text (layout, paragraph->text, -1);
+      pango_layout_set_attributes (layout, paragraph->attrs);
+      pango_layout_get_pixel_size (layout, NULL, &height);
+      paragraph->height = height;
+    }
+
+  g_object_unref (layout);
+  g_object_unref (context);
+
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                   _text_measure_dispatch, measure, NULL);
+}
+
+static GThreadPool *
+_text_measure_get_pool (void)
+{
+  static GThreadPool *pool = NULL;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      /* A single worker keeps batches in order */
+      pool = g_thread_pool_new (_text_measure_func, NULL,
+                                1, FALSE, NULL);
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return pool;
+}
+
+static void
+_measure_paragraph_clear (MeasureParagraph *paragraph)
+{
+  g_free (paragraph->text);
+
+  if (paragraph->attrs)
+    pango_attr_list_unref (paragraph->attrs);
+}
+
+MechTextMeasure *
+_mech_text_measure_new (PangoContext *context,
+                        gdouble       width)
+{
+  const cairo_font_options_t *font_options;
+  MechTextMeasure *measure;
+
+  measure = g_slice_new0 (MechTextMeasure);
+  measure->font_desc =
+    pango_font_description_copy (pango_context_get_font_description (context));
+  measure->resolution = pango_cairo_context_get_resolution (context);
+  measure->width = width;
+  measure->paragraphs = g_array_new (FALSE, FALSE, sizeof (MeasureParagraph));
+
+  font_options = pango_cairo_context_get_font_options (context);
+
+  if (font_options)
+    measure->font_options = cairo_font_options_copy (font_options);
+
+  return measure;
+}
+
+void
+_mech_text_measure_add (MechTextMeasure *measure,
+                        guint            paragraph,
+                        gchar           *text,
+                        PangoAttrList   *attrs)
+{
+  MeasureParagraph new = { 0 };
+
+  new.paragraph = paragraph;
+  new.text = text;
+  new.attrs = attrs;
+  g_array_append_val (measure->paragraphs, new);
+
+  measure->size += strlen (text);
+}
+
+gsize
+_mech_text_measure_get_size (MechTextMeasure *measure)
+{
+  return measure->size;
+}
+
+guint
+_mech_text_measure_get_n_paragraphs (MechTextMeasure *measure)
+{
+  return measure->paragraphs->len;
+}
+
+void
+_mech_text_measure_get_paragraph (MechTextMeasure *measure,
+                                  guint            index,
+                                  guint           *paragraph,
+                                  gdouble         *height)
+{
+  MeasureParagraph *data;
+
+  data = &g_array_index (measure->paragraphs, MeasureParagraph, index);
+
+  if (paragraph)
+    *paragraph = data->paragraph;
+  if (height)
+    *height = data->height;
+}
+
+void
+_mech_text_measure_run_async (MechTextMeasure     *measure,
+                              MechTextMeasureFunc  func,
+                              gpointer             user_data)
+{
+  measure->func = func;
+  measure->user_data = user_data;
+  g_thread_pool_push (_text_measure_get_pool (), measure, NULL);
+}
+
+void
+_mech_text_measure_cancel (MechTextMeasure *measure)
+{
+  g_atomic_int_set (&measure->cancelled, TRUE);
+}
+
+void
+_mech_text_measure_free (MechTextMeasure *measure)
+{
+  guint i;
+
+  for (i = 0; i < measure->paragraphs->len; i++)
+    _measure_paragraph_clear (&g_array_index (measure->paragraphs,
+                                              MeasureParagraph, i));
+
+  g_array_unref (measure->paragraphs);
+  pango_font_description_free (measure->font_desc);
+
+  if (measure->font_options)
+    cairo_font_options_destroy (measure->font_options);
+
+  g_slice_free (MechTextMeasure, measure);
+}
@@ -0,0 +1,63 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MECH_TEXT_TREE_PRIVATE_H__
+#define __MECH_TEXT_TREE_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MechTextTree MechTextTree;
+typedef struct _MechTextTreeNode MechTextTreeNode;
+
+typedef enum {
+  MECH_TEXT_TREE_BYTES,
+  MECH_TEXT_TREE_CHARS,
+  MECH_TEXT_TREE_PARAGRAPHS,
+  MECH_TEXT_TREE_N_METRICS
+} MechTextTreeMetric;
+
+MechTextTree     * _mech_text_tree_new            (void);
+void               _mech_text_tree_free           (MechTextTree       *tree);
+
+MechTextTreeNode * _mech_text_tree_insert_before  (MechTextTree       *tree,
+                                                   MechTextTreeNode   *sibling,
+                                                   gpointer            data);
+void               _mech_text_tree_remove         (MechTextTree       *tree,
+                                                   MechTextTreeNode   *node);
+
+void               _mech_text_tree_node_set_counts (MechTextTreeNode  *node,
+                                                    gsize              bytes,
+                                                    gsize              chars,
+                                                    gsize              paragraphs);
+gsize              _mech_text_tree_node_get_count  (MechTextTreeNode  *node,
+                                                    MechTextTreeMetric metric);
+gpointer           _mech_text_tree_node_get_data   (MechTextTreeNode  *node);
+gsize              _mech_text_tree_node_get_offset (MechTextTreeNode  *node,
+                                                    MechTextTreeMetric metric);
+
+gsize              _mech_text_tree_get_total      (MechTextTree       *tree,
+                                                   MechTextTreeMetric  metric);
+MechTextTreeNode * _mech_text_tree_lookup         (MechTextTree       *tree,
+                                                   MechTextTreeMetric  metric,
+                                                   gsize               offset,
+                                                   gsize              *node_offset);
+
+G_END_DECLS
+
+#endif /* __MECH_TEXT_TREE_PRIVATE_H__ */
@@ -0,0 +1,345 @@
+/* Mechane:
+ * Copyright (C) 2012 Carlos Garnacho <carlosg@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mech-text-tree-private.h"
+
+/* Treap keeping the text buffer pieces in document order,
+ * each subtree caches the sum of its pieces' metrics, so
+ * offset <-> piece lookups are O(log n).
+ */
+struct _MechTextTreeNode
+{
+  MechTextTreeNode *parent;
+  MechTextTreeNode *left;
+  MechTextTreeNode *right;
+  gpointer data;
+  guint32 priority;
+
+  gsize counts[MECH_TEXT_TREE_N_METRICS];
+  gsize sums[MECH_TEXT_TREE_N_METRICS];
+};
+
+struct _MechTextTree
+{
+  MechTextTreeNode *root;
+  guint32 seed;
+};
+
+static guint32
+_text_tree_next_priority (MechTextTree *tree)
+{
+  /* xorshift32, avoids the global lock in g_random_* */
+  tree->seed ^= tree->seed << 13;
+  tree->seed ^= tree->seed >> 17;
+  tree->seed ^= tree->seed << 5;
+
+  return tree->seed;
+}
+
+static void
+_text_tree_node_update_sums (MechTextTreeNode *node)
+{
+  guint i;
+
+  for (i = 0; i < MECH_TEXT_TREE_N_METRICS; i++)
+    {
+      node->sums[i] = node->counts[i];
+
+      if (node->left)
+        node->sums[i] += node->left->sums[i];
+      if (node->right)
+        node->sums[i] += node->right->sums[i];
+    }
+}
+
+static void
+_text_tree_node_propagate (MechTextTreeNode *node)
+{
+  while (node)
+    {
+      _text_tree_node_update_sums (node);
+      node = node->parent;
+    }
+}
+
+static void
+_text_tree_rotate_up (MechTextTree     *tree,
+                      MechTextTreeNode *node)
+{
+  MechTextTreeNode *parent, *grandparent;
+
+  parent = node->parent;
+  grandparent = parent->parent;
+
+  if (parent->left == node)
+    {
+      parent->left = node->right;
+
+      if (node->right)
+        node->right->parent = parent;
+
+      node->right = parent;
+    }
+  else
+    {
+      parent->right = node->left;
+
+      if (node->left)
+        node->left->parent = parent;
+
+      node->left = parent;
+    }
+
+  parent->parent = node;
+  node->parent = grandparent;
+
+  if (!grandparent)
+    tree->root = node;
+  else if (grandparent->left == parent)
+    grandparent->left = node;
+  else
+    grandparent->right = node;
+
+  _text_tree_node_update_sums (parent);
+  _text_tree_node_update_sums (node);
+}
+
+static void
+_text_tree_node_free (MechTextTreeNode *node)
+{
+  if (!node)
+    return;
+
+  _text_tree_node_free (node->left);
+  _text_tree_node_free (node->right);
+  g_slice_free (MechTextTreeNode, node);
+}
+
+MechTextTree *
+_mech_text_tree_new (void)
+{
+  MechTextTree *tree;
+
+  tree = g_slice_new0 (MechTextTree);
+  tree->seed = g_random_int () | 1;
+
+  return tree;
+}
+
+void
+_mech_text_tree_free (MechTextTree *tree)
+{
+  _text_tree_node_free (tree->root);
+  g_slice_free (MechTextTree, tree);
+}
+
+MechTextTreeNode *
+_mech_text_tree_insert_before (MechTextTree     *tree,
+                               MechTextTreeNode *sibling,
+                               gpointer          data)
+{
+  MechTextTreeNode *node, *parent;
+
+  node = g_slice_new0 (MechTextTreeNode);
+  node->priority = _text_tree_next_priority (tree);
+  node->data = data;
+
+  if (!tree->root)
+    {
+      tree->root = node;
+      return node;
+    }
+
+  /* Find the in-order predecessor slot of sibling,
+   * or the rightmost slot if appending.
+   */
+  if (!sibling)
+    {
+      parent = tree->root;
+
+      while (parent->right)
+        parent = parent->right;
+
+      parent->right = node;
+    }
+  else if (!sibling->left)
+    {
+      parent = sibling;
+      parent->left = node;
+    }
+  else
+    {
+      parent = sibling->left;
+
+      while (parent->right)
+        parent = parent->right;
+
+      parent->right = node;
+    }
+
+  node->parent = parent;
+
+  /* The node is still empty, so sums above
+   * it are unaffected by the insertion.
+   */
+  while (node->parent && node->parent->priority < node->priority)
+    _text_tree_rotate_up (tree, node);
+
+  return node;
+}
+
+void
+_mech_text_tree_remove (MechTextTree     *tree,
+                        MechTextTreeNode *node)
+{
+  MechTextTreeNode *parent;
+
+  while (node->left || node->right)
+    {
+      MechTextTreeNode *child;
+
+      if (!node->left)
+        child = node->right;
+      else if (!node->right)
+        child = node->left;
+      else if (node->left->priority > node->right->priority)
+        child = node->left;
+      else
+        child = node->right;
+
+      _text_tree_rotate_up (tree, child);
+    }
+
+  parent = node->parent;
+
+  if (!parent)
+    tree->root = NULL;
+  else
+    {
+      if (parent->left == node)
+        parent->left = NULL;
+      else
+        parent->right = NULL;
+
+      _text_tree_node_propagate (parent);
+    }
+
+  g_slice_free (MechTextTreeNode, node);
+}
+
+void
+_mech_text_tree_node_set_counts (MechTextTreeNode *node,
+                                 gsize             bytes,
+                                 gsize             chars,
+                                 gsize             paragraphs)
+{
+  if (node->counts[MECH_TEXT_TREE_BYTES] == bytes &&
+      node->counts[MECH_TEXT_TREE_CHARS] == chars &&
+      node->counts[MECH_TEXT_TREE_PARAGRAPHS] == paragraphs)
+    return;
+
+  node->counts[MECH_TEXT_TREE_BYTES] = bytes;
+  node->counts[MECH_TEXT_TREE_CHARS] = chars;
+  node->counts[MECH_TEXT_TREE_PARAGRAPHS] = paragraphs;
+  _text_tree_node_propagate (node);
+}
+
+gsize
+_mech_text_tree_node_get_count (MechTextTreeNode   *node,
+                                MechTextTreeMetric  metric)
+{
+  return node->counts[metric];
+}
+
+gpointer
+_mech_text_tree_node_get_data (MechTextTreeNode *node)
+{
+  return node->data;
+}
+
+gsize
+_mech_text_tree_node_get_offset (MechTextTreeNode   *node,
+                                 MechTextTreeMetric  metric)
+{
+  gsize offset = 0;
+
+  if (node->left)
+    offset += node->left->sums[metric];
+
+  while (node->parent)
+    {
+      if (node->parent->right == node)
+        {
+          offset += node->parent->counts[metric];
+
+          if (node->parent->left)
+            offset += node->parent->left->sums[metric];
+        }
+
+      node = node->parent;
+    }
+
+  return offset;
+}
+
+gsize
+_mech_text_tree_get_total (MechTextTree       *tree,
+                           MechTextTreeMetric  metric)
+{
+  if (!tree->root)
+    return 0;
+
+  return tree->root->sums[metric];
+}
+
+MechTextTreeNode *
+_mech_text_tree_lookup (MechTextTree       *tree,
+                        MechTextTreeMetric  metric,
+                        gsize               offset,
+                        gsize              *node_offset)
+{
+  MechTextTreeNode *node = tree->root;
+
+  while (node)
+    {
+      gsize left = 0;
+
+      if (node->left)
+        left = node->left->sums[metric];
+
+      if (offset < left)
+        {
+          node = node->left;
+          continue;
+        }
+
+      offset -= left;
+
+      if (offset < node->counts[metric])
+        {
+          if (node_offset)
+            *node_offset = offset;
+
+          return node;
+        }
+
+      offset -= node->counts[metric];
+      node = node->right;
+    }
+
+  return NULL;
+}
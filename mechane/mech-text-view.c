@@ -18,12 +18,20 @@
 #include <pango/pangocairo.h>
 #include <pango/pango.h>
 #include <cairo-gobject.h>
+#include <string.h>
 #include <math.h>
 #include "mech-text-view.h"
 #include "mech-text-range.h"
 #include "mech-text.h"
+#include "mech-text-measure-private.h"
 #include "mech-area-private.h"
 
+#define MEASURE_BATCH_SIZE       (64 * 1024)
+#define MEASURE_BATCH_PARAGRAPHS 256
+#define MEASURE_SCAN_PARAGRAPHS  4096
+
+#define DEFAULT_LAYOUT_CACHE_SIZE (4 * 1024 * 1024)
+
 enum {
   PROP_BUFFER = 1
 };
@@ -37,6 +45,10 @@ typedef struct _MechTextViewPrivate MechTextViewPrivate;
 typedef struct _TextIterator TextIterator;
 typedef struct _ParagraphCalcExtentsData ParagraphCalcExtentsData;
 typedef struct _FindIterData FindIterData;
+typedef struct _ComposeStyleData ComposeStyleData;
+typedef struct _LayoutDamageData LayoutDamageData;
+typedef struct _LayoutLineSpan LayoutLineSpan;
+typedef struct _CachedLayout CachedLayout;
 
 struct _TextIterator
 {
@@ -57,6 +69,38 @@ struct _FindIterData
   guint found : 1;
 };
 
+struct _ComposeStyleData
+{
+  PangoAttrList *list;
+  guint offset;
+};
+
+struct _LayoutLineSpan
+{
+  gint start_index;
+  gint length;
+  gint y0;
+  gint y1;
+};
+
+struct _LayoutDamageData
+{
+  PangoLayout *last_layout;
+  cairo_region_t *damage;
+  gdouble damage_below;
+  guint first_paragraph;
+  gdouble first_y;
+  guint has_first : 1;
+  guint restyled  : 1;
+};
+
+struct _CachedLayout
+{
+  PangoLayout *layout;
+  guint mark_id;
+  gsize size;
+};
+
 struct _ParagraphCalcExtentsData
 {
   PangoLayout *calc_layout;
@@ -74,16 +118,42 @@ struct _MechTextViewPrivate
   guint paragraph_layout_id;
   guint paragraph_extents_id;
   guint text_style_id;
+  guint paragraph_height_id;
   gdouble layout_width;
 
   gssize buffer_bytes;
   MechTextRange *visible;
   gssize visible_start_offset;
+
+  MechTextMeasure *measure;
+  guint measure_id;
+  guint measure_first;
+  guint measure_last;
+  guint measure_next;
+  gdouble measured_height;
+  gssize measured_bytes;
+
+  guint edit_first;
+  guint edit_last;
+  guint edit_n_paragraphs;
+
+  /* Layouts of paragraphs out of the visible range, most recent first */
+  GQueue layout_cache;
+  GHashTable *cached_layouts;
+  gsize layout_cache_size;
+  gsize layout_cache_max;
+  guint layout_cache_hits;
+  guint layout_cache_misses;
+  guint layout_cache_evictions;
+
+  guint follow_tail : 1;
+  guint edit_measured : 1;
 };
 
 static void mech_text_view_text_init   (MechTextInterface *iface);
 static void _mech_text_view_set_buffer (MechTextView      *view,
                                         MechTextBuffer    *buffer);
+static void _text_view_queue_measure   (MechTextView      *view);
 
 G_DEFINE_TYPE_WITH_CODE (MechTextView, mech_text_view, MECH_TYPE_VIEW,
                          G_ADD_PRIVATE (MechTextView)
@@ -159,16 +229,26 @@ _mech_text_view_compose_style (MechTextView *view,
                                MechTextIter *end,
                                gpointer      user_data)
 {
-  PangoAttrList **list = user_data;
+  ComposeStyleData *data = user_data;
   PangoFontDescription *font_desc;
   MechTextAttributes *attributes;
   guint offset_start, offset_end;
   MechTextViewPrivate *priv;
-  MechTextIter para_start;
+  PangoAttrList **list;
   PangoAttribute *attr;
   MechColor *bg, *fg;
 
   priv = mech_text_view_get_instance_private (view);
+  list = &data->list;
+
+  /* Runs come in order from the paragraph start, so
+   * offsets are accumulated rather than looked up.
+   */
+  offset_start = data->offset;
+  offset_end = offset_start +
+    mech_text_buffer_get_byte_offset (priv->buffer, start, end);
+  data->offset = offset_end;
+
   mech_text_buffer_get_data (priv->buffer, start,
                              priv->text_style_id,
                              &attributes, 0);
@@ -178,10 +258,6 @@ _mech_text_view_compose_style (MechTextView *view,
   if (!*list)
     *list = pango_attr_list_new ();
 
-  mech_text_buffer_paragraph_extents (priv->buffer, start, &para_start, NULL);
-  offset_start = mech_text_buffer_get_byte_offset (priv->buffer, &para_start, start);
-  offset_end = mech_text_buffer_get_byte_offset (priv->buffer, &para_start, end);
-
   g_object_get (attributes,
                 "font-description", &font_desc,
                 "background", &bg,
@@ -222,13 +298,13 @@ _mech_text_view_compose_style (MechTextView *view,
   return TRUE;
 }
 
-static void
-_mech_text_view_update_style (MechTextView *view,
-                              PangoLayout  *layout,
-                              MechTextIter *start,
-                              MechTextIter *end)
+static gchar *
+_mech_text_view_get_paragraph_text (MechTextView   *view,
+                                    MechTextIter   *start,
+                                    MechTextIter   *end,
+                                    PangoAttrList **attrs)
 {
-  PangoAttrList *list = NULL;
+  ComposeStyleData data = { NULL, 0 };
   MechTextViewPrivate *priv;
   MechTextIter layout_end;
   TextIterator *iterator;
@@ -261,22 +337,39 @@ _mech_text_view_update_style (MechTextView *view,
     }
 
   text = mech_text_buffer_get_text (priv->buffer, start, &layout_end);
-  pango_layout_set_text (layout, text, -1);
-  g_free (text);
 
   iterator = _style_iterator_new (view, start, end,
                                   _mech_text_view_compose_style,
-                                  &list);
+                                  &data);
   while (_style_iterator_next_run (iterator))
     ;
 
   _text_iterator_free (iterator);
+  *attrs = data.list;
+
+  return text;
+}
 
-  if (list)
+static void
+_mech_text_view_update_style (MechTextView *view,
+                              PangoLayout  *layout,
+                              MechTextIter *start,
+                              MechTextIter *end)
+{
+  PangoAttrList *attrs;
+  gchar *text;
+
+  text = _mech_text_view_get_paragraph_text (view, start, end, &attrs);
+  pango_layout_set_text (layout, text, -1);
+  g_free (text);
+
+  if (attrs)
     {
-      pango_layout_set_attributes (layout, list);
-      pango_attr_list_unref (list);
+      pango_layout_set_attributes (layout, attrs);
+      pango_attr_list_unref (attrs);
     }
+  else if (pango_layout_get_attributes (layout))
+    pango_layout_set_attributes (layout, NULL);
 }
 
 /* Per-paragraph iterator */
@@ -368,6 +461,204 @@ _mech_text_view_paragraph_foreach (MechTextView        *view,
   _text_iterator_free (iterator);
 }
 
+/* Layout cache */
+static gsize
+_text_view_layout_get_size (PangoLayout *layout)
+{
+  const gchar *text;
+
+  /* Rough estimate of the shaped text footprint */
+  text = pango_layout_get_text (layout);
+
+  return 256 + strlen (text) +
+    pango_layout_get_character_count (layout) *
+    (sizeof (PangoGlyphInfo) + sizeof (gint)) +
+    pango_layout_get_line_count (layout) * 64;
+}
+
+static void
+_text_view_cached_layout_free (MechTextView *view,
+                               CachedLayout *cached,
+                               gboolean      unset)
+{
+  MechTextIter iter, para_start, para_end;
+  MechTextViewPrivate *priv;
+  PangoLayout *layout;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (unset && priv->buffer &&
+      mech_text_buffer_get_iter_at_mark (priv->buffer, cached->mark_id, &iter) &&
+      !mech_text_buffer_iter_is_end (&iter))
+    {
+      mech_text_buffer_get_data (priv->buffer, &iter,
+                                 priv->paragraph_layout_id, &layout, 0);
+
+      if (layout == cached->layout)
+        {
+          mech_text_buffer_paragraph_extents (priv->buffer, &iter,
+                                              &para_start, &para_end);
+          mech_text_buffer_set_data (priv->buffer, &para_start, &para_end,
+                                     priv->paragraph_layout_id, NULL,
+                                     0);
+        }
+    }
+
+  if (priv->buffer)
+    mech_text_buffer_delete_mark (priv->buffer, cached->mark_id);
+
+  g_object_unref (cached->layout);
+  g_slice_free (CachedLayout, cached);
+}
+
+static void
+_text_view_trim_layout_cache (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+  CachedLayout *cached;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  while (priv->layout_cache_size > priv->layout_cache_max &&
+         !g_queue_is_empty (&priv->layout_cache))
+    {
+      cached = g_queue_pop_tail (&priv->layout_cache);
+      g_hash_table_remove (priv->cached_layouts, cached->layout);
+      priv->layout_cache_size -= cached->size;
+      priv->layout_cache_evictions++;
+
+      _text_view_cached_layout_free (view, cached, TRUE);
+    }
+}
+
+static void
+_text_view_cache_layout (MechTextView *view,
+                         MechTextIter *para_start,
+                         PangoLayout  *layout)
+{
+  MechTextViewPrivate *priv;
+  CachedLayout *cached;
+  GList *link;
+
+  priv = mech_text_view_get_instance_private (view);
+  link = g_hash_table_lookup (priv->cached_layouts, layout);
+
+  if (link)
+    {
+      g_queue_unlink (&priv->layout_cache, link);
+      g_queue_push_head_link (&priv->layout_cache, link);
+      return;
+    }
+
+  cached = g_slice_new0 (CachedLayout);
+  cached->layout = g_object_ref (layout);
+  cached->mark_id = mech_text_buffer_create_mark (priv->buffer, para_start);
+  cached->size = _text_view_layout_get_size (layout);
+
+  g_queue_push_head (&priv->layout_cache, cached);
+  g_hash_table_insert (priv->cached_layouts, layout,
+                       priv->layout_cache.head);
+  priv->layout_cache_size += cached->size;
+}
+
+static gboolean
+_text_view_uncache_layout (MechTextView *view,
+                           PangoLayout  *layout)
+{
+  MechTextViewPrivate *priv;
+  CachedLayout *cached;
+  GList *link;
+
+  priv = mech_text_view_get_instance_private (view);
+  link = g_hash_table_lookup (priv->cached_layouts, layout);
+
+  if (!link)
+    return FALSE;
+
+  cached = link->data;
+  g_queue_delete_link (&priv->layout_cache, link);
+  g_hash_table_remove (priv->cached_layouts, layout);
+  priv->layout_cache_size -= cached->size;
+
+  _text_view_cached_layout_free (view, cached, FALSE);
+
+  return TRUE;
+}
+
+static void
+_text_view_clear_layout_cache (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+  CachedLayout *cached;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  while ((cached = g_queue_pop_head (&priv->layout_cache)) != NULL)
+    _text_view_cached_layout_free (view, cached, TRUE);
+
+  g_hash_table_remove_all (priv->cached_layouts);
+  priv->layout_cache_size = 0;
+}
+
+static void
+_text_view_uncache_edited (MechTextView *view,
+                           guint         first,
+                           guint         last)
+{
+  MechTextIter para_start, para_end;
+  MechTextViewPrivate *priv;
+  PangoLayout *layout;
+  CachedLayout *cached;
+  guint paragraph;
+  GList *link;
+
+  priv = mech_text_view_get_instance_private (view);
+  paragraph = first;
+
+  /* Only the edited paragraphs are looked up, through
+   * the layout they hold as buffer data.
+   */
+  while (paragraph < last &&
+         mech_text_buffer_get_iter_at_paragraph (priv->buffer,
+                                                 &para_start, paragraph))
+    {
+      mech_text_buffer_get_data (priv->buffer, &para_start,
+                                 priv->paragraph_layout_id, &layout, 0);
+      link = layout ? g_hash_table_lookup (priv->cached_layouts, layout) : NULL;
+
+      if (!link)
+        {
+          paragraph++;
+          continue;
+        }
+
+      cached = link->data;
+
+      /* Paragraphs split by the edit share the stale layout */
+      while (layout == cached->layout)
+        {
+          mech_text_buffer_get_iter_at_paragraph (priv->buffer, &para_end,
+                                                  ++paragraph);
+          mech_text_buffer_set_data (priv->buffer, &para_start, &para_end,
+                                     priv->paragraph_layout_id, NULL,
+                                     0);
+
+          if (!mech_text_buffer_get_iter_at_paragraph (priv->buffer,
+                                                       &para_start,
+                                                       paragraph))
+            break;
+
+          mech_text_buffer_get_data (priv->buffer, &para_start,
+                                     priv->paragraph_layout_id, &layout, 0);
+        }
+
+      g_queue_delete_link (&priv->layout_cache, link);
+      g_hash_table_remove (priv->cached_layouts, cached->layout);
+      priv->layout_cache_size -= cached->size;
+      _text_view_cached_layout_free (view, cached, FALSE);
+    }
+}
+
 /* Iterator to calculate extents */
 static gboolean
 _text_view_paragraph_calc_extents (MechTextView *view,
@@ -392,6 +683,7 @@ _text_view_paragraph_calc_extents (MechTextView *view,
           MechRenderer *renderer;
           PangoContext *context;
 
+          priv->layout_cache_misses++;
           renderer = mech_area_get_renderer (MECH_AREA (view));
           context = mech_renderer_get_font_context (renderer);
           layout = pango_layout_new (context);
@@ -405,8 +697,9 @@ _text_view_paragraph_calc_extents (MechTextView *view,
 
       _mech_text_view_update_style (view, layout, start, end);
     }
-  else if (data->force_update)
-    _mech_text_view_update_style (view, layout, start, end);
+  else if (data->force_update &&
+           _text_view_uncache_layout (view, layout))
+    priv->layout_cache_hits++;
 
   pango_layout_set_width (layout, data->width * PANGO_SCALE);
   pango_layout_get_pixel_size (layout, NULL, &layout_height);
@@ -803,7 +1096,11 @@ mech_text_view_get_property (GObject    *object,
 static void
 mech_text_view_finalize (GObject *object)
 {
+  MechTextViewPrivate *priv;
+
+  priv = mech_text_view_get_instance_private ((MechTextView *) object);
   _mech_text_view_set_buffer ((MechTextView *) object, NULL);
+  g_hash_table_unref (priv->cached_layouts);
 
   G_OBJECT_CLASS (mech_text_view_parent_class)->finalize (object);
 }
@@ -857,27 +1154,180 @@ mech_text_view_draw (MechArea *area,
                                        _text_view_paragraph_render, cr);
 }
 
+static GArray *
+_text_view_layout_get_lines (PangoLayout *layout)
+{
+  PangoLayoutIter *iter;
+  LayoutLineSpan span;
+  GArray *lines;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (LayoutLineSpan));
+  iter = pango_layout_get_iter (layout);
+
+  do
+    {
+      PangoLayoutLine *line;
+
+      line = pango_layout_iter_get_line_readonly (iter);
+      span.start_index = line->start_index;
+      span.length = line->length;
+      pango_layout_iter_get_line_yrange (iter, &span.y0, &span.y1);
+      g_array_append_val (lines, span);
+    }
+  while (pango_layout_iter_next_line (iter));
+
+  pango_layout_iter_free (iter);
+
+  return lines;
+}
+
+static gboolean
+_layout_line_span_equal (LayoutLineSpan *old,
+                         LayoutLineSpan *new,
+                         gint            delta)
+{
+  return (old->start_index + delta == new->start_index &&
+          old->length == new->length &&
+          old->y1 - old->y0 == new->y1 - new->y0);
+}
+
+static void
+_text_view_add_layout_damage (LayoutDamageData  *data,
+                              cairo_rectangle_t *rect,
+                              GArray            *old_lines,
+                              GArray            *new_lines,
+                              gint               delta)
+{
+  LayoutLineSpan *old, *new;
+  cairo_rectangle_int_t damage;
+  guint n_old, n_new, head, tail;
+  gint y0, y1;
+
+  n_old = old_lines->len;
+  n_new = new_lines->len;
+  old = (LayoutLineSpan *) old_lines->data;
+  new = (LayoutLineSpan *) new_lines->data;
+
+  /* Lines before the edit keep their indices, lines
+   * after it are shifted by the paragraph size change.
+   */
+  for (head = 0; head < n_old && head < n_new; head++)
+    {
+      if (!_layout_line_span_equal (&old[head], &new[head], 0))
+        break;
+    }
+
+  for (tail = 0; tail < n_old - head && tail < n_new - head; tail++)
+    {
+      if (!_layout_line_span_equal (&old[n_old - tail - 1],
+                                    &new[n_new - tail - 1], delta))
+        break;
+    }
+
+  if (head == n_new && n_old == n_new)
+    return;
+
+  y0 = (head < n_new) ? new[head].y0 : new[n_new - 1].y1;
+  y1 = (head < n_new - tail) ? new[n_new - tail - 1].y1 : y0;
+
+  if (old[n_old - 1].y1 != new[n_new - 1].y1)
+    {
+      /* Paragraph height changed, everything below moves */
+      data->damage_below = MIN (data->damage_below,
+                                rect->y + (gdouble) y0 / PANGO_SCALE);
+      return;
+    }
+
+  damage.x = floor (rect->x);
+  damage.y = floor (rect->y + (gdouble) y0 / PANGO_SCALE);
+  damage.width = ceil (rect->x + rect->width) - damage.x;
+  damage.height = ceil (rect->y + (gdouble) y1 / PANGO_SCALE) - damage.y;
+  cairo_region_union_rectangle (data->damage, &damage);
+}
+
 static gboolean
 _text_view_store_layout (MechTextView *view,
                          MechTextIter *start,
                          MechTextIter *end,
                          gpointer      user_data)
 {
+  LayoutDamageData *data = user_data;
+  GArray *old_lines = NULL;
   MechTextViewPrivate *priv;
-  MechRenderer *renderer;
-  PangoContext *context;
+  cairo_rectangle_t *rect;
   PangoLayout *layout;
+  gint old_len = 0;
 
   priv = mech_text_view_get_instance_private (view);
-  renderer = mech_area_get_renderer (MECH_AREA (view));
-  context = mech_renderer_get_font_context (renderer);
+  mech_text_buffer_get_data (priv->buffer, start,
+                             priv->paragraph_layout_id, &layout,
+                             priv->paragraph_extents_id, &rect,
+                             0);
+
+  /* A paragraph split by the edit still shares
+   * the layout with the paragraph preceding it.
+   */
+  if (layout && layout != data->last_layout)
+    {
+      g_object_ref (layout);
+
+      if (rect)
+        {
+          old_lines = _text_view_layout_get_lines (layout);
+          old_len = strlen (pango_layout_get_text (layout));
+        }
+    }
+  else
+    {
+      MechRenderer *renderer;
+      PangoContext *context;
+
+      renderer = mech_area_get_renderer (MECH_AREA (view));
+      context = mech_renderer_get_font_context (renderer);
+      layout = pango_layout_new (context);
+    }
+
+  if (rect && !data->has_first)
+    {
+      data->first_paragraph =
+        mech_text_buffer_iter_get_paragraph (priv->buffer, start);
+      data->first_y = rect->y;
+      data->has_first = TRUE;
+    }
 
-  layout = pango_layout_new (context);
   _mech_text_view_update_style (view, layout, start, end);
   pango_layout_set_width (layout, priv->layout_width * PANGO_SCALE);
 
+  if (old_lines)
+    {
+      GArray *new_lines;
+
+      new_lines = _text_view_layout_get_lines (layout);
+      _text_view_add_layout_damage (data, rect, old_lines, new_lines,
+                                    strlen (pango_layout_get_text (layout)) -
+                                    old_len);
+      g_array_unref (new_lines);
+      g_array_unref (old_lines);
+
+      if (data->restyled)
+        {
+          cairo_rectangle_int_t damage;
+
+          damage.x = floor (rect->x);
+          damage.y = floor (rect->y);
+          damage.width = ceil (rect->x + rect->width) - damage.x;
+          damage.height = ceil (rect->y + rect->height) - damage.y;
+          cairo_region_union_rectangle (data->damage, &damage);
+        }
+    }
+  else if (rect)
+    data->damage_below = MIN (data->damage_below, rect->y);
+  else
+    data->damage_below = -G_MAXDOUBLE;
+
   mech_text_buffer_set_data (priv->buffer, start, end,
                              priv->paragraph_layout_id, layout, 0);
+  data->last_layout = layout;
   g_object_unref (layout);
 
   return TRUE;
@@ -914,6 +1364,271 @@ _text_view_get_visible_yrange (MechTextView *view,
   return TRUE;
 }
 
+/* Background measurement, paragraph heights are stored
+ * as they come, and feed the total height estimation.
+ */
+static void
+_text_view_measure_done (MechTextMeasure *measure,
+                         gpointer         user_data)
+{
+  MechTextView *view = user_data;
+  MechTextViewPrivate *priv;
+  MechTextIter start, end;
+  gdouble height, stored;
+  guint i, paragraph;
+
+  priv = mech_text_view_get_instance_private (view);
+  priv->measure = NULL;
+
+  for (i = 0; i < _mech_text_measure_get_n_paragraphs (measure); i++)
+    {
+      _mech_text_measure_get_paragraph (measure, i, &paragraph, &height);
+      paragraph += priv->measure_first;
+
+      if (!mech_text_buffer_get_iter_at_paragraph (priv->buffer,
+                                                   &start, paragraph))
+        break;
+
+      mech_text_buffer_get_data (priv->buffer, &start,
+                                 priv->paragraph_height_id, &stored, 0);
+      if (stored > 0)
+        continue;
+
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer,
+                                              &end, paragraph + 1);
+      priv->measured_bytes +=
+        mech_text_buffer_get_byte_offset (priv->buffer, &start, &end);
+      priv->measured_height += height;
+
+      mech_text_buffer_set_data (priv->buffer, &start, &end,
+                                 priv->paragraph_height_id, height, 0);
+    }
+
+  mech_area_check_size ((MechArea *) view);
+  _text_view_queue_measure (view);
+}
+
+static gboolean
+_text_view_measure_idle (gpointer user_data)
+{
+  MechTextView *view = user_data;
+  MechTextMeasure *measure = NULL;
+  guint i, n_paragraphs, scanned;
+  MechTextViewPrivate *priv;
+  MechRenderer *renderer;
+  PangoAttrList *attrs;
+  MechTextIter start, end;
+  gdouble height;
+  gchar *text;
+
+  priv = mech_text_view_get_instance_private (view);
+  priv->measure_id = 0;
+  renderer = mech_area_get_renderer ((MechArea *) view);
+
+  if (!priv->buffer || !renderer || priv->layout_width <= 0)
+    return FALSE;
+
+  n_paragraphs = mech_text_buffer_get_paragraph_count (priv->buffer);
+  i = priv->measure_next;
+  scanned = 0;
+
+  while (i < n_paragraphs && scanned < MEASURE_SCAN_PARAGRAPHS)
+    {
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &start, i);
+      mech_text_buffer_get_data (priv->buffer, &start,
+                                 priv->paragraph_height_id, &height, 0);
+      i++;
+      scanned++;
+
+      if (height > 0)
+        continue;
+
+      if (!measure)
+        {
+          PangoContext *context;
+
+          context = mech_renderer_get_font_context (renderer);
+          measure = _mech_text_measure_new (context, priv->layout_width);
+          priv->measure_first = i - 1;
+        }
+
+      /* Text and attributes are snapshotted here, the
+       * worker thread never touches the buffer.
+       */
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &end, i);
+      text = _mech_text_view_get_paragraph_text (view, &start, &end, &attrs);
+      _mech_text_measure_add (measure, i - 1 - priv->measure_first,
+                              text, attrs);
+
+      if (_mech_text_measure_get_size (measure) >= MEASURE_BATCH_SIZE ||
+          _mech_text_measure_get_n_paragraphs (measure) >=
+          MEASURE_BATCH_PARAGRAPHS)
+        break;
+    }
+
+  priv->measure_next = i;
+
+  if (measure)
+    {
+      priv->measure = measure;
+      priv->measure_last = i;
+      _mech_text_measure_run_async (measure, _text_view_measure_done, view);
+    }
+  else if (i < n_paragraphs)
+    _text_view_queue_measure (view);
+
+  return FALSE;
+}
+
+static void
+_text_view_queue_measure (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (priv->measure_id || priv->measure || !priv->buffer)
+    return;
+
+  priv->measure_id = g_idle_add_full (G_PRIORITY_LOW,
+                                      _text_view_measure_idle,
+                                      view, NULL);
+}
+
+static void
+_text_view_cancel_measure (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (priv->measure)
+    {
+      _mech_text_measure_cancel (priv->measure);
+      priv->measure_next = MIN (priv->measure_next, priv->measure_first);
+      priv->measure = NULL;
+    }
+
+  if (priv->measure_id)
+    {
+      g_source_remove (priv->measure_id);
+      priv->measure_id = 0;
+    }
+}
+
+static void
+_text_view_reset_heights (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+  MechTextIter start, end;
+
+  priv = mech_text_view_get_instance_private (view);
+  _text_view_cancel_measure (view);
+
+  priv->measured_height = 0;
+  priv->measured_bytes = 0;
+  priv->measure_next = 0;
+
+  if (!priv->buffer)
+    return;
+
+  mech_text_buffer_get_bounds (priv->buffer, &start, &end);
+
+  if (mech_text_buffer_iter_compare (&start, &end) != 0)
+    mech_text_buffer_set_datav (priv->buffer, &start, &end,
+                                priv->paragraph_height_id, NULL);
+
+  _text_view_queue_measure (view);
+}
+
+static void
+_text_view_forget_heights (MechTextView *view,
+                           MechTextIter *start,
+                           MechTextIter *end)
+{
+  MechTextIter para_start, para_end;
+  guint first, last, n_paragraphs, i;
+  MechTextViewPrivate *priv;
+  gdouble height;
+
+  priv = mech_text_view_get_instance_private (view);
+  n_paragraphs = mech_text_buffer_get_paragraph_count (priv->buffer);
+  first = mech_text_buffer_iter_get_paragraph (priv->buffer, start);
+  last = mech_text_buffer_iter_get_paragraph (priv->buffer, end);
+
+  /* Edits may join or split the surrounding paragraphs */
+  first = (first > 0) ? first - 1 : 0;
+  last = MIN (last + 2, n_paragraphs);
+  priv->edit_measured = FALSE;
+
+  for (i = first; i < last; i++)
+    {
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &para_start, i);
+      mech_text_buffer_get_data (priv->buffer, &para_start,
+                                 priv->paragraph_height_id, &height, 0);
+      if (height <= 0)
+        continue;
+
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &para_end, i + 1);
+      priv->measured_bytes -=
+        mech_text_buffer_get_byte_offset (priv->buffer,
+                                          &para_start, &para_end);
+      priv->measured_height -= height;
+      priv->edit_measured = TRUE;
+    }
+
+  if (priv->measured_bytes <= 0)
+    {
+      priv->measured_bytes = 0;
+      priv->measured_height = 0;
+    }
+
+  /* Batches before the edit may go on, later ones get shifted */
+  if (priv->measure &&
+      first < priv->measure_last && last > priv->measure_first)
+    _text_view_cancel_measure (view);
+
+  priv->measure_next = MIN (priv->measure_next, first);
+  priv->edit_first = first;
+  priv->edit_last = last;
+  priv->edit_n_paragraphs = n_paragraphs;
+}
+
+static void
+_text_view_finish_edit (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+  MechTextIter start, end;
+  gint delta, last;
+
+  priv = mech_text_view_get_instance_private (view);
+  delta = (gint) mech_text_buffer_get_paragraph_count (priv->buffer) -
+    (gint) priv->edit_n_paragraphs;
+  last = MAX ((gint) priv->edit_last + delta, (gint) priv->edit_first);
+
+  if (priv->measure && priv->edit_last <= priv->measure_first)
+    {
+      priv->measure_first += delta;
+      priv->measure_last += delta;
+    }
+
+  if (!g_queue_is_empty (&priv->layout_cache))
+    _text_view_uncache_edited (view, priv->edit_first, last);
+
+  if (priv->edit_measured)
+    {
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &start,
+                                              priv->edit_first);
+      mech_text_buffer_get_iter_at_paragraph (priv->buffer, &end, last);
+
+      if (mech_text_buffer_iter_compare (&start, &end) < 0)
+        mech_text_buffer_set_datav (priv->buffer, &start, &end,
+                                    priv->paragraph_height_id, NULL);
+    }
+
+  _text_view_queue_measure (view);
+}
+
 static gdouble
 _text_view_guess_height (MechTextView *view,
                          gdouble       width,
@@ -926,6 +1641,18 @@ _text_view_guess_height (MechTextView *view,
 
   priv = mech_text_view_get_instance_private (view);
 
+  /* Extrapolate from the paragraphs measured in the background,
+   * this converges to the exact height as measuring progresses.
+   */
+  if (priv->measured_bytes > 0 && width == priv->layout_width)
+    {
+      if (n_bytes == priv->buffer_bytes &&
+          priv->measured_bytes >= priv->buffer_bytes)
+        return priv->measured_height;
+
+      return round (n_bytes * priv->measured_height / priv->measured_bytes);
+    }
+
   if (mech_text_range_get_bounds (priv->visible, &start, &end))
     {
       _text_view_get_visible_yrange (view, NULL, &height);
@@ -1070,7 +1797,12 @@ mech_text_view_allocate_size (MechArea *area,
         _mech_text_view_recalculate_visible (view, width);
     }
 
-  priv->layout_width = width;
+  if (width != priv->layout_width)
+    {
+      priv->layout_width = width;
+      _text_view_reset_heights (view);
+    }
+
   mech_area_redraw (area, NULL);
   MECH_AREA_CLASS (mech_text_view_parent_class)->allocate_size (area,
                                                                 width, height);
@@ -1142,13 +1874,94 @@ mech_text_view_get_boundaries (MechView *view,
 }
 
 static void
-_text_view_store_layouts (MechTextView *view,
-                          MechTextIter *from,
-                          MechTextIter *to)
+_text_view_refresh_layouts (MechTextView *view,
+                            MechTextIter *from,
+                            MechTextIter *to,
+                            gboolean      restyled)
 {
+  MechTextIter visible_start, visible_end, first;
+  cairo_rectangle_int_t below;
+  LayoutDamageData data = { 0 };
+  MechTextViewPrivate *priv;
+  cairo_rectangle_t visible;
+  cairo_rectangle_t *rect;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (!mech_text_range_get_bounds (priv->visible, &visible_start, &visible_end))
+    return;
+
+  /* Paragraphs outside the visible range are laid out when scrolled in */
+  if (mech_text_buffer_iter_compare (from, &visible_start) < 0)
+    from = &visible_start;
+  if (mech_text_buffer_iter_compare (to, &visible_end) > 0)
+    to = &visible_end;
+
+  if (mech_text_buffer_iter_compare (from, to) >= 0)
+    return;
+
+  data.damage = cairo_region_create ();
+  data.damage_below = G_MAXDOUBLE;
+  data.restyled = (restyled == TRUE);
+
   _mech_text_view_paragraph_foreach (view, from, to,
                                      _text_view_store_layout,
-                                     NULL);
+                                     &data);
+  _mech_text_view_recalculate_visible (view, priv->layout_width);
+
+  /* The anchor paragraph may be the edited one, so
+   * everything could have moved after recalculating.
+   */
+  if (data.has_first)
+    {
+      rect = NULL;
+
+      if (mech_text_buffer_get_iter_at_paragraph (priv->buffer, &first,
+                                                  data.first_paragraph))
+        mech_text_buffer_get_data (priv->buffer, &first,
+                                   priv->paragraph_extents_id, &rect, 0);
+
+      if (!rect || rect->y != data.first_y)
+        data.damage_below = -G_MAXDOUBLE;
+    }
+
+  if (data.damage_below == -G_MAXDOUBLE)
+    mech_area_redraw ((MechArea *) view, NULL);
+  else
+    {
+      if (data.damage_below != G_MAXDOUBLE)
+        {
+          _mech_area_get_renderable_rect ((MechArea *) view, &visible);
+          below.x = floor (visible.x);
+          below.width = ceil (visible.x + visible.width) - below.x;
+          below.y = floor (data.damage_below);
+          below.height = MAX (0, ceil (visible.y + visible.height) - below.y);
+          cairo_region_union_rectangle (data.damage, &below);
+        }
+
+      if (!cairo_region_is_empty (data.damage))
+        mech_area_redraw ((MechArea *) view, data.damage);
+    }
+
+  cairo_region_destroy (data.damage);
+}
+
+static gboolean
+_text_view_cache_paragraph (MechTextView *view,
+                            MechTextIter *start,
+                            MechTextIter *end,
+                            gpointer      user_data)
+{
+  MechTextViewPrivate *priv;
+  PangoLayout *layout;
+
+  priv = mech_text_view_get_instance_private (view);
+  mech_text_buffer_get_data (priv->buffer, start,
+                             priv->paragraph_layout_id, &layout, 0);
+  if (layout)
+    _text_view_cache_layout (view, start, layout);
+
+  return TRUE;
 }
 
 static void
@@ -1159,10 +1972,82 @@ _text_view_unset_data (MechTextView *view,
   MechTextViewPrivate *priv;
 
   priv = mech_text_view_get_instance_private (view);
+
+  if (priv->layout_cache_max == 0)
+    {
+      mech_text_buffer_set_data (priv->buffer, from, to,
+                                 priv->paragraph_layout_id, NULL,
+                                 priv->paragraph_extents_id, NULL,
+                                 0);
+      return;
+    }
+
+  /* Layouts are kept around in case the paragraphs
+   * are scrolled back in, extents are meaningless.
+   */
+  _mech_text_view_paragraph_foreach (view, from, to,
+                                     _text_view_cache_paragraph, NULL);
   mech_text_buffer_set_data (priv->buffer, from, to,
-                             priv->paragraph_layout_id, NULL,
                              priv->paragraph_extents_id, NULL,
                              0);
+  _text_view_trim_layout_cache (view);
+}
+
+static gboolean
+_text_view_anchor_tail (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+  cairo_rectangle_t visible;
+  MechTextIter start, end;
+  TextIterator *iterator;
+  gboolean filled;
+
+  priv = mech_text_view_get_instance_private (view);
+  _mech_area_get_renderable_rect ((MechArea *) view, &visible);
+
+  if (visible.height <= 0)
+    return FALSE;
+
+  /* Lay out backwards from the buffer end just the paragraphs
+   * filling the viewport, so the last line stays at its bottom
+   * edge and nothing offscreen gets measured.
+   */
+  mech_text_buffer_get_bounds (priv->buffer, NULL, &end);
+  iterator = _calculate_extents_iterator_new (view, &end, TRUE,
+                                              visible.y + visible.height,
+                                              priv->layout_width, TRUE);
+  filled = _calculate_extents_iterator_run (iterator, visible.height, NULL);
+  start = iterator->current;
+  _text_iterator_free (iterator);
+
+  if (!filled)
+    return FALSE;
+
+  _text_view_set_visible_bounds (view, &start, &end);
+
+  return TRUE;
+}
+
+static void
+_text_view_buffer_insert (MechTextBuffer *buffer,
+                          MechTextIter   *start,
+                          MechTextIter   *end,
+                          gchar          *text,
+                          gulong          len,
+                          MechTextView   *view)
+{
+  _text_view_forget_heights (view, start, start);
+}
+
+static void
+_text_view_buffer_insert_finish (MechTextBuffer *buffer,
+                                 MechTextIter   *start,
+                                 MechTextIter   *end,
+                                 gchar          *text,
+                                 gulong          len,
+                                 MechTextView   *view)
+{
+  _text_view_finish_edit (view);
 }
 
 static void
@@ -1183,6 +2068,16 @@ _text_view_buffer_insert_after (MechTextBuffer *buffer,
   if (!mech_text_range_get_bounds (priv->visible, &visible_start, &visible_end))
     return;
 
+  /* Text appended while the end is visible */
+  if (priv->follow_tail &&
+      mech_text_buffer_iter_is_end (end) &&
+      mech_text_buffer_iter_is_end (&visible_end) &&
+      _text_view_anchor_tail (view))
+    {
+      mech_area_redraw ((MechArea *) view, NULL);
+      return;
+    }
+
   mech_text_buffer_paragraph_extents (buffer, start, &para_start, &para_end);
 
   if (mech_text_buffer_iter_compare (&para_start, start) == 0)
@@ -1191,13 +2086,9 @@ _text_view_buffer_insert_after (MechTextBuffer *buffer,
   if (mech_text_buffer_iter_compare (&para_end, end) >= 0)
     mech_text_buffer_iter_next_paragraph (buffer, &para_end);
 
-  if (mech_text_buffer_iter_compare (start, &visible_start) >= 0 &&
-      mech_text_buffer_iter_compare (end, &visible_end) <= 0)
-    {
-      _text_view_store_layouts (view, &para_start, &para_end);
-      _mech_text_view_recalculate_visible (view, priv->layout_width);
-      mech_area_redraw ((MechArea *) view, NULL);
-    }
+  if (mech_text_buffer_iter_compare (start, &visible_end) <= 0 &&
+      mech_text_buffer_iter_compare (end, &visible_start) > 0)
+    _text_view_refresh_layouts (view, &para_start, &para_end, FALSE);
   else if (mech_text_buffer_iter_compare (end, &visible_start) <= 0)
     priv->visible_start_offset += len;
 }
@@ -1208,13 +2099,39 @@ _text_view_buffer_delete (MechTextBuffer *buffer,
                           MechTextIter   *end,
                           MechTextView   *view)
 {
-  MechTextIter visible_start;
+  MechTextIter visible_start, para_start;
   MechTextViewPrivate *priv;
+  guint paragraph, last;
+  PangoLayout *layout;
   gssize len;
 
   priv = mech_text_view_get_instance_private (view);
   len = mech_text_buffer_get_byte_offset (buffer, start, end);
   priv->buffer_bytes -= len;
+  _text_view_forget_heights (view, start, end);
+
+  /* Paragraphs going away entirely drop their cached layouts
+   * now, edited ones at both ends are handled after the edit.
+   */
+  paragraph = mech_text_buffer_iter_get_paragraph (buffer, start);
+  last = mech_text_buffer_iter_get_paragraph (buffer, end);
+  mech_text_buffer_paragraph_extents (buffer, start, &para_start, NULL);
+
+  if (mech_text_buffer_iter_compare (&para_start, start) != 0)
+    paragraph++;
+
+  while (paragraph < last &&
+         mech_text_buffer_get_iter_at_paragraph (buffer, &para_start,
+                                                 paragraph))
+    {
+      mech_text_buffer_get_data (buffer, &para_start,
+                                 priv->paragraph_layout_id, &layout, 0);
+
+      if (layout)
+        _text_view_uncache_layout (view, layout);
+
+      paragraph++;
+    }
 
   if (mech_text_range_get_bounds (priv->visible, &visible_start, NULL) &&
       mech_text_buffer_iter_compare (end, &visible_start) <= 0)
@@ -1237,13 +2154,18 @@ _text_view_buffer_delete_after (MechTextBuffer *buffer,
   mech_text_buffer_iter_next_paragraph (buffer, &end);
 
   if (mech_text_range_get_bounds (priv->visible, &visible_start, &visible_end) &&
-      mech_text_buffer_iter_compare (&start, &visible_start) >= 0 &&
-      mech_text_buffer_iter_compare (&end, &visible_end) <= 0)
-    {
-      _text_view_store_layouts (view, &start, &end);
-      _mech_text_view_recalculate_visible (view, priv->layout_width);
-      mech_area_redraw ((MechArea *) view, NULL);
-    }
+      mech_text_buffer_iter_compare (&start, &visible_end) <= 0 &&
+      mech_text_buffer_iter_compare (&end, &visible_start) >= 0)
+    _text_view_refresh_layouts (view, &start, &end, FALSE);
+}
+
+static void
+_text_view_buffer_delete_finish (MechTextBuffer *buffer,
+                                 MechTextIter   *start,
+                                 MechTextIter   *end,
+                                 MechTextView   *view)
+{
+  _text_view_finish_edit (view);
 }
 
 static void
@@ -1280,14 +2202,20 @@ _mech_text_view_set_buffer (MechTextView   *view,
   if (priv->buffer)
     {
       _text_view_clear_visible (view);
+      _text_view_clear_layout_cache (view);
 
       g_signal_handlers_disconnect_by_data (priv->buffer, view);
       mech_text_buffer_unregister_instance (priv->buffer, view);
       g_object_unref (priv->buffer);
       priv->paragraph_layout_id = 0;
       priv->paragraph_extents_id = 0;
+      priv->paragraph_height_id = 0;
     }
 
+  _text_view_cancel_measure (view);
+  priv->measured_height = 0;
+  priv->measured_bytes = 0;
+  priv->measure_next = 0;
   priv->buffer = buffer;
 
   if (priv->buffer)
@@ -1304,6 +2232,9 @@ _mech_text_view_set_buffer (MechTextView   *view,
       priv->text_style_id =
         mech_text_buffer_register_data (priv->buffer, view,
                                         MECH_TYPE_TEXT_ATTRIBUTES);
+      priv->paragraph_height_id =
+        mech_text_buffer_register_data (priv->buffer, view,
+                                        G_TYPE_DOUBLE);
 
       mech_text_buffer_get_bounds (priv->buffer, &start, NULL);
 
@@ -1311,6 +2242,8 @@ _mech_text_view_set_buffer (MechTextView   *view,
       g_signal_connect_swapped (priv->visible, "removed",
                                 G_CALLBACK (_text_view_unset_data), view);
 
+      g_signal_connect (priv->buffer, "insert",
+                        G_CALLBACK (_text_view_buffer_insert), view);
       g_signal_connect_after (priv->buffer, "insert",
 			      G_CALLBACK (_text_view_buffer_insert_after),
                               view);
@@ -1320,8 +2253,19 @@ _mech_text_view_set_buffer (MechTextView   *view,
       g_signal_connect (priv->buffer, "delete",
                         G_CALLBACK (_text_view_buffer_delete), view);
 
+      /* Stale heights and layouts are dropped last, as
+       * it may invalidate the iters passed to the signal.
+       */
+      g_signal_connect_after (priv->buffer, "insert",
+                              G_CALLBACK (_text_view_buffer_insert_finish),
+                              view);
+      g_signal_connect_after (priv->buffer, "delete",
+                              G_CALLBACK (_text_view_buffer_delete_finish),
+                              view);
+
       priv->buffer_bytes = mech_text_buffer_get_byte_offset (priv->buffer,
                                                              NULL, NULL);
+      _text_view_queue_measure (view);
     }
 
   g_object_notify (G_OBJECT (view), "buffer");
@@ -1361,6 +2305,11 @@ mech_text_view_class_init (MechTextViewClass *klass)
 static void
 mech_text_view_init (MechTextView *view)
 {
+  MechTextViewPrivate *priv;
+
+  priv = mech_text_view_get_instance_private (view);
+  priv->cached_layouts = g_hash_table_new (NULL, NULL);
+  priv->layout_cache_max = DEFAULT_LAYOUT_CACHE_SIZE;
 }
 
 MechArea *
@@ -1510,6 +2459,24 @@ mech_text_view_get_cursor_locations (MechTextView       *view,
   return TRUE;
 }
 
+static void
+_text_view_restyle_paragraphs (MechTextView *view,
+                               guint         first,
+                               guint         last)
+{
+  MechTextViewPrivate *priv;
+  MechTextIter from, to;
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (!mech_text_buffer_get_iter_at_paragraph (priv->buffer, &from, first))
+    return;
+
+  /* Falls back to the buffer end past the last paragraph */
+  mech_text_buffer_get_iter_at_paragraph (priv->buffer, &to, last + 1);
+  _text_view_refresh_layouts (view, &from, &to, TRUE);
+}
+
 static gboolean
 _text_view_combine_section_attributes (MechTextView *view,
                                        MechTextIter *start,
@@ -1565,13 +2532,19 @@ mech_text_view_combine_attributes (MechTextView       *view,
                                    MechTextIter       *end,
                                    MechTextAttributes *attributes)
 {
+  MechTextViewPrivate *priv;
   TextIterator *iterator;
+  guint first, last;
 
   g_return_if_fail (MECH_IS_TEXT_VIEW (view));
   g_return_if_fail (MECH_IS_TEXT_ATTRIBUTES (attributes));
   g_return_if_fail (start != NULL);
   g_return_if_fail (end != NULL);
 
+  priv = mech_text_view_get_instance_private (view);
+  first = mech_text_buffer_iter_get_paragraph (priv->buffer, start);
+  last = mech_text_buffer_iter_get_paragraph (priv->buffer, end);
+
   iterator = _style_iterator_new (view, start, end,
                                   _text_view_combine_section_attributes,
                                   attributes);
@@ -1580,6 +2553,7 @@ mech_text_view_combine_attributes (MechTextView       *view,
     ;
 
   _text_iterator_free (iterator);
+  _text_view_restyle_paragraphs (view, first, last);
 }
 
 void
@@ -1588,12 +2562,18 @@ mech_text_view_unset_attributes (MechTextView            *view,
                                  MechTextIter            *end,
                                  MechTextAttributeFields  fields)
 {
+  MechTextViewPrivate *priv;
   TextIterator *iterator;
+  guint first, last;
 
   g_return_if_fail (MECH_IS_TEXT_VIEW (view));
   g_return_if_fail (start != NULL);
   g_return_if_fail (end != NULL);
 
+  priv = mech_text_view_get_instance_private (view);
+  first = mech_text_buffer_iter_get_paragraph (priv->buffer, start);
+  last = mech_text_buffer_iter_get_paragraph (priv->buffer, end);
+
   iterator = _style_iterator_new (view, start, end,
                                   _text_view_unset_section_attributes,
                                   GUINT_TO_POINTER (fields));
@@ -1602,6 +2582,7 @@ mech_text_view_unset_attributes (MechTextView            *view,
     ;
 
   _text_iterator_free (iterator);
+  _text_view_restyle_paragraphs (view, first, last);
 }
 
 MechTextAttributes *
@@ -1624,3 +2605,70 @@ mech_text_view_get_attributes (MechTextView *view,
 
   return copy;
 }
+
+void
+mech_text_view_set_follow_tail (MechTextView *view,
+                                gboolean      follow_tail)
+{
+  MechTextViewPrivate *priv;
+
+  g_return_if_fail (MECH_IS_TEXT_VIEW (view));
+
+  priv = mech_text_view_get_instance_private (view);
+  priv->follow_tail = (follow_tail == TRUE);
+}
+
+gboolean
+mech_text_view_get_follow_tail (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_VIEW (view), FALSE);
+
+  priv = mech_text_view_get_instance_private (view);
+  return priv->follow_tail;
+}
+
+void
+mech_text_view_set_layout_cache_size (MechTextView *view,
+                                      gsize         size)
+{
+  MechTextViewPrivate *priv;
+
+  g_return_if_fail (MECH_IS_TEXT_VIEW (view));
+
+  priv = mech_text_view_get_instance_private (view);
+  priv->layout_cache_max = size;
+  _text_view_trim_layout_cache (view);
+}
+
+gsize
+mech_text_view_get_layout_cache_size (MechTextView *view)
+{
+  MechTextViewPrivate *priv;
+
+  g_return_val_if_fail (MECH_IS_TEXT_VIEW (view), 0);
+
+  priv = mech_text_view_get_instance_private (view);
+  return priv->layout_cache_max;
+}
+
+void
+mech_text_view_get_layout_cache_stats (MechTextView *view,
+                                       guint        *hits,
+                                       guint        *misses,
+                                       guint        *evictions)
+{
+  MechTextViewPrivate *priv;
+
+  g_return_if_fail (MECH_IS_TEXT_VIEW (view));
+
+  priv = mech_text_view_get_instance_private (view);
+
+  if (hits)
+    *hits = priv->layout_cache_hits;
+  if (misses)
+    *misses = priv->layout_cache_misses;
+  if (evictions)
+    *evictions = priv->layout_cache_evictions;
+}
@@ -67,6 +67,20 @@ void                 mech_text_view_unset_attributes     (MechTextView
 MechTextAttributes * mech_text_view_get_attributes       (MechTextView            *view,
                                                           MechTextIter            *iter);
 
+/* Log tailing */
+void                 mech_text_view_set_follow_tail      (MechTextView            *view,
+                                                          gboolean                 follow_tail);
+gboolean             mech_text_view_get_follow_tail      (MechTextView            *view);
+
+/* Layout cache */
+void                 mech_text_view_set_layout_cache_size  (MechTextView          *view,
+                                                            gsize                  size);
+gsize                mech_text_view_get_layout_cache_size  (MechTextView          *view);
+void                 mech_text_view_get_layout_cache_stats (MechTextView          *view,
+                                                            guint                 *hits,
+                                                            guint                 *misses,
+                                                            guint                 *evictions);
+
 G_END_DECLS
 
 #endif /* __MECH_TEXT_VIEW_H__ */
@@ -58,3 +58,18 @@ mech_border_free (MechBorder *border)
 {
   g_slice_free (MechBorder, border);
 }
+
+G_DEFINE_BOXED_TYPE (MechFrameStats, mech_frame_stats,
+                     mech_frame_stats_copy, mech_frame_stats_free)
+
+MechFrameStats *
+mech_frame_stats_copy (MechFrameStats *stats)
+{
+  return g_slice_dup (MechFrameStats, stats);
+}
+
+void
+mech_frame_stats_free (MechFrameStats *stats)
+{
+  g_slice_free (MechFrameStats, stats);
+}
@@ -25,10 +25,12 @@ G_BEGIN_DECLS
 #define MECH_TYPE_COLOR (mech_color_get_type ())
 #define MECH_TYPE_POINT (mech_point_get_type ())
 #define MECH_TYPE_BORDER (mech_border_get_type ())
+#define MECH_TYPE_FRAME_STATS (mech_frame_stats_get_type ())
 
 typedef struct _MechColor MechColor;
 typedef struct _MechPoint MechPoint;
 typedef struct _MechBorder MechBorder;
+typedef struct _MechFrameStats MechFrameStats;
 
 struct _MechColor
 {
@@ -57,6 +59,27 @@ struct _MechBorder
   guint bottom_unit : 4;
 };
 
+struct _MechFrameStats
+{
+  gint64 frame_time;
+
+  /* Durations in microseconds, resize_time includes
+   * layout_time, render_time includes offscreen_time
+   * and push_time.
+   */
+  gint64 total_time;
+  gint64 resize_time;
+  gint64 layout_time;
+  gint64 render_time;
+  gint64 offscreen_time;
+  gint64 push_time;
+
+  guint n_areas_visited;
+  guint n_areas_culled;
+  guint n_offscreens;
+  guint64 damaged_pixels;
+};
+
 GType        mech_color_get_type    (void) G_GNUC_CONST;
 MechColor *  mech_color_copy        (MechColor *color);
 void         mech_color_free        (MechColor *color);
@@ -69,6 +92,10 @@ GType        mech_border_get_type   (void) G_GNUC_CONST;
 MechBorder * mech_border_copy       (MechBorder *border);
 void         mech_border_free       (MechBorder *border);
 
+GType            mech_frame_stats_get_type (void) G_GNUC_CONST;
+MechFrameStats * mech_frame_stats_copy     (MechFrameStats *stats);
+void             mech_frame_stats_free     (MechFrameStats *stats);
+
 G_END_DECLS
 
 #endif /* __MECH_TYPES_H__ */
@@ -317,6 +317,7 @@ mech_window_frame_init (MechWindowFrame *frame)
   priv->resizable = TRUE;
 
   mech_area_set_name (area, "window-frame");
+  mech_area_set_retain_drawing (area, TRUE);
   mech_area_set_events (area,
                         MECH_BUTTON_MASK | MECH_CROSSING_MASK |
                         MECH_MOTION_MASK);
@@ -22,6 +22,7 @@
 #include <mechane/mech-area-private.h>
 #include <mechane/mech-window-frame-private.h>
 #include <mechane/mech-clock-private.h>
+#include <mechane/mech-style-private.h>
 #include <mechane/mech-window-private.h>
 #include <mechane/mechane.h>
 
@@ -332,28 +333,38 @@ mech_window_class_init (MechWindowClass *klass)
 static MechStyle *
 _load_default_style (void)
 {
+  static MechStyle *default_style = NULL;
+  static gboolean loaded = FALSE;
   GError *error = NULL;
   MechTheme *theme;
-  MechStyle *style;
   GFile *file;
 
-  style = mech_style_new ();
-  theme = mech_theme_new ();
-
-  file = g_file_new_for_uri ("resource://org/mechane/libmechane/DefaultTheme/style");
-  mech_theme_load_style_from_file (theme, style, file, &error);
-  g_object_unref (file);
-  g_object_unref (theme);
-
-  if (error)
+  /* The default theme is parsed once, windows get
+   * copies sharing its compiled data until modified.
+   */
+  if (!loaded)
     {
-      g_warning ("Error loading default theme: %s\n", error->message);
-      g_object_unref (style);
-      g_error_free (error);
-      return NULL;
+      loaded = TRUE;
+      default_style = mech_style_new ();
+      theme = mech_theme_new ();
+
+      file = g_file_new_for_uri ("resource://org/mechane/libmechane/DefaultTheme/style");
+      mech_theme_load_style_from_file (theme, default_style, file, &error);
+      g_object_unref (file);
+      g_object_unref (theme);
+
+      if (error)
+        {
+          g_warning ("Error loading default theme: %s\n", error->message);
+          g_clear_object (&default_style);
+          g_error_free (error);
+        }
     }
 
-  return style;
+  if (!default_style)
+    return NULL;
+
+  return _mech_style_copy (default_style);
 }
 
 static void
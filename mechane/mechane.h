@@ -35,6 +35,7 @@ G_BEGIN_DECLS
 #include <mechane/mech-area.h>
 #include <mechane/mech-container.h>
 #include <mechane/mech-window.h>
+#include <mechane/mech-headless.h>
 
 /* Basic interfaces */
 #include <mechane/mech-activatable.h>
@@ -0,0 +1,92 @@
+#include <mechane/mechane.h>
+
+#define FRAME_INTERVAL 16667
+
+static gboolean
+step_frame (MechWindow *window,
+            gint64     *frame_time,
+            guint64    *damage)
+{
+  MechFrameStats stats;
+  gboolean stepped;
+
+  *frame_time += FRAME_INTERVAL;
+  stepped = mech_headless_step (window, *frame_time);
+  mech_headless_get_damage (window, damage, NULL);
+
+  if (stepped &&
+      mech_container_get_frame_stats ((MechContainer *) window, &stats))
+    g_print ("Frame at %" G_GINT64_FORMAT ": %" G_GINT64_FORMAT " us, "
+             "%u areas, %" G_GUINT64_FORMAT " pixels damaged\n",
+             *frame_time, stats.total_time, stats.n_areas_visited,
+             *damage);
+
+  return stepped;
+}
+
+static gboolean
+check_frames (MechWindow *window,
+              MechArea   *area)
+{
+  guint64 full_damage, damage;
+  gint64 frame_time = 0;
+  guint n_updates;
+
+  /* The first frame paints everything */
+  if (!step_frame (window, &frame_time, &full_damage) ||
+      mech_headless_get_n_updates (window) != 1 ||
+      full_damage == 0)
+    {
+      g_warning ("First frame wasn't rendered");
+      return FALSE;
+    }
+
+  /* Nothing changed, nothing is pushed */
+  n_updates = mech_headless_get_n_updates (window);
+  step_frame (window, &frame_time, &damage);
+
+  if (mech_headless_get_n_updates (window) != n_updates)
+    {
+      g_warning ("Idle frame pushed an update");
+      return FALSE;
+    }
+
+  /* A redraw only damages the area */
+  mech_area_redraw (area, NULL);
+
+  if (!step_frame (window, &frame_time, &damage) ||
+      mech_headless_get_n_updates (window) != n_updates + 1 ||
+      damage == 0 || damage > full_damage)
+    {
+      g_warning ("Redraw frame damaged %" G_GUINT64_FORMAT " pixels, "
+                 "expected at most %" G_GUINT64_FORMAT,
+                 damage, full_damage);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  MechWindow *window;
+  MechArea *area;
+  gboolean success;
+
+  g_setenv ("MECH_BACKEND", "headless", TRUE);
+
+  window = mech_window_new ();
+  area = mech_area_new (NULL, 0);
+  mech_area_set_preferred_size (area, MECH_AXIS_X, MECH_UNIT_PX, 200);
+  mech_area_set_preferred_size (area, MECH_AXIS_Y, MECH_UNIT_PX, 100);
+  mech_area_add (mech_container_get_root ((MechContainer *) window), area);
+
+  mech_window_set_visible (window, TRUE);
+  mech_container_queue_resize ((MechContainer *) window, 200, 100);
+
+  success = check_frames (window, area);
+  g_object_unref (window);
+
+  return success ? 0 : 1;
+}
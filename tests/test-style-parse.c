@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+#include <mechane/mechane.h>
+
+static gchar *
+create_theme (guint n_rules)
+{
+  GString *str;
+  guint i;
+
+  str = g_string_new ("- foreground: #426a41;\n\n");
+
+  for (i = 0; i < n_rules; i++)
+    {
+      g_string_append_printf (str,
+                              "element-%d {\n"
+                              "  - border: #565 1px;\n"
+                              "  - corner-radius [right]: 3px;\n"
+                              "  - background: linear 0,0,0,20 { 0%%: rgba(80, 140, 170, 1); 100%%: rgba (15, 0, 210, 0.6) };\n"
+                              "  - margin: 2px;\n"
+                              "  - font: monospace;\n"
+                              "};\n\n"
+                              "element-%d[active] {\n"
+                              "  - border: #565 1px;\n"
+                              "  - background: rgba (155, 155, 155, 0.6);\n"
+                              "  - padding: 4px;\n"
+                              "};\n\n",
+                              i, i);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static gboolean
+check_style (MechStyle *style)
+{
+  MechBorder outer, inner;
+  MechRenderer *renderer;
+  MechArea *area;
+  gboolean retval;
+
+  area = g_object_ref_sink (mech_area_new ("element-0", 0));
+  renderer = mech_style_lookup_renderer (style, area, 0);
+
+  /* The border is the space between the margin and the padding */
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_BORDER, &outer);
+  mech_renderer_get_border_extents (renderer, MECH_EXTENT_PADDING, &inner);
+
+  retval = (outer.left == 2 && outer.right == 2 &&
+            outer.top == 2 && outer.bottom == 2 &&
+            inner.left - outer.left == 1 &&
+            inner.right - outer.right == 1 &&
+            inner.top - outer.top == 1 &&
+            inner.bottom - outer.bottom == 1);
+
+  g_object_unref (renderer);
+  g_object_unref (area);
+
+  return retval;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GError *error = NULL;
+  gchar *data, *formatted_size;
+  MechTheme *theme;
+  MechStyle *style;
+  GTimer *timer;
+  gint n_rules = 0, n_runs = 10, i, retval = 0;
+  gdouble elapsed;
+  gsize len;
+
+  if (argc > 1)
+    n_rules = atoi (argv[1]);
+  if (argc > 2)
+    n_runs = MAX (atoi (argv[2]), 1);
+
+  if (n_rules <= 0)
+    {
+      gchar *basename;
+
+      basename = g_filename_display_basename (argv[0]);
+      g_print ("Usage: %s <n-rules> [n-runs]\n\n", basename);
+      n_rules = 5000;
+      g_free (basename);
+    }
+
+  data = create_theme (n_rules);
+  len = strlen (data);
+  formatted_size = g_format_size (len);
+  theme = mech_theme_new ();
+  timer = g_timer_new ();
+  elapsed = 0;
+
+  for (i = 0; i < n_runs; i++)
+    {
+      style = mech_style_new ();
+      g_timer_start (timer);
+
+      if (!mech_theme_load_style_from_data (theme, style, data, len, &error))
+        {
+          g_warning ("Could not parse theme: %s", error->message);
+          g_error_free (error);
+          g_object_unref (style);
+          retval = 1;
+          break;
+        }
+
+      elapsed += g_timer_elapsed (timer, NULL);
+
+      if (!check_style (style))
+        {
+          g_warning ("Parsed style doesn't match the theme");
+          g_object_unref (style);
+          retval = 1;
+          break;
+        }
+
+      g_object_unref (style);
+    }
+
+  if (retval == 0)
+    g_print ("Parsed %d rules (%s) %d times, %f per run, %f MB/s\n",
+             n_rules * 2, formatted_size, n_runs, elapsed / n_runs,
+             (len * n_runs) / (elapsed * 1024 * 1024));
+
+  g_timer_destroy (timer);
+  g_object_unref (theme);
+  g_free (formatted_size);
+  g_free (data);
+
+  return retval;
+}